@@ -0,0 +1,132 @@
+#!/bin/bash
+# Compares the C and Rust implementations on identical inputs. For every case of spec.tsv, generates
+# a corpus from the pattern with the C library's generator (main --generate, fixed seed), then runs
+# each implementation's driver on it in a process of its own:
+#
+#   c_dfa         c/regex-compiler/bench/compare.c, table interpreter
+#   c_jit         the same with REGEX_FLAG_JIT
+#   c_nfa_sim     the same, forced to nfa simulation (compile time leaves out locating the blowup)
+#   rust_dfa      rust/regex-compiler/examples/compare.rs, Regex::new
+#   rust_nfa_sim  the same with Regex::new_nfa_sim
+#
+# The C library is built with -O2 (objects included), as the Rust side is with --release.
+#
+# Every driver prints one json line: the fastest of 5 compiles, match throughput over the corpus,
+# lines matched, and peak resident memory before compiling and at the end (the difference is what
+# compiling and matching took on top of the corpus). The lines go to $OUT/results.jsonl and a
+# markdown report comparing the implementations to c_dfa goes to stdout and $OUT/report.md. Lines
+# matched that differ from c_dfa's are flagged, as the implementations should agree.
+#
+# Usage: bench/compare.sh [case ...]    (every case by default)
+# Environment: ROUNDS (passes over each corpus, default 5), TIMEOUT (seconds per driver run,
+# default 60, after which the run is reported as a timeout), OUT (default bench/out)
+
+set -euo pipefail
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+C_DIR=$ROOT/c/regex-compiler
+RUST_DIR=$ROOT/rust/regex-compiler
+SPEC=$ROOT/bench/spec.tsv
+OUT=${OUT:-$ROOT/bench/out}
+ROUNDS=${ROUNDS:-5}
+TIMEOUT=${TIMEOUT:-60}
+IMPLS="c:dfa c:jit c:nfa_sim rust:dfa rust:nfa_sim"
+
+make -s -C "$C_DIR" CCFLAGS="-std=gnu99 -Wall -O2" main compare_bin >&2
+(cd "$RUST_DIR" && cargo build -q --release --offline --example compare) >&2
+
+mkdir -p "$OUT/corpora"
+RESULTS=$OUT/results.jsonl
+: > "$RESULTS"
+
+while IFS=$'\t' read -r name lines length mix pattern; do
+   if [[ -z "$name" || "$name" == \#* ]]; then
+      continue
+   fi
+   if [[ $# -gt 0 && ! " $* " == *" $name "* ]]; then
+      continue
+   fi
+
+   corpus=$OUT/corpora/$name.txt
+   "$C_DIR/bin/main" --generate "$lines" --length "$length" --mix "$mix" --seed 42 "$pattern" \
+      > "$corpus"
+
+   for impl in $IMPLS; do
+      language=${impl%%:*}
+      engine=${impl##*:}
+      if [[ $language == c ]]; then
+         driver=$C_DIR/bin/compare
+      else
+         driver=$RUST_DIR/target/release/examples/compare
+      fi
+      echo "$name: ${language}_$engine" >&2
+      status=0
+      timeout "$TIMEOUT" "$driver" "$engine" "$name" "$pattern" "$corpus" "$ROUNDS" \
+         >> "$RESULTS" || status=$?
+      if [[ $status -ne 0 ]]; then
+         error=$([[ $status -eq 124 ]] && echo "timeout" || echo "failed")
+         echo "{\"impl\":\"${language}_$engine\",\"case\":\"$name\",\"error\":\"$error\"}" \
+            >> "$RESULTS"
+      fi
+   done
+done < "$SPEC"
+
+# One table per case, every implementation relative to c_dfa
+awk '
+function field(name,    pattern) {
+   pattern = "\"" name "\":(\"[^\"]*\"|[-0-9.e]+)"
+   if (!match($0, pattern)) {
+      return ""
+   }
+   value = substr($0, RSTART + length(name) + 3, RLENGTH - length(name) - 3)
+   gsub(/"/, "", value)
+   return value
+}
+{
+   c = field("case")
+   if (!(c in seen)) {
+      seen[c] = 1
+      cases[++num_cases] = c
+   }
+   rows[c] = rows[c] "\n" $0
+}
+END {
+   print "# C vs Rust comparison\n"
+   print "Throughput and memory relative to c_dfa in parentheses. Memory is the growth of peak"
+   print "resident memory over loading the corpus. c_nfa_sim compile times leave out locating the"
+   print "subexpression that hit the one-state limit forcing it.\n"
+   for (i = 1; i <= num_cases; i++) {
+      c = cases[i]
+      n = split(substr(rows[c], 2), lines, "\n")
+      base_mbs = 0; base_matched = ""; base_kb = 0
+      for (j = 1; j <= n; j++) {
+         $0 = lines[j]
+         if (field("impl") == "c_dfa" && field("error") == "") {
+            base_mbs = field("mb_per_second")
+            base_matched = field("matched")
+            base_kb = field("peak_rss_kb") - field("rss_before_kb")
+         }
+      }
+      printf "## %s\n\n", c
+      print "| impl | compile ms | MB/s | ns/line | matched | memory KB |"
+      print "| --- | ---: | ---: | ---: | ---: | ---: |"
+      for (j = 1; j <= n; j++) {
+         $0 = lines[j]
+         if (field("error") != "") {
+            printf "| %s | %s | | | | |\n", field("impl"), field("error")
+            continue
+         }
+         mbs = field("mb_per_second")
+         kb = field("peak_rss_kb") - field("rss_before_kb")
+         matched = field("matched")
+         # Parenthesized, as a ">" in printf arguments would redirect its output
+         ratio = (base_mbs > 0 ? mbs / base_mbs : 0)
+         flag = (base_matched != "" && matched != base_matched ? " MISMATCH" : "")
+         memory_ratio = (base_kb > 0 ? sprintf("%.2fx", kb / base_kb) : "-")
+         printf "| %s | %.3f | %.1f (%.2fx) | %.1f | %s%s | %d (%s) |\n", field("impl"),
+                field("compile_ms"), mbs, ratio, field("ns_per_line"), matched, flag, kb,
+                memory_ratio
+      }
+      print ""
+   }
+}' "$RESULTS" | tee "$OUT/report.md"
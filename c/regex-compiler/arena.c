@@ -0,0 +1,124 @@
+#include "arena.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "utils.h"
+
+#define ARENA_ALIGN 16  // enough for any type the compiler builds (and what malloc gives on x86-64)
+#define ARENA_MIN_CHUNK_SIZE 4096
+#define ARENA_MAX_CHUNK_SIZE (1 << 20)
+#define ALIGN_UP(n, a) (((n) + (a)-1) & ~((size_t)(a)-1))
+
+typedef struct arena_chunk arena_chunk_t;
+
+struct arena_chunk {
+      arena_chunk_t* next;
+      size_t size;  // usable bytes in data
+      size_t used;
+      unsigned char data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+struct arena {
+      arena_chunk_t* head;  // chunk currently being bumped; older chunks follow it
+      size_t next_chunk_size;
+      size_t size;
+      void* last;  // most recent allocation, which arena_grow() can extend in place
+};
+
+static arena_chunk_t* new_chunk(size_t);
+
+/**
+ * Public API
+*/
+
+arena_t* new_arena(void) {
+   arena_t* arena = xmalloc(sizeof(arena_t));
+   arena->head = NULL;
+   arena->next_chunk_size = ARENA_MIN_CHUNK_SIZE;
+   arena->size = 0;
+   arena->last = NULL;
+   return arena;
+}
+
+void* arena_alloc(arena_t* arena, size_t size) {
+   size = ALIGN_UP(size == 0 ? 1 : size, ARENA_ALIGN);
+   arena_chunk_t* chunk = arena->head;
+
+   if (chunk == NULL || chunk->size - chunk->used < size) {
+      if (size > arena->next_chunk_size / 2) {
+         // Large allocations get a chunk of their own behind the head, so the space left in the head
+         // chunk isn't thrown away
+         arena_chunk_t* large = new_chunk(size);
+         large->used = size;
+         if (chunk == NULL) {
+            large->next = NULL;
+            arena->head = large;
+         } else {
+            large->next = chunk->next;
+            chunk->next = large;
+         }
+         arena->size += size;
+         arena->last = NULL;
+         return large->data;
+      }
+
+      // Chunks double in size so a big compilation needs only a few of them
+      chunk = new_chunk(arena->next_chunk_size);
+      chunk->next = arena->head;
+      arena->head = chunk;
+      if (arena->next_chunk_size < ARENA_MAX_CHUNK_SIZE) {
+         arena->next_chunk_size *= 2;
+      }
+   }
+
+   void* ptr = chunk->data + chunk->used;
+   chunk->used += size;
+   arena->size += size;
+   arena->last = ptr;
+   return ptr;
+}
+
+void* arena_grow(arena_t* arena, void* ptr, size_t old_size, size_t new_size) {
+   if (ptr == NULL) {
+      return arena_alloc(arena, new_size);
+   }
+
+   arena_chunk_t* chunk = arena->head;
+   size_t old_aligned = ALIGN_UP(old_size == 0 ? 1 : old_size, ARENA_ALIGN);
+   size_t new_aligned = ALIGN_UP(new_size == 0 ? 1 : new_size, ARENA_ALIGN);
+   if (ptr == arena->last && chunk->used - old_aligned + new_aligned <= chunk->size) {
+      chunk->used += new_aligned - old_aligned;
+      arena->size += new_aligned - old_aligned;
+      return ptr;
+   }
+
+   void* grown = arena_alloc(arena, new_size);
+   memcpy(grown, ptr, old_size);
+   return grown;
+}
+
+size_t arena_size(arena_t* arena) { return arena->size; }
+
+void arena_release(arena_t* arena) {
+   arena_chunk_t* chunk = arena->head;
+   while (chunk != NULL) {
+      arena_chunk_t* next = chunk->next;
+      free(chunk);
+      chunk = next;
+   }
+   free(arena);
+}
+
+/**
+ * Helpers (private)
+*/
+
+static arena_chunk_t* new_chunk(size_t size) {
+   arena_chunk_t* chunk = xmalloc(sizeof(arena_chunk_t) + size);
+   chunk->next = NULL;
+   chunk->size = size;
+   chunk->used = 0;
+   return chunk;
+}
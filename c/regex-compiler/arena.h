@@ -0,0 +1,35 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct arena arena_t;
+
+/**
+ * Creates a bump allocator. Everything allocated from it is freed at once by arena_release(), so
+ * structures built in an arena (ast, nfa, dfa) have no destructors of their own.
+ */
+arena_t* new_arena(void);
+
+/**
+ * Allocates size bytes, aligned for any type. Never returns null (exits like xmalloc).
+ */
+void* arena_alloc(arena_t*, size_t size);
+
+/**
+ * Grows an allocation from old_size to new_size bytes, keeping its contents. Grows in place when ptr
+ * is the arena's most recent allocation, otherwise copies (the old bytes stay until release).
+ */
+void* arena_grow(arena_t*, void* ptr, size_t old_size, size_t new_size);
+
+/**
+ * Returns the number of bytes handed out by the arena so far.
+ */
+size_t arena_size(arena_t*);
+
+/**
+ * Frees the arena and everything allocated from it.
+ */
+void arena_release(arena_t*);
+
+#endif  // ARENA_H
@@ -0,0 +1,565 @@
+/**
+ * Benchmark suite. Every case of a catalogue of patterns (including pathological ones) runs over a
+ * synthetic corpus of its own (words, log lines, random text, adversarial inputs, or strings
+ * generated from the pattern's dfa by regex_generate() and regex_generate_near_miss()) with each
+ * engine: the table interpreter, the JIT (REGEX_FLAG_JIT) and nfa simulation (forced by a compile
+ * limit of one dfa state). Each run reports regex_accepts() and regex_test() throughput, compile
+ * time (of a fallback without looking for the subexpression that hit the limit, see skip_locate)
+ * and the memory the compiled regex holds. Then compares a large hostname blocklist before and
+ * after regex_relayout() on skewed traffic, and times compiling generated 1 MB patterns (blocklists
+ * and deeply nested groups).
+ *
+ * With --json every measurement is printed as one json object per line instead of a table, for
+ * tracking regressions across releases. The corpora are generated from fixed seeds, so results of
+ * the same build on the same machine are comparable.
+ *
+ * Usage: bench [--json] [rounds]
+*/
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jit.h"
+#include "sregex.h"
+#include "utils.h"
+
+#define DEFAULT_ROUNDS 5
+#define CORPUS_LINES 20000
+#define TEST_LINES 100  // regex_test() tries every substring, so it runs over the first lines only
+#define MAX_LINE_SIZE 128
+#define GENERATED_LENGTH 48     // length generated corpora aim for
+#define GENERATED_ACCEPTED 60   // percentage of accepted lines in generated corpora
+#define GENERATED_NEAR_MISSES 30  // the rest is random text
+#define MAX_CATALOGUE_STATES (1 << 16)  // pathological patterns past this fall back to simulation
+#define COMPILE_PATTERN_SIZE (1 << 20)
+#define LAYOUT_HOSTS 4000     // hostnames in the blocklist of the layout case
+#define LAYOUT_HOT_HOSTS 16   // hostnames that get most of its traffic
+#define MAX_HOST_SIZE 24
+
+typedef enum BenchFormat {
+   BENCH_FORMAT_TEXT,
+   BENCH_FORMAT_JSON,
+} BenchFormat;
+
+// One measurement: a row of the table, or a line of json
+typedef struct bench_result {
+      const char* suite;    // "match", "layout" or "compile"
+      const char* name;     // the case
+      const char* engine;   // the engine that ran ("table", "jit" or "nfa_sim"), or the layout
+      const char* op;       // "accepts", "test" or "compile"
+      size_t bytes;         // input bytes per round (the pattern's when compiling)
+      int inputs;           // inputs per round (0 when compiling)
+      int rounds;
+      double seconds;       // over all rounds
+      int matched;          // inputs matched per round
+      double compile_seconds;
+      size_t memory_bytes;  // table image and generated code (nfa simulation isn't counted)
+      const char* status;   // "ok", or why the case couldn't run
+} bench_result_t;
+
+typedef void (*line_generator_f)(char* line, int size, unsigned int* seed);
+
+typedef struct bench_case {
+      const char* name;
+      char* pattern;
+      line_generator_f generate;  // null to generate the corpus from the pattern
+} bench_case_t;
+
+typedef struct bench_engine {
+      const char* name;
+      regex_options_t options;
+} bench_engine_t;
+
+static void generate_words(char*, int, unsigned int*);
+static void generate_identifier(char*, int, unsigned int*);
+static void generate_log_line(char*, int, unsigned int*);
+static void generate_random_text(char*, int, unsigned int*);
+static void generate_ab(char*, int, unsigned int*);
+static void generate_a_runs(char*, int, unsigned int*);
+static void generate_traffic(char*, int, unsigned int*);
+
+// Hostnames of the layout case, shared with generate_traffic()
+static char layout_hosts[LAYOUT_HOSTS][MAX_HOST_SIZE];
+
+// Writes a null-terminated pattern of at most size - 1 characters
+typedef void (*pattern_generator_f)(char* pattern, int size, unsigned int* seed);
+
+typedef struct compile_case {
+      const char* name;
+      pattern_generator_f generate;
+} compile_case_t;
+
+static void generate_ipv4_list(char*, int, unsigned int*);
+static void generate_host_list(char*, int, unsigned int*);
+static void generate_nested_groups(char*, int, unsigned int*);
+static void generate_nested_options(char*, int, unsigned int*);
+
+static const compile_case_t COMPILE_CASES[] = {
+    {"ipv4_list", generate_ipv4_list},        // '1\.2\.3\.4|...'
+    {"host_list", generate_host_list},        // 'abc\.(com|net|org)|...'
+    {"nested_groups", generate_nested_groups},    // '((((...ab...))))'
+    {"nested_options", generate_nested_options},  // '(a|(a|(a|...b)))'
+};
+
+static const bench_case_t BENCH_CASES[] = {
+    {"words", "[a-z]+( [a-z]+)*\\.?", generate_words},
+    {"identifier", "[a-zA-Z_][a-zA-Z0-9_]*", generate_identifier},
+    {"log_line", "\\d+-\\d+-\\d+ (INFO|WARN|ERROR) .*", generate_log_line},
+    {"email", "[a-z0-9.]+@[a-z]+\\.(com|net|org)", generate_random_text},
+    {"semver", "v?\\d+\\.\\d+\\.\\d+(-[a-z0-9]+(\\.[a-z0-9]+)*)?", NULL},
+    {"url", "https?://[a-z0-9.]+(:\\d+)?(/[a-zA-Z0-9._~%]*)*(\\?[a-z]+=[a-zA-Z0-9]*)?", NULL},
+    {"ab_suffix", "(a|b)*abb", generate_ab},
+    // Pathological for backtracking matchers: exponentially many ways to split a run of a's
+    {"nested_star", "(a*)*b", generate_a_runs},
+    {"overlapping_options", "(a|aa|aaa)*c", generate_a_runs},
+    // Pathological for dfas: the subset construction builds 2^13 states
+    {"nth_from_end", "(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)",
+     generate_ab},
+};
+
+static const bench_engine_t BENCH_ENGINES[] = {
+    {"table", {REGEX_FLAG_NONE, MAX_CATALOGUE_STATES, 0, 0, true, true}},
+    {"jit", {REGEX_FLAG_JIT, MAX_CATALOGUE_STATES, 0, 0, true, true}},
+    {"nfa_sim", {REGEX_FLAG_NONE, 1, 0, 0, true, true}},
+};
+
+static BenchFormat format = BENCH_FORMAT_TEXT;
+
+static void report(const bench_result_t*);
+static void report_header(const char*);
+static const char* engine_name(RegexEngine);
+static char** new_corpus(line_generator_f, size_t*);
+static char** new_generated_corpus(char*, size_t*);
+static void free_corpus(char**);
+static size_t corpus_bytes(char**, int);
+static double measure_seconds(regex_t*, char**, int, int, bool, int*);
+static void bench_match(const bench_case_t*, int);
+static void bench_layout(int);
+static void bench_compile(const compile_case_t*);
+static int next_random(unsigned int*, int);
+
+int main(int argc, char** argv) {
+   int rounds = DEFAULT_ROUNDS;
+   for (int i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "--json") == 0) {
+         format = BENCH_FORMAT_JSON;
+      } else if ((rounds = atoi(argv[i])) <= 0) {
+         printf("Usage: %s [--json] [rounds]\n", argv[0]);
+         return EXIT_FAILURE;
+      }
+   }
+
+   const char* jit = jit_supported() ? "x86-64" : "unsupported";
+   if (format == BENCH_FORMAT_JSON) {
+      printf("{\"suite\":\"meta\",\"jit\":\"%s\",\"rounds\":%d,\"corpus_lines\":%d,"
+             "\"test_lines\":%d,\"locate_blowup\":false}\n",
+             jit, rounds, CORPUS_LINES, TEST_LINES);
+   } else {
+      printf("jit: %s (the jit engine falls back to the table where it can't run)\n", jit);
+      printf("nfa_sim compile times leave out locating the subexpression that hit the limit\n");
+   }
+
+   report_header("match case");
+   for (int i = 0; i < sizeof BENCH_CASES / sizeof BENCH_CASES[0]; i++) {
+      bench_match(&BENCH_CASES[i], rounds);
+   }
+
+   report_header("layout case");
+   bench_layout(rounds);
+
+   report_header("compile case");
+   for (int i = 0; i < sizeof COMPILE_CASES / sizeof COMPILE_CASES[0]; i++) {
+      bench_compile(&COMPILE_CASES[i]);
+   }
+
+   return EXIT_SUCCESS;
+}
+
+// Runs one case of the catalogue with every engine: regex_accepts() over the whole corpus and
+// regex_test() over its first TEST_LINES lines
+static void bench_match(const bench_case_t* bench_case, int rounds) {
+   size_t total_bytes;
+   char** corpus = bench_case->generate != NULL
+                       ? new_corpus(bench_case->generate, &total_bytes)
+                       : new_generated_corpus(bench_case->pattern, &total_bytes);
+
+   for (int e = 0; e < sizeof BENCH_ENGINES / sizeof BENCH_ENGINES[0]; e++) {
+      regex_error_t error;
+      regex_t* regex =
+          new_regex_with_options(bench_case->pattern, &BENCH_ENGINES[e].options, &error);
+      bench_result_t result = {"match", bench_case->name, BENCH_ENGINES[e].name, "accepts"};
+      result.rounds = rounds;
+      if (regex == NULL) {
+         result.status = error.message;
+         report(&result);
+         continue;
+      }
+
+      regex_stats_t stats;
+      regex_stats(regex, &stats);
+      result.engine = engine_name(stats.engine);
+      result.compile_seconds = stats.total_seconds;
+      result.memory_bytes = stats.table_bytes + stats.jit_bytes;
+      result.status = "ok";
+
+      result.bytes = total_bytes;
+      result.inputs = CORPUS_LINES;
+      result.seconds = measure_seconds(regex, corpus, CORPUS_LINES, rounds, false, &result.matched);
+      report(&result);
+
+      result.op = "test";
+      result.bytes = corpus_bytes(corpus, TEST_LINES);
+      result.inputs = TEST_LINES;
+      result.seconds = measure_seconds(regex, corpus, TEST_LINES, rounds, true, &result.matched);
+      report(&result);
+
+      regex_release(regex);
+   }
+
+   free_corpus(corpus);
+}
+
+// A blocklist of hostnames checked against traffic that mostly repeats a few of them. Relayout
+// moves the states those walk through to the front of the table and stores unvisited ones sparsely.
+static void bench_layout(int rounds) {
+   unsigned int seed = 42;
+   char* pattern = xmalloc(LAYOUT_HOSTS * (MAX_HOST_SIZE + 2));
+   int length = 0;
+   for (int i = 0; i < LAYOUT_HOSTS; i++) {
+      static const char* domains[] = {"com", "net", "org", "io"};
+      int name_length = 4 + next_random(&seed, 12);
+      for (int c = 0; c < name_length; c++) {
+         layout_hosts[i][c] = 'a' + next_random(&seed, 26);
+      }
+      sprintf(layout_hosts[i] + name_length, ".%s", domains[next_random(&seed, 4)]);
+      length += sprintf(pattern + length, "%s%.*s\\%s", i > 0 ? "|" : "", name_length,
+                        layout_hosts[i], layout_hosts[i] + name_length);
+   }
+
+   size_t total_bytes;
+   char** corpus = new_corpus(generate_traffic, &total_bytes);
+   regex_t* regex = new_regex(pattern);
+   double start = monotonic_seconds();
+   // The traffic itself is the training sample, as a recorded day of traffic would be
+   regex_t* relaid = regex_relayout(regex, corpus, CORPUS_LINES);
+   double relayout_seconds = monotonic_seconds() - start;
+
+   const char* layouts[] = {"compiled", "relayout"};
+   regex_t* regexes[] = {regex, relaid};
+   for (int i = 0; i < 2; i++) {
+      regex_stats_t stats;
+      regex_stats(regexes[i], &stats);
+      bench_result_t result = {"layout", "hosts", layouts[i], "accepts", total_bytes,
+                               CORPUS_LINES, rounds};
+      result.seconds =
+          measure_seconds(regexes[i], corpus, CORPUS_LINES, rounds, false, &result.matched);
+      // The relaid out regex took compiling and then relayout
+      result.compile_seconds = stats.total_seconds + (i == 1 ? relayout_seconds : 0);
+      result.memory_bytes = stats.table_bytes + stats.jit_bytes;
+      result.status = "ok";
+      report(&result);
+   }
+
+   regex_release(regex);
+   regex_release(relaid);
+   free_corpus(corpus);
+   free(pattern);
+}
+
+static void bench_compile(const compile_case_t* compile_case) {
+   unsigned int seed = 42;
+   char* pattern = xmalloc(COMPILE_PATTERN_SIZE);
+   compile_case->generate(pattern, COMPILE_PATTERN_SIZE, &seed);
+
+   regex_error_t error;
+   double start = monotonic_seconds();
+   regex_t* regex = new_regex_with_error(pattern, REGEX_FLAG_NONE, &error);
+   double seconds = monotonic_seconds() - start;
+
+   bench_result_t result = {"compile", compile_case->name, "table", "compile", strlen(pattern),
+                            0, 1, seconds};
+   result.compile_seconds = seconds;
+   result.status = regex != NULL ? "ok" : error.message;
+   if (regex != NULL) {
+      regex_stats_t stats;
+      regex_stats(regex, &stats);
+      result.engine = engine_name(stats.engine);
+      result.memory_bytes = stats.table_bytes + stats.jit_bytes;
+      regex_release(regex);
+   }
+   report(&result);
+   free(pattern);
+}
+
+/**
+ * Output
+*/
+
+static void report_header(const char* title) {
+   if (format == BENCH_FORMAT_TEXT) {
+      printf("\n%-20s %-8s %-8s %10s %10s %8s %10s %10s %s\n", title, "engine", "op", "MB/s",
+             "ns/input", "matched", "compile ms", "memory B", "status");
+   }
+}
+
+static void report(const bench_result_t* result) {
+   double inputs = (double)result->inputs * result->rounds;
+   double mb_per_second =
+       result->seconds > 0 ? result->bytes * result->rounds / result->seconds / 1e6 : 0;
+   double ns_per_input = inputs > 0 ? result->seconds * 1e9 / inputs : 0;
+
+   if (format == BENCH_FORMAT_TEXT) {
+      printf("%-20s %-8s %-8s %10.1f %10.1f %8d %10.2f %10zu %s\n", result->name, result->engine,
+             result->op, mb_per_second, ns_per_input, result->matched,
+             result->compile_seconds * 1e3, result->memory_bytes, result->status);
+      return;
+   }
+   // Names are fixed and error messages have no quotes, so nothing needs escaping
+   printf("{\"suite\":\"%s\",\"case\":\"%s\",\"engine\":\"%s\",\"op\":\"%s\",\"bytes\":%zu,"
+          "\"inputs\":%d,\"rounds\":%d,\"seconds\":%.6f,\"mb_per_second\":%.3f,"
+          "\"ns_per_input\":%.3f,\"matched\":%d,\"compile_ms\":%.3f,\"memory_bytes\":%zu,"
+          "\"status\":\"%s\"}\n",
+          result->suite, result->name, result->engine, result->op, result->bytes, result->inputs,
+          result->rounds, result->seconds, mb_per_second, ns_per_input, result->matched,
+          result->compile_seconds * 1e3, result->memory_bytes, result->status);
+}
+
+static const char* engine_name(RegexEngine engine) {
+   switch (engine) {
+      case REGEX_ENGINE_JIT:
+         return "jit";
+      case REGEX_ENGINE_NFA_SIMULATION:
+         return "nfa_sim";
+      default:
+         return "table";
+   }
+}
+
+/**
+ * Corpora
+*/
+
+// Matches the first lines of the corpus rounds times, with regex_test() or regex_accepts()
+static double measure_seconds(regex_t* regex, char** corpus, int lines, int rounds, bool test,
+                              int* matched) {
+   double start = monotonic_seconds();
+   for (int round = 0; round < rounds; round++) {
+      *matched = 0;
+      for (int line = 0; line < lines; line++) {
+         *matched += test ? regex_test(regex, corpus[line]) : regex_accepts(regex, corpus[line]);
+      }
+   }
+   return monotonic_seconds() - start;
+}
+
+static size_t corpus_bytes(char** corpus, int lines) {
+   size_t bytes = 0;
+   for (int line = 0; line < lines; line++) {
+      bytes += strlen(corpus[line]);
+   }
+   return bytes;
+}
+
+static char** new_corpus(line_generator_f generate, size_t* total_bytes) {
+   unsigned int seed = 42;
+   char** corpus = xmalloc(sizeof(char*) * CORPUS_LINES);
+   *total_bytes = 0;
+
+   for (int line = 0; line < CORPUS_LINES; line++) {
+      corpus[line] = xmalloc(MAX_LINE_SIZE);
+      generate(corpus[line], MAX_LINE_SIZE, &seed);
+      *total_bytes += strlen(corpus[line]);
+   }
+   return corpus;
+}
+
+// Accepted strings, near misses and random text in the proportions of GENERATED_ACCEPTED and
+// GENERATED_NEAR_MISSES, generated from the pattern's dfa
+static char** new_generated_corpus(char* pattern, size_t* total_bytes) {
+   unsigned int seed = 42;
+   regex_t* regex = new_regex(pattern);
+   regex_generator_t* generator = new_regex_generator(regex, seed);
+   char** corpus = xmalloc(sizeof(char*) * CORPUS_LINES);
+   *total_bytes = 0;
+
+   for (int line = 0; line < CORPUS_LINES; line++) {
+      corpus[line] = xmalloc(MAX_LINE_SIZE);
+      int kind = next_random(&seed, 100);
+      int length = -1;
+      if (kind < GENERATED_ACCEPTED) {
+         length = regex_generate(generator, corpus[line], MAX_LINE_SIZE, GENERATED_LENGTH);
+      } else if (kind < GENERATED_ACCEPTED + GENERATED_NEAR_MISSES) {
+         length = regex_generate_near_miss(generator, corpus[line], MAX_LINE_SIZE,
+                                           GENERATED_LENGTH);
+      }
+      if (length == -1) {
+         generate_random_text(corpus[line], MAX_LINE_SIZE, &seed);
+      }
+      *total_bytes += strlen(corpus[line]);
+   }
+
+   free_regex_generator(generator);
+   regex_release(regex);
+   return corpus;
+}
+
+static void free_corpus(char** corpus) {
+   for (int line = 0; line < CORPUS_LINES; line++) {
+      free(corpus[line]);
+   }
+   free(corpus);
+}
+
+/**
+ * Corpus generators: each writes one null-terminated line of at most size - 1 characters.
+ * Most lines match so the matcher has to scan them to the end.
+*/
+
+static void generate_words(char* line, int size, unsigned int* seed) {
+   int length = 0;
+   int target = 40 + next_random(seed, size - 48);
+   while (length < target) {
+      if (length > 0) {
+         line[length++] = ' ';
+      }
+      int word_length = 1 + next_random(seed, 8);
+      for (int i = 0; i < word_length; i++) {
+         line[length++] = 'a' + next_random(seed, 26);
+      }
+   }
+   // Roughly one line in sixteen has a capital letter and doesn't match
+   if (next_random(seed, 16) == 0) {
+      line[next_random(seed, length)] = 'Q';
+   }
+   line[length] = '\0';
+}
+
+static void generate_identifier(char* line, int size, unsigned int* seed) {
+   static const char characters[] =
+       "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
+   int length = 8 + next_random(seed, size - 9);
+   line[0] = characters[next_random(seed, 52)];
+   for (int i = 1; i < length; i++) {
+      line[i] = characters[next_random(seed, sizeof characters - 1)];
+   }
+   line[length] = '\0';
+}
+
+static void generate_log_line(char* line, int size, unsigned int* seed) {
+   static const char* levels[] = {"INFO", "WARN", "ERROR", "DEBUG"};
+   int length = sprintf(line, "2024-%02d-%02d %s ", 1 + next_random(seed, 12),
+                        1 + next_random(seed, 28), levels[next_random(seed, 4)]);
+   int target = length + 20 + next_random(seed, size - length - 21);
+   while (length < target) {
+      line[length++] = ' ' + next_random(seed, '~' - ' ' + 1);
+   }
+   line[length] = '\0';
+}
+
+static void generate_ab(char* line, int size, unsigned int* seed) {
+   int length = 16 + next_random(seed, size - 20);
+   for (int i = 0; i < length; i++) {
+      line[i] = next_random(seed, 2) ? 'a' : 'b';
+   }
+   strcpy(line + length, next_random(seed, 2) ? "abb" : "aba");
+}
+
+// Random printable text, with an address somewhere in one line in four. Almost no line matches as
+// a whole, so this measures how quickly the matcher gives up (and how regex_test() searches).
+static void generate_random_text(char* line, int size, unsigned int* seed) {
+   int length = 20 + next_random(seed, size - 21);
+   for (int i = 0; i < length; i++) {
+      line[i] = ' ' + next_random(seed, '~' - ' ' + 1);
+   }
+   line[length] = '\0';
+   if (next_random(seed, 4) == 0) {
+      memcpy(line + next_random(seed, length - 16), "me@example.com", 14);
+   }
+   // One line in sixteen is only an address, so a few lines match exactly
+   if (next_random(seed, 16) == 0) {
+      strcpy(line, "someone.else@example.org");
+   }
+}
+
+// Long runs of a's, ending in a 'b', a 'c' or nothing
+static void generate_a_runs(char* line, int size, unsigned int* seed) {
+   int length = 16 + next_random(seed, size - 18);
+   memset(line, 'a', length);
+   strcpy(line + length, (const char*[]){"b", "c", ""}[next_random(seed, 3)]);
+}
+
+// Mostly one of a few blocklisted hosts, sometimes any of them, sometimes a host not in the list
+static void generate_traffic(char* line, int size, unsigned int* seed) {
+   int kind = next_random(seed, 10);
+   if (kind < 8) {
+      snprintf(line, size, "%s", layout_hosts[next_random(seed, LAYOUT_HOT_HOSTS)]);
+   } else if (kind < 9) {
+      snprintf(line, size, "%s", layout_hosts[next_random(seed, LAYOUT_HOSTS)]);
+   } else {
+      snprintf(line, size, "%s", layout_hosts[next_random(seed, LAYOUT_HOSTS)]);
+      line[next_random(seed, strlen(line))] = 'x';
+   }
+}
+
+/**
+ * Pattern generators for the compile cases
+*/
+
+static void generate_ipv4_list(char* pattern, int size, unsigned int* seed) {
+   int length = 0;
+   // An address is at most 22 characters with its escapes and the '|'
+   while (length + 23 < size) {
+      length += sprintf(pattern + length, "%s%d\\.%d\\.%d\\.%d", length > 0 ? "|" : "",
+                        next_random(seed, 256), next_random(seed, 256), next_random(seed, 256),
+                        next_random(seed, 256));
+   }
+   pattern[length] = '\0';
+}
+
+static void generate_host_list(char* pattern, int size, unsigned int* seed) {
+   static const char* domains[] = {"com", "net", "org", "(com|net|org)"};
+   int length = 0;
+   // A host is at most 31 characters with its escape and the '|'
+   while (length + 32 < size) {
+      if (length > 0) {
+         pattern[length++] = '|';
+      }
+      int name_length = 4 + next_random(seed, 12);
+      for (int i = 0; i < name_length; i++) {
+         pattern[length++] = 'a' + next_random(seed, 26);
+      }
+      length += sprintf(pattern + length, "\\.%s", domains[next_random(seed, 4)]);
+   }
+   pattern[length] = '\0';
+}
+
+static void generate_nested_groups(char* pattern, int size, unsigned int* seed) {
+   int depth = (size - 3) / 2;
+   memset(pattern, '(', depth);
+   pattern[depth] = 'a';
+   pattern[depth + 1] = 'b';
+   memset(pattern + depth + 2, ')', depth);
+   pattern[2 * depth + 2] = '\0';
+}
+
+static void generate_nested_options(char* pattern, int size, unsigned int* seed) {
+   int depth = (size - 2) / 4;
+   int length = 0;
+   for (int i = 0; i < depth; i++) {
+      pattern[length++] = '(';
+      pattern[length++] = 'a' + next_random(seed, 3);
+      pattern[length++] = '|';
+   }
+   pattern[length++] = 'b';
+   memset(pattern + length, ')', depth);
+   pattern[length + depth] = '\0';
+}
+
+/**
+ * Helpers
+*/
+
+// Deterministic so every engine sees the same corpus
+static int next_random(unsigned int* seed, int bound) { return rand_r(seed) % bound; }
@@ -0,0 +1,144 @@
+/**
+ * C driver of the C vs Rust comparison (see bench/compare.sh at the root of the repository).
+ * Compiles one pattern with one engine, matches every line of a corpus with it a number of times,
+ * and prints the measurements as one json object, in the same format as the Rust driver
+ * (rust/regex-compiler/examples/compare.rs). Engines: dfa (the table interpreter), jit, and nfa_sim
+ * (nfa simulation, forced by a compile limit of one dfa state, and timed without locating the
+ * subexpression that hit it, so that its compile time is just building the simulation).
+ *
+ * Usage: compare <dfa|jit|nfa_sim> <case> <pattern> <corpus> <rounds>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sregex.h"
+#include "utils.h"
+
+#define COMPILE_ROUNDS 5  // compiles are timed this many times and the fastest kept
+
+static char** read_lines(const char*, int*, size_t*);
+static long peak_rss_kb();
+
+int main(int argc, char** argv) {
+   int rounds = argc == 6 ? atoi(argv[5]) : 0;
+   regex_options_t options = {REGEX_FLAG_NONE, 0, 0, 0, false};
+   if (argc == 6 && strcmp(argv[1], "jit") == 0) {
+      options.flags = REGEX_FLAG_JIT;
+   } else if (argc == 6 && strcmp(argv[1], "nfa_sim") == 0) {
+      options.max_states = 1;
+      options.fallback = true;
+      options.skip_locate = true;
+   } else if (argc != 6 || strcmp(argv[1], "dfa") != 0) {
+      rounds = 0;
+   }
+   if (rounds <= 0) {
+      fprintf(stderr, "Usage: %s <dfa|jit|nfa_sim> <case> <pattern> <corpus> <rounds>\n", argv[0]);
+      return EXIT_FAILURE;
+   }
+   char* engine = argv[1];
+   char* name = argv[2];
+   char* pattern = argv[3];
+
+   int num_lines;
+   size_t bytes;
+   char** lines = read_lines(argv[4], &num_lines, &bytes);
+   if (lines == NULL) {
+      fprintf(stderr, "Error: could not read %s\n", argv[4]);
+      return EXIT_FAILURE;
+   }
+   long rss_before_kb = peak_rss_kb();
+
+   regex_t* regex = NULL;
+   double compile_seconds = 0;
+   for (int i = 0; i < COMPILE_ROUNDS; i++) {
+      if (regex != NULL) {
+         regex_release(regex);
+      }
+      regex_error_t error;
+      double start = monotonic_seconds();
+      regex = new_regex_with_options(pattern, &options, &error);
+      double seconds = monotonic_seconds() - start;
+      if (regex == NULL) {
+         fprintf(stderr, "Error: %s at offset %d\n", error.message, error.position);
+         return EXIT_FAILURE;
+      }
+      compile_seconds = i == 0 || seconds < compile_seconds ? seconds : compile_seconds;
+   }
+
+   int matched = 0;
+   double start = monotonic_seconds();
+   for (int round = 0; round < rounds; round++) {
+      matched = 0;
+      for (int line = 0; line < num_lines; line++) {
+         matched += regex_accepts(regex, lines[line]);
+      }
+   }
+   double seconds = monotonic_seconds() - start;
+
+   long inputs = (long)num_lines * rounds;
+   printf("{\"impl\":\"c_%s\",\"case\":\"%s\",\"lines\":%d,\"bytes\":%zu,\"rounds\":%d,"
+          "\"compile_ms\":%.3f,\"mb_per_second\":%.3f,\"ns_per_line\":%.1f,\"matched\":%d,"
+          "\"rss_before_kb\":%ld,\"peak_rss_kb\":%ld}\n",
+          engine, name, num_lines, bytes, rounds, compile_seconds * 1e3,
+          bytes * rounds / seconds / 1e6, seconds * 1e9 / (inputs > 0 ? inputs : 1), matched,
+          rss_before_kb, peak_rss_kb());
+
+   regex_release(regex);
+   for (int line = 0; line < num_lines; line++) {
+      free(lines[line]);
+   }
+   free(lines);
+   return EXIT_SUCCESS;
+}
+
+// Reads the file's lines without their newlines (a '\r' is kept, as the Rust driver keeps it)
+static char** read_lines(const char* path, int* num_lines, size_t* bytes) {
+   FILE* file = fopen(path, "r");
+   if (file == NULL) {
+      return NULL;
+   }
+
+   int capacity = 1024;
+   char** lines = xmalloc(sizeof(char*) * capacity);
+   *num_lines = 0;
+   *bytes = 0;
+   char* line = NULL;
+   size_t size = 0;
+   ssize_t length;
+   while ((length = getline(&line, &size, file)) != -1) {
+      if (length > 0 && line[length - 1] == '\n') {
+         line[--length] = '\0';
+      }
+      if (*num_lines == capacity) {
+         capacity *= 2;
+         lines = xrealloc(lines, sizeof(char*) * capacity);
+      }
+      lines[(*num_lines)++] = line;
+      *bytes += length;
+      line = NULL;
+      size = 0;
+   }
+
+   free(line);
+   fclose(file);
+   return lines;
+}
+
+// The process's peak resident set size so far (VmHWM), or 0 where /proc isn't available
+static long peak_rss_kb() {
+   FILE* status = fopen("/proc/self/status", "r");
+   if (status == NULL) {
+      return 0;
+   }
+   char line[256];
+   long kb = 0;
+   while (fgets(line, sizeof line, status) != NULL) {
+      if (sscanf(line, "VmHWM: %ld kB", &kb) == 1) {
+         break;
+      }
+   }
+   fclose(status);
+   return kb;
+}
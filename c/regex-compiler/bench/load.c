@@ -0,0 +1,521 @@
+/**
+ * Load harness: for each thread count of a list, that many threads match pre-generated inputs for a
+ * fixed time against regexes they all share. Reports the throughput of each thread count, how well
+ * it scales from the first count, and where per-call latency lands (with a full histogram on
+ * request), to catch contention on what the threads share: reference counts, the locks of a
+ * regex_cache_t and, in PROFILE=1 builds, the profile counters every match updates.
+ *
+ * Workloads:
+ *    regex  every call matches one shared regex (--pattern, a log line pattern by default)
+ *    set    every call matches each regex of a shared set of log line patterns
+ *    cache  every call gets one regex of the set from a shared regex_cache_t, and releases it
+ *
+ * Input sizes (bytes) are drawn from a distribution:
+ *    fixed:N          always N
+ *    uniform:MIN:MAX  uniformly between MIN and MAX
+ *    pareto:MIN:MAX   mostly near MIN with a heavy tail up to MAX (shape 1.2)
+ *
+ * Usage: load [--threads 1,2,4,8,16,32] [--seconds S] [--workload regex|set|cache]
+ *             [--pattern P] [--sizes DISTRIBUTION] [--op accepts|test] [--histogram] [--json]
+*/
+
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cache.h"
+#include "sregex.h"
+#include "utils.h"
+
+#define MAX_THREAD_COUNTS 32
+#define INPUTS_PER_THREAD 1024  // a power of two, cycled through by each thread
+#define LINEAR_BUCKETS 16       // latencies under this many ns get a bucket each
+#define SUB_BUCKETS 8           // buckets per power of two above that (12.5% resolution)
+#define HISTOGRAM_BUCKETS (LINEAR_BUCKETS + (64 - 4) * SUB_BUCKETS)
+#define CACHE_LINE_SIZE 64
+
+typedef enum LoadWorkload {
+   LOAD_WORKLOAD_REGEX,
+   LOAD_WORKLOAD_SET,
+   LOAD_WORKLOAD_CACHE,
+} LoadWorkload;
+
+typedef enum LoadSizes {
+   LOAD_SIZES_FIXED,
+   LOAD_SIZES_UNIFORM,
+   LOAD_SIZES_PARETO,
+} LoadSizes;
+
+typedef struct load_config {
+      int thread_counts[MAX_THREAD_COUNTS];
+      int num_thread_counts;
+      double seconds;  // per thread count
+      LoadWorkload workload;
+      char* pattern;
+      LoadSizes sizes;
+      int min_size;
+      int max_size;
+      bool test;  // regex_test() instead of regex_accepts()
+      bool histogram;
+      bool json;
+} load_config_t;
+
+// Everything a run's threads share
+typedef struct load_run {
+      const load_config_t* config;
+      regex_t** regexes;
+      int num_regexes;
+      regex_cache_t* cache;
+      pthread_barrier_t start;
+      int stop;  // set atomically by the main thread when the run's time is up
+} load_run_t;
+
+// One thread's inputs and counters. Only the thread writes to them until it's joined, and they're
+// aligned to a cache line so that threads never write to the same line.
+typedef struct load_worker {
+      load_run_t* run;
+      char* inputs[INPUTS_PER_THREAD];
+      size_t input_bytes[INPUTS_PER_THREAD];
+      uint64_t calls;
+      uint64_t bytes;
+      uint64_t matched;
+      uint64_t histogram[HISTOGRAM_BUCKETS];  // calls by latency (see histogram_bucket())
+      pthread_t thread;
+} __attribute__((aligned(CACHE_LINE_SIZE))) load_worker_t;
+
+// Log line patterns of the set and cache workloads
+static char* SET_PATTERNS[] = {
+    "\\d+-\\d+-\\d+ (INFO|WARN|ERROR) .*",
+    "\\d+-\\d+-\\d+ ERROR .*",
+    "\\d+-\\d+-\\d+ WARN .*(timeout|refused).*",
+    "\\d+-\\d+-\\d+ [A-Z]+ .*[0-9]+\\.[0-9]+\\.[0-9]+\\.[0-9]+.*",
+    "\\d+-\\d+-\\d+ DEBUG .*",
+    "\\d+-0[1-6]-\\d+ .*",
+    ".*(GET|POST|PUT) /[a-z/]*.*",
+    "\\d+-\\d+-\\d+ INFO user=[a-z]+.*",
+};
+
+static const char* WORKLOADS[] = {"regex", "set", "cache"};
+static const char* SIZES[] = {"fixed", "uniform", "pareto"};
+
+static bool parse_args(int, char**, load_config_t*);
+static bool parse_sizes(char*, load_config_t*);
+static void run_load(load_run_t*, int, double*);
+static void* work(void*);
+static bool match_one(load_run_t*, int, char*);
+static void generate_inputs(load_worker_t*, const load_config_t*, unsigned int);
+static int next_size(const load_config_t*, unsigned int*);
+static int histogram_bucket(uint64_t);
+static uint64_t histogram_upper_bound(int);
+static uint64_t histogram_percentile(const uint64_t*, uint64_t, double);
+static void report(const load_config_t*, int, load_worker_t*, double, double*);
+static uint64_t now_nanoseconds();
+
+int main(int argc, char** argv) {
+   load_config_t config = {{1, 2, 4, 8, 16, 32}, 6, 1.0, LOAD_WORKLOAD_REGEX,
+                           SET_PATTERNS[0], LOAD_SIZES_UNIFORM, 16, 256};
+   if (!parse_args(argc, argv, &config)) {
+      printf("Usage: %s [--threads 1,2,4,8,16,32] [--seconds S] [--workload regex|set|cache]\n"
+             "          [--pattern P] [--sizes fixed:N|uniform:MIN:MAX|pareto:MIN:MAX]\n"
+             "          [--op accepts|test] [--histogram] [--json]\n",
+             argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   load_run_t run = {&config};
+   run.num_regexes =
+       config.workload == LOAD_WORKLOAD_REGEX ? 1 : sizeof SET_PATTERNS / sizeof SET_PATTERNS[0];
+   char** patterns = config.workload == LOAD_WORKLOAD_REGEX ? &config.pattern : SET_PATTERNS;
+   run.regexes = xmalloc(sizeof(regex_t*) * run.num_regexes);
+   for (int i = 0; i < run.num_regexes; i++) {
+      regex_error_t error;
+      run.regexes[i] = new_regex_with_error(patterns[i], REGEX_FLAG_NONE, &error);
+      if (run.regexes[i] == NULL) {
+         fprintf(stderr, "Invalid pattern %s: %s at %d\n", patterns[i], error.message,
+                 error.position);
+         return EXIT_FAILURE;
+      }
+   }
+   if (config.workload == LOAD_WORKLOAD_CACHE) {
+      // Even if every pattern of the set hashed to the same shard, it wouldn't evict, so the run
+      // measures hits (the cache has 16 shards)
+      run.cache = new_regex_cache(16 * run.num_regexes);
+   }
+
+   if (!config.json) {
+      printf("workload: %s, sizes: %s %d-%d bytes, op: %s, %.1f s per thread count\n",
+             WORKLOADS[config.workload], SIZES[config.sizes], config.min_size, config.max_size,
+             config.test ? "test" : "accepts", config.seconds);
+      printf("%8s %12s %10s %12s %8s %10s %10s %10s %10s %10s\n", "threads", "calls/s", "MB/s",
+             "MB/s/thread", "scaling", "p50 ns", "p90 ns", "p99 ns", "p99.9 ns", "max ns");
+   }
+   double first_per_thread = 0;
+   for (int i = 0; i < config.num_thread_counts; i++) {
+      run_load(&run, config.thread_counts[i], &first_per_thread);
+   }
+
+   if (run.cache != NULL) {
+      regex_cache_stats_t stats;
+      regex_cache_stats(run.cache, &stats);
+      printf(config.json ? "{\"cache_hits\":%llu,\"cache_misses\":%llu,\"cache_evictions\":%llu}\n"
+                         : "cache: %llu hits, %llu misses, %llu evictions\n",
+             (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+             (unsigned long long)stats.evictions);
+      regex_cache_release(run.cache);
+   }
+   for (int i = 0; i < run.num_regexes; i++) {
+      regex_release(run.regexes[i]);
+   }
+   free(run.regexes);
+   return EXIT_SUCCESS;
+}
+
+/**
+ * Running
+*/
+
+// Runs the given number of threads for config->seconds and reports them. The first run's per
+// thread throughput is the baseline of the others' scaling.
+static void run_load(load_run_t* run, int num_threads, double* first_per_thread) {
+   load_worker_t* workers;
+   if (posix_memalign((void**)&workers, CACHE_LINE_SIZE, sizeof(load_worker_t) * num_threads)) {
+      fprintf(stderr, "Out of memory\n");
+      exit(EXIT_FAILURE);
+   }
+   memset(workers, 0, sizeof(load_worker_t) * num_threads);
+   for (int t = 0; t < num_threads; t++) {
+      workers[t].run = run;
+      generate_inputs(&workers[t], run->config, 42 + t);
+   }
+
+   run->stop = 0;
+   pthread_barrier_init(&run->start, NULL, num_threads + 1);
+   for (int t = 0; t < num_threads; t++) {
+      pthread_create(&workers[t].thread, NULL, work, &workers[t]);
+   }
+   pthread_barrier_wait(&run->start);
+   uint64_t start = now_nanoseconds();
+   struct timespec duration = {(time_t)run->config->seconds,
+                               (long)(fmod(run->config->seconds, 1.0) * 1e9)};
+   nanosleep(&duration, NULL);
+   __atomic_store_n(&run->stop, 1, __ATOMIC_RELAXED);
+   for (int t = 0; t < num_threads; t++) {
+      pthread_join(workers[t].thread, NULL);
+   }
+   double seconds = (now_nanoseconds() - start) / 1e9;
+   pthread_barrier_destroy(&run->start);
+
+   report(run->config, num_threads, workers, seconds, first_per_thread);
+
+   for (int t = 0; t < num_threads; t++) {
+      for (int i = 0; i < INPUTS_PER_THREAD; i++) {
+         free(workers[t].inputs[i]);
+      }
+   }
+   free(workers);
+}
+
+static void* work(void* arg) {
+   load_worker_t* worker = (load_worker_t*)arg;
+   load_run_t* run = worker->run;
+   pthread_barrier_wait(&run->start);
+
+   for (int i = 0; !__atomic_load_n(&run->stop, __ATOMIC_RELAXED);
+        i = (i + 1) & (INPUTS_PER_THREAD - 1)) {
+      uint64_t start = now_nanoseconds();
+      bool matched = match_one(run, i, worker->inputs[i]);
+      uint64_t latency = now_nanoseconds() - start;
+
+      worker->calls++;
+      worker->bytes += worker->input_bytes[i];
+      worker->matched += matched;
+      worker->histogram[histogram_bucket(latency)]++;
+   }
+   return NULL;
+}
+
+// One call of the workload. The cache workload picks the regex by input, so all threads ask for
+// every pattern of the set.
+static bool match_one(load_run_t* run, int index, char* input) {
+   bool test = run->config->test;
+   switch (run->config->workload) {
+      case LOAD_WORKLOAD_REGEX:
+         return test ? regex_test(run->regexes[0], input) : regex_accepts(run->regexes[0], input);
+      case LOAD_WORKLOAD_SET: {
+         bool matched = false;
+         for (int i = 0; i < run->num_regexes; i++) {
+            matched |= test ? regex_test(run->regexes[i], input)
+                            : regex_accepts(run->regexes[i], input);
+         }
+         return matched;
+      }
+      case LOAD_WORKLOAD_CACHE: {
+         regex_t* regex =
+             regex_cache_get(run->cache, SET_PATTERNS[index % run->num_regexes], REGEX_FLAG_NONE);
+         bool matched = test ? regex_test(regex, input) : regex_accepts(regex, input);
+         regex_release(regex);
+         return matched;
+      }
+   }
+   return false;
+}
+
+/**
+ * Inputs
+*/
+
+// Log lines ("2024-03-14 WARN ...") padded with random text to sizes drawn from the distribution.
+// Lines shorter than their prefix are cut short and don't match.
+static void generate_inputs(load_worker_t* worker, const load_config_t* config,
+                            unsigned int seed) {
+   static const char* levels[] = {"INFO", "WARN", "ERROR", "DEBUG"};
+   static const char* words[] = {"GET /index", "user=alice", "timeout", "10.0.0.1", "refused"};
+   char prefix[32];
+
+   for (int i = 0; i < INPUTS_PER_THREAD; i++) {
+      int size = next_size(config, &seed);
+      char* input = xmalloc(size + 1);
+      int length = sprintf(prefix, "2024-%02d-%02d %s ", 1 + rand_r(&seed) % 12,
+                           1 + rand_r(&seed) % 28, levels[rand_r(&seed) % 4]);
+      memcpy(input, prefix, length < size ? length : size);
+      for (int c = length; c < size; c++) {
+         input[c] = ' ' + rand_r(&seed) % ('~' - ' ' + 1);
+      }
+      // Sometimes a word some of the set's patterns look for
+      const char* word = words[rand_r(&seed) % 5];
+      if (size - length > (int)strlen(word) && rand_r(&seed) % 2 == 0) {
+         memcpy(input + length + rand_r(&seed) % (size - length - strlen(word)), word,
+                strlen(word));
+      }
+      input[size] = '\0';
+      worker->inputs[i] = input;
+      worker->input_bytes[i] = size;
+   }
+}
+
+static int next_size(const load_config_t* config, unsigned int* seed) {
+   double uniform = (rand_r(seed) + 1.0) / ((double)RAND_MAX + 1.0);  // in (0, 1]
+   switch (config->sizes) {
+      case LOAD_SIZES_FIXED:
+         return config->min_size;
+      case LOAD_SIZES_UNIFORM:
+         return config->min_size + uniform * (config->max_size - config->min_size);
+      case LOAD_SIZES_PARETO: {
+         // Inverse of the bounded Pareto distribution's cdf
+         double shape = 1.2;
+         double low = pow(config->min_size, shape);
+         double ratio = low / pow(config->max_size, shape);
+         return pow(low / (1 - uniform * (1 - ratio)), 1 / shape);
+      }
+   }
+   return config->min_size;
+}
+
+/**
+ * Latency histogram: one bucket per ns up to LINEAR_BUCKETS, then SUB_BUCKETS per power of two
+*/
+
+static int histogram_bucket(uint64_t nanoseconds) {
+   if (nanoseconds < LINEAR_BUCKETS) {
+      return nanoseconds;
+   }
+   int exponent = 63 - __builtin_clzll(nanoseconds);  // at least 4
+   int sub_bucket = (nanoseconds >> (exponent - 3)) & (SUB_BUCKETS - 1);
+   return LINEAR_BUCKETS + (exponent - 4) * SUB_BUCKETS + sub_bucket;
+}
+
+// The largest latency that falls in the bucket
+static uint64_t histogram_upper_bound(int bucket) {
+   if (bucket < LINEAR_BUCKETS) {
+      return bucket;
+   }
+   int exponent = (bucket - LINEAR_BUCKETS) / SUB_BUCKETS + 4;
+   int sub_bucket = (bucket - LINEAR_BUCKETS) % SUB_BUCKETS;
+   uint64_t lower = (uint64_t)(SUB_BUCKETS + sub_bucket) << (exponent - 3);
+   return lower + ((uint64_t)1 << (exponent - 3)) - 1;
+}
+
+static uint64_t histogram_percentile(const uint64_t* histogram, uint64_t calls, double fraction) {
+   uint64_t rank = (uint64_t)ceil(fraction * calls);
+   uint64_t seen = 0;
+   for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+      seen += histogram[bucket];
+      if (seen >= rank && seen > 0) {
+         return histogram_upper_bound(bucket);
+      }
+   }
+   return 0;
+}
+
+/**
+ * Output
+*/
+
+static void report(const load_config_t* config, int num_threads, load_worker_t* workers,
+                   double seconds, double* first_per_thread) {
+   uint64_t histogram[HISTOGRAM_BUCKETS] = {0};
+   uint64_t calls = 0;
+   uint64_t bytes = 0;
+   uint64_t matched = 0;
+   for (int t = 0; t < num_threads; t++) {
+      calls += workers[t].calls;
+      bytes += workers[t].bytes;
+      matched += workers[t].matched;
+      for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+         histogram[bucket] += workers[t].histogram[bucket];
+      }
+   }
+
+   double calls_per_second = calls / seconds;
+   double mb_per_second = bytes / seconds / 1e6;
+   if (*first_per_thread == 0) {
+      *first_per_thread = calls_per_second / num_threads;
+   }
+   // 1.0 when every thread keeps the throughput a thread had in the first run
+   double scaling = calls_per_second / num_threads / *first_per_thread;
+   double fractions[] = {0.5, 0.9, 0.99, 0.999, 1.0};
+   uint64_t percentiles[5];
+   for (int i = 0; i < 5; i++) {
+      percentiles[i] = histogram_percentile(histogram, calls, fractions[i]);
+   }
+
+   if (config->json) {
+      printf("{\"workload\":\"%s\",\"op\":\"%s\",\"sizes\":\"%s\",\"min_size\":%d,"
+             "\"max_size\":%d,\"threads\":%d,\"seconds\":%.6f,\"calls\":%llu,\"matched\":%llu,"
+             "\"calls_per_second\":%.1f,\"mb_per_second\":%.3f,\"scaling\":%.3f,"
+             "\"p50_ns\":%llu,\"p90_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu,"
+             "\"histogram\":[",
+             WORKLOADS[config->workload], config->test ? "test" : "accepts",
+             SIZES[config->sizes], config->min_size, config->max_size, num_threads, seconds,
+             (unsigned long long)calls, (unsigned long long)matched, calls_per_second,
+             mb_per_second, scaling, (unsigned long long)percentiles[0],
+             (unsigned long long)percentiles[1], (unsigned long long)percentiles[2],
+             (unsigned long long)percentiles[3], (unsigned long long)percentiles[4]);
+      // [largest latency of the bucket in ns, calls] for each bucket with calls
+      bool first = true;
+      for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+         if (histogram[bucket] > 0) {
+            printf("%s[%llu,%llu]", first ? "" : ",",
+                   (unsigned long long)histogram_upper_bound(bucket),
+                   (unsigned long long)histogram[bucket]);
+            first = false;
+         }
+      }
+      printf("]}\n");
+      return;
+   }
+
+   printf("%8d %12.0f %10.1f %12.1f %8.2f %10llu %10llu %10llu %10llu %10llu\n", num_threads,
+          calls_per_second, mb_per_second, mb_per_second / num_threads, scaling,
+          (unsigned long long)percentiles[0], (unsigned long long)percentiles[1],
+          (unsigned long long)percentiles[2], (unsigned long long)percentiles[3],
+          (unsigned long long)percentiles[4]);
+   if (config->histogram) {
+      uint64_t seen = 0;
+      for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+         if (histogram[bucket] == 0) {
+            continue;
+         }
+         seen += histogram[bucket];
+         int bar = (int)(50.0 * histogram[bucket] / calls + 0.5);
+         printf("%20s <= %10llu ns %12llu %7.3f%% %-50.*s\n", "",
+                (unsigned long long)histogram_upper_bound(bucket),
+                (unsigned long long)histogram[bucket], 100.0 * seen / calls, bar,
+                "##################################################");
+      }
+   }
+}
+
+/**
+ * Arguments
+*/
+
+static bool parse_args(int argc, char** argv, load_config_t* config) {
+   for (int i = 1; i < argc; i++) {
+      char* arg = argv[i];
+      char* value = i + 1 < argc ? argv[i + 1] : NULL;
+      if (strcmp(arg, "--histogram") == 0) {
+         config->histogram = true;
+         continue;
+      }
+      if (strcmp(arg, "--json") == 0) {
+         config->json = true;
+         continue;
+      }
+      if (value == NULL) {
+         return false;
+      }
+      i++;
+
+      if (strcmp(arg, "--threads") == 0) {
+         config->num_thread_counts = 0;
+         for (char* count = strtok(value, ","); count != NULL; count = strtok(NULL, ",")) {
+            if (config->num_thread_counts == MAX_THREAD_COUNTS || atoi(count) <= 0) {
+               return false;
+            }
+            config->thread_counts[config->num_thread_counts++] = atoi(count);
+         }
+      } else if (strcmp(arg, "--seconds") == 0) {
+         if ((config->seconds = atof(value)) <= 0) {
+            return false;
+         }
+      } else if (strcmp(arg, "--workload") == 0) {
+         int workload = 0;
+         while (workload < 3 && strcmp(value, WORKLOADS[workload]) != 0) {
+            workload++;
+         }
+         if (workload == 3) {
+            return false;
+         }
+         config->workload = workload;
+      } else if (strcmp(arg, "--pattern") == 0) {
+         config->pattern = value;
+      } else if (strcmp(arg, "--sizes") == 0) {
+         if (!parse_sizes(value, config)) {
+            return false;
+         }
+      } else if (strcmp(arg, "--op") == 0) {
+         if (strcmp(value, "test") != 0 && strcmp(value, "accepts") != 0) {
+            return false;
+         }
+         config->test = strcmp(value, "test") == 0;
+      } else {
+         return false;
+      }
+   }
+   return config->num_thread_counts > 0;
+}
+
+// "fixed:N", "uniform:MIN:MAX" or "pareto:MIN:MAX"
+static bool parse_sizes(char* value, load_config_t* config) {
+   int min_size;
+   int max_size;
+   if (sscanf(value, "fixed:%d", &min_size) == 1) {
+      config->sizes = LOAD_SIZES_FIXED;
+      max_size = min_size;
+   } else if (sscanf(value, "uniform:%d:%d", &min_size, &max_size) == 2) {
+      config->sizes = LOAD_SIZES_UNIFORM;
+   } else if (sscanf(value, "pareto:%d:%d", &min_size, &max_size) == 2) {
+      config->sizes = LOAD_SIZES_PARETO;
+   } else {
+      return false;
+   }
+   config->min_size = min_size;
+   config->max_size = max_size;
+   return min_size > 0 && max_size >= min_size;
+}
+
+/**
+ * Helpers
+*/
+
+static uint64_t now_nanoseconds() {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
@@ -0,0 +1,293 @@
+#include "cache.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+/**
+ * The cache is split into shards by hash. Lookups take no lock: a shard's entries are a list whose
+ * links are read and written atomically, so a lookup only reads shared memory (apart from taking a
+ * reference to the regex it finds). Inserts and evictions take the shard's mutex, which only
+ * orders writers among themselves.
+ *
+ * An evicted entry is unlinked at once but freed only once every lookup that may still be walking
+ * past it is done. Lookups count themselves in and out of a reader slot, one of a fixed number of
+ * cache-line aligned counters that threads are spread over, under the current generation (0 or 1).
+ * To free an entry, the evicting thread flips the generation, so that new lookups (which can't
+ * reach the unlinked entry) count themselves under the other one, then waits for the counters of
+ * the old generation to drain.
+ *
+ * Recency is a tick the misses advance: a hit stamps its entry with the current tick (only writing
+ * it if it changed), and eviction removes the entry with the oldest stamp in the full shard.
+*/
+
+#define NUM_SHARDS 16
+#define NUM_READER_SLOTS 64
+#define CACHE_LINE_SIZE 64
+
+typedef struct cache_entry cache_entry_t;
+
+struct cache_entry {
+      char* pattern;
+      int flags;
+      uint64_t hash;
+      regex_t* regex;  // the cache's reference
+      uint64_t last_used;
+      cache_entry_t* next;
+};
+
+typedef struct cache_shard {
+      pthread_mutex_t lock;  // taken by inserts and evictions only
+      cache_entry_t* entries;
+      int size;
+      int capacity;
+      uint64_t misses;
+      uint64_t evictions;
+} __attribute__((aligned(CACHE_LINE_SIZE))) cache_shard_t;
+
+typedef struct reader_slot {
+      uint64_t readers[2];  // lookups in progress, by the generation they started in
+      uint64_t hits;
+} __attribute__((aligned(CACHE_LINE_SIZE))) reader_slot_t;
+
+struct regex_cache {
+      cache_shard_t* shards;
+      int num_shards;
+      reader_slot_t* slots;
+      int generation;
+      pthread_mutex_t reclaim_lock;  // one generation flip at a time
+      uint64_t tick;
+};
+
+static uint64_t hash_key(char*, int);
+static cache_entry_t* shard_find(cache_shard_t*, uint64_t, char*, int);
+static cache_entry_t* shard_unlink_oldest(cache_shard_t*);
+static reader_slot_t* thread_reader_slot(regex_cache_t*);
+static int read_begin(regex_cache_t*, reader_slot_t*);
+static void read_end(reader_slot_t*, int);
+static void wait_for_readers(regex_cache_t*);
+static void free_cache_entry(cache_entry_t*);
+
+regex_cache_t* new_regex_cache(int capacity) {
+   if (capacity <= 0) {
+      error("[new_regex_cache] capacity must be positive");
+   }
+
+   regex_cache_t* cache = xmalloc(sizeof(regex_cache_t));
+   cache->tick = 0;
+   cache->generation = 0;
+   pthread_mutex_init(&cache->reclaim_lock, NULL);
+   cache->num_shards = capacity < NUM_SHARDS ? capacity : NUM_SHARDS;
+   if (posix_memalign((void**)&cache->shards, CACHE_LINE_SIZE,
+                      sizeof(cache_shard_t) * cache->num_shards) != 0 ||
+       posix_memalign((void**)&cache->slots, CACHE_LINE_SIZE,
+                      sizeof(reader_slot_t) * NUM_READER_SLOTS) != 0) {
+      error("[new_regex_cache] allocation failed");
+   }
+   memset(cache->slots, 0, sizeof(reader_slot_t) * NUM_READER_SLOTS);
+
+   // Spread the capacity over the shards so that their capacities add up to exactly `capacity`
+   for (int i = 0; i < cache->num_shards; i++) {
+      cache_shard_t* shard = &cache->shards[i];
+      pthread_mutex_init(&shard->lock, NULL);
+      shard->entries = NULL;
+      shard->size = 0;
+      shard->capacity = capacity / cache->num_shards + (i < capacity % cache->num_shards ? 1 : 0);
+      shard->misses = 0;
+      shard->evictions = 0;
+   }
+
+   return cache;
+}
+
+regex_t* regex_cache_get(regex_cache_t* cache, char* pattern, int flags) {
+   uint64_t hash = hash_key(pattern, flags);
+   cache_shard_t* shard = &cache->shards[hash % cache->num_shards];
+   reader_slot_t* slot = thread_reader_slot(cache);
+
+   // Fast path: no lock, no allocation, and no write to memory other threads use but the
+   // regex's reference count
+   int generation = read_begin(cache, slot);
+   cache_entry_t* entry = shard_find(shard, hash, pattern, flags);
+   if (entry != NULL) {
+      regex_t* regex = regex_retain(entry->regex);
+      uint64_t now = __atomic_load_n(&cache->tick, __ATOMIC_RELAXED);
+      if (__atomic_load_n(&entry->last_used, __ATOMIC_RELAXED) != now) {
+         __atomic_store_n(&entry->last_used, now, __ATOMIC_RELAXED);
+      }
+      __atomic_fetch_add(&slot->hits, 1, __ATOMIC_RELAXED);
+      read_end(slot, generation);
+      return regex;
+   }
+   read_end(slot, generation);
+
+   // Compile outside the shard lock so a slow compile doesn't block other misses
+   regex_t* compiled = new_regex_with_flags(pattern, flags);
+
+   pthread_mutex_lock(&shard->lock);
+   shard->misses++;
+   if (compiled == NULL) {
+      // Invalid patterns aren't cached
+      pthread_mutex_unlock(&shard->lock);
+      return NULL;
+   }
+   uint64_t now = __atomic_add_fetch(&cache->tick, 1, __ATOMIC_RELAXED);
+   cache_entry_t* evicted = NULL;
+   entry = shard_find(shard, hash, pattern, flags);
+   if (entry == NULL) {
+      if (shard->size == shard->capacity) {
+         evicted = shard_unlink_oldest(shard);
+      }
+      entry = xmalloc(sizeof(cache_entry_t));
+      entry->pattern = xmalloc(strlen(pattern) + 1);
+      strcpy(entry->pattern, pattern);
+      entry->flags = flags;
+      entry->hash = hash;
+      entry->regex = compiled;
+      entry->last_used = now;
+      entry->next = shard->entries;
+      // Publishes the entry, fully initialized, to lookups
+      __atomic_store_n(&shard->entries, entry, __ATOMIC_RELEASE);
+      shard->size++;
+   } else {
+      // Another thread cached the same pattern while this one was compiling
+      regex_release(compiled);
+      __atomic_store_n(&entry->last_used, now, __ATOMIC_RELAXED);
+   }
+   regex_t* regex = regex_retain(entry->regex);
+   pthread_mutex_unlock(&shard->lock);
+
+   if (evicted != NULL) {
+      wait_for_readers(cache);
+      free_cache_entry(evicted);
+   }
+   return regex;
+}
+
+void regex_cache_stats(regex_cache_t* cache, regex_cache_stats_t* stats) {
+   memset(stats, 0, sizeof(regex_cache_stats_t));
+
+   for (int i = 0; i < cache->num_shards; i++) {
+      cache_shard_t* shard = &cache->shards[i];
+      pthread_mutex_lock(&shard->lock);
+      stats->misses += shard->misses;
+      stats->evictions += shard->evictions;
+      stats->size += shard->size;
+      pthread_mutex_unlock(&shard->lock);
+   }
+   for (int i = 0; i < NUM_READER_SLOTS; i++) {
+      stats->hits += __atomic_load_n(&cache->slots[i].hits, __ATOMIC_RELAXED);
+   }
+}
+
+void regex_cache_release(regex_cache_t* cache) {
+   for (int i = 0; i < cache->num_shards; i++) {
+      cache_shard_t* shard = &cache->shards[i];
+      cache_entry_t* entry = shard->entries;
+      while (entry != NULL) {
+         cache_entry_t* next = entry->next;
+         free_cache_entry(entry);
+         entry = next;
+      }
+      pthread_mutex_destroy(&shard->lock);
+   }
+   pthread_mutex_destroy(&cache->reclaim_lock);
+   free(cache->slots);
+   free(cache->shards);
+   free(cache);
+}
+
+// FNV-1a over the pattern and flags
+static uint64_t hash_key(char* pattern, int flags) {
+   uint64_t hash = 14695981039346656037ULL;
+   for (char* c = pattern; *c; c++) {
+      hash = (hash ^ (uint8_t)*c) * 1099511628211ULL;
+   }
+   return (hash ^ (uint64_t)flags) * 1099511628211ULL;
+}
+
+// Safe without the shard's lock, between read_begin() and read_end()
+static cache_entry_t* shard_find(cache_shard_t* shard, uint64_t hash, char* pattern, int flags) {
+   cache_entry_t* entry = __atomic_load_n(&shard->entries, __ATOMIC_ACQUIRE);
+   while (entry != NULL) {
+      if (entry->hash == hash && entry->flags == flags && strcmp(entry->pattern, pattern) == 0) {
+         return entry;
+      }
+      entry = __atomic_load_n(&entry->next, __ATOMIC_ACQUIRE);
+   }
+   return NULL;
+}
+
+// Unlinks the least recently used entry, which lookups may still be reading until
+// wait_for_readers() returns. Called with the shard's lock held.
+static cache_entry_t* shard_unlink_oldest(cache_shard_t* shard) {
+   cache_entry_t** oldest = NULL;
+   for (cache_entry_t** entry = &shard->entries; *entry != NULL; entry = &(*entry)->next) {
+      if (oldest == NULL || __atomic_load_n(&(*entry)->last_used, __ATOMIC_RELAXED) <
+                                __atomic_load_n(&(*oldest)->last_used, __ATOMIC_RELAXED)) {
+         oldest = entry;
+      }
+   }
+   if (oldest == NULL) {
+      return NULL;
+   }
+
+   cache_entry_t* evicted = *oldest;
+   __atomic_store_n(oldest, evicted->next, __ATOMIC_RELEASE);
+   shard->size--;
+   shard->evictions++;
+   return evicted;
+}
+
+// The slot of the calling thread. Threads are numbered in the order they first look up, so up to
+// NUM_READER_SLOTS threads get a slot of their own.
+static reader_slot_t* thread_reader_slot(regex_cache_t* cache) {
+   static int next_thread_index = 0;
+   static __thread int thread_index = -1;
+   if (thread_index == -1) {
+      thread_index = __atomic_fetch_add(&next_thread_index, 1, __ATOMIC_RELAXED);
+   }
+   return &cache->slots[thread_index % NUM_READER_SLOTS];
+}
+
+// Counts a lookup in under the current generation, and returns it. A lookup that read the
+// generation just before a flip and counted itself in too late for wait_for_readers() to see it
+// notices the flip and counts itself in again under the new generation, before reading anything.
+static int read_begin(regex_cache_t* cache, reader_slot_t* slot) {
+   for (;;) {
+      int generation = __atomic_load_n(&cache->generation, __ATOMIC_SEQ_CST);
+      __atomic_fetch_add(&slot->readers[generation], 1, __ATOMIC_SEQ_CST);
+      if (__atomic_load_n(&cache->generation, __ATOMIC_SEQ_CST) == generation) {
+         return generation;
+      }
+      __atomic_fetch_sub(&slot->readers[generation], 1, __ATOMIC_SEQ_CST);
+   }
+}
+
+static void read_end(reader_slot_t* slot, int generation) {
+   __atomic_fetch_sub(&slot->readers[generation], 1, __ATOMIC_RELEASE);
+}
+
+// Waits until every lookup that started before the call is done, so that what they could reach
+// and has since been unlinked can be freed. Lookups are short, so this yields rather than sleeps.
+static void wait_for_readers(regex_cache_t* cache) {
+   pthread_mutex_lock(&cache->reclaim_lock);
+   int old = __atomic_load_n(&cache->generation, __ATOMIC_SEQ_CST);
+   __atomic_store_n(&cache->generation, !old, __ATOMIC_SEQ_CST);
+   for (int i = 0; i < NUM_READER_SLOTS; i++) {
+      while (__atomic_load_n(&cache->slots[i].readers[old], __ATOMIC_SEQ_CST) != 0) {
+         sched_yield();
+      }
+   }
+   pthread_mutex_unlock(&cache->reclaim_lock);
+}
+
+static void free_cache_entry(cache_entry_t* entry) {
+   regex_release(entry->regex);
+   free(entry->pattern);
+   free(entry);
+}
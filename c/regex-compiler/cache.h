@@ -0,0 +1,44 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+
+#include "sregex.h"
+
+typedef struct regex_cache regex_cache_t;
+typedef struct regex_cache_stats regex_cache_stats_t;
+
+struct regex_cache_stats {
+      uint64_t hits;
+      uint64_t misses;
+      uint64_t evictions;
+      int size;  // number of cached regexes
+};
+
+/**
+ * Creates a thread-safe cache of compiled regexes keyed by (pattern, flags).
+ * The cache is split into shards by key; when a key's shard is full, the shard's least recently
+ * used regex is evicted. Lookups of cached regexes take no lock; only misses do.
+ * @param capacity Maximum number of cached regexes
+ */
+regex_cache_t* new_regex_cache(int);
+
+/**
+ * Returns the compiled regex for the pattern and flags, compiling and caching it on a miss.
+ * The returned regex holds a reference for the caller, who must regex_release() it when done.
+ * Evicting a regex only drops the cache's reference, so regexes in use stay valid.
+ * Returns null (and caches nothing) if the pattern is invalid.
+ */
+regex_t* regex_cache_get(regex_cache_t*, char*, int);
+
+/**
+ * Reads the cache's hit/miss/eviction counters and current size.
+ */
+void regex_cache_stats(regex_cache_t*, regex_cache_stats_t*);
+
+/**
+ * Drops the cache's references to its regexes and frees the cache.
+ */
+void regex_cache_release(regex_cache_t*);
+
+#endif  // CACHE_H
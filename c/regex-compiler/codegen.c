@@ -0,0 +1,101 @@
+#include "codegen.h"
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#define VALUES_PER_LINE 16
+
+static const char* smallest_state_type(int);
+static bool is_identifier(const char*);
+static void emit_comment_escaped(FILE*, const char*);
+
+int codegen_emit_c(dfa_table_t* table, FILE* out, const char* name) {
+   if (!is_identifier(name)) {
+      return -1;
+   }
+   const char* state_type = smallest_state_type(table->num_states);
+
+   fprintf(out, "// Generated by sregex-gen. Do not edit.\n");
+   fprintf(out, "// Pattern: \"");
+   emit_comment_escaped(out, table->pattern);
+   fprintf(out, "\"\n// States: %d, byte classes: %d\n\n", table->num_states, table->num_classes);
+   fprintf(out, "#include <stdbool.h>\n#include <stddef.h>\n\n");
+
+   // Byte -> byte class
+   fprintf(out, "static const unsigned char %s_classes[256] = {", name);
+   for (int byte = 0; byte < TABLE_NUM_BYTES; byte++) {
+      fprintf(out, "%s%d,", byte % VALUES_PER_LINE == 0 ? "\n    " : " ", table->classes[byte]);
+   }
+   fprintf(out, "\n};\n\n");
+
+   // One row per state, one column per byte class
+   fprintf(out, "static const %s %s_transitions[%d][%d] = {\n", state_type, name,
+           table->num_states, table->num_classes);
+   for (int state = 0; state < table->num_states; state++) {
+      fprintf(out, "    {");
+      for (int class = 0; class < table->num_classes; class++) {
+         fprintf(out, "%s%d", class == 0 ? "" : ", ", table_next(table, state, class));
+      }
+      fprintf(out, "},\n");
+   }
+   fprintf(out, "};\n\n");
+
+   fprintf(out, "static const bool %s_accepting[%d] = {", name, table->num_states);
+   for (int state = 0; state < table->num_states; state++) {
+      fprintf(out, "%s%d,", state % VALUES_PER_LINE == 0 ? "\n    " : " ",
+              table->accepting[state]);
+   }
+   fprintf(out, "\n};\n\n");
+
+   fprintf(out, "bool %s(const char* str, size_t len) {\n", name);
+   fprintf(out, "   int state = %d;\n", table->start);
+   fprintf(out, "   for (size_t i = 0; i < len; i++) {\n");
+   fprintf(out, "      state = %s_transitions[state][%s_classes[(unsigned char)str[i]]];\n", name,
+           name);
+   fprintf(out, "      if (state < 0) {\n");
+   fprintf(out, "         return false;\n");
+   fprintf(out, "      }\n");
+   fprintf(out, "   }\n");
+   fprintf(out, "   return %s_accepting[state];\n", name);
+   fprintf(out, "}\n");
+
+   return ferror(out) ? -1 : 0;
+}
+
+// Smallest signed type that holds every state and -1 (no transition)
+static const char* smallest_state_type(int num_states) {
+   if (num_states <= 127) {
+      return "signed char";
+   }
+   if (num_states <= 32767) {
+      return "short";
+   }
+   return "int";
+}
+
+static bool is_identifier(const char* name) {
+   if (name == NULL || !(isalpha(name[0]) || name[0] == '_')) {
+      return false;
+   }
+   for (const char* c = name; *c; c++) {
+      if (!(isalnum(*c) || *c == '_')) {
+         return false;
+      }
+   }
+   return true;
+}
+
+// The pattern goes into a quoted line comment, so anything that could end the line is escaped
+static void emit_comment_escaped(FILE* out, const char* str) {
+   for (const char* c = str; *c; c++) {
+      if (*c == '\\') {
+         fprintf(out, "\\\\");
+      } else if (isprint(*c)) {
+         fputc(*c, out);
+      } else {
+         fprintf(out, "\\x%02x", (unsigned char)*c);
+      }
+   }
+}
@@ -0,0 +1,16 @@
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+#include <stdio.h>
+
+#include "table.h"
+
+/**
+ * Writes C source for a function `bool <function_name>(const char* str, size_t len)` that returns
+ * true if the table accepts the first len characters of str (exact match). The function only uses
+ * static const tables, so the output compiles without this library.
+ * @returns 0 on success, -1 if function_name isn't a valid C identifier or writing fails
+ */
+int codegen_emit_c(dfa_table_t*, FILE*, const char* function_name);
+
+#endif  // CODEGEN_H
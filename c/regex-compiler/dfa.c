@@ -2,53 +2,80 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "utils.h"
 
-struct dfa {
-      dfa_node_t* start;
-      list_t* __nodes;
-};
-
-struct dfa_node {
-      char* id;
-      bool is_accepting;
-      list_t* edges;
-};
-
-struct dfa_edge {
-      char value;
-      dfa_node_t* to;
-};
+#define STATE_TABLE_INITIAL_CAPACITY 64
+#define DEADLINE_CHECK_INTERVAL 64  // states to build between looks at the clock
 
 /**
  * Note: Any list that holds a copy of a pointer uses list_noop_data_destructor as the destructor.
  * In terms of nfa_nodes, the nfa is the owner of all nodes (an eclosure never does).
+ * Dfa nodes, their edges and the eclosures live in the arena passed to dfa_from_nfa(); the state
+ * table and the stack of eclosures to process are malloc'd and freed once the dfa is built.
+ * Eclosures are arrays of nfa ids, which index builder->nfa_nodes.
  */
 typedef struct epsilon_closure {
-      char* id;
-      list_t* nodes;  // list of nfa_node_t
+      int* nodes;  // nfa ids, in the order they were reached
+      int num_nodes;
+      dfa_node_t* dfa_node;  // the dfa node made from this eclosure
 } epsilon_closure_t;
 
-static epsilon_closure_t* new_epsilon_closure();
-static epsilon_closure_t* compute_epsilon_closure(nfa_node_t*);
-static epsilon_closure_t* compute_epsilon_closure_for_set(list_t*, char*);
-static void __compute_epsilon_closure(nfa_node_t*, epsilon_closure_t*);
-
-static dfa_node_t* dfa_node_from_epsilon_closure(epsilon_closure_t*);
-static dfa_node_t* dfa_find_node(dfa_t*, char*);
-static void dfa_node_add_edge(dfa_node_t*, char, dfa_node_t*);
-static char* create_id_for_set(list_t*);
-static list_t* compute_move_set(list_t*, char);
-
-static void free_dfa_list_node(void*);
-static void free_epsilon_closure(epsilon_closure_t*);
-
-static int nfa_node_comparator(void*, void*);
-static int dfa_find_by_id_comparator(void*, void*);
+// Sparse set of nfa ids: O(1) insert, membership test and clear, without initializing per use
+typedef struct sparse_set {
+      int* dense;   // members, in insertion order
+      int* sparse;  // sparse[id] is id's position in dense, if id is a member
+      int size;
+} sparse_set_t;
+
+// Open-addressing hash set of dfa nodes, keyed by the sorted nfa ids they were reached on
+typedef struct state_table {
+      dfa_node_t** slots;
+      int capacity;  // power of two
+      int size;
+} state_table_t;
+
+// Everything subset construction needs besides the nfa
+typedef struct dfa_builder {
+      arena_t* arena;
+      dfa_t* dfa;
+      nfa_node_t** nfa_nodes;  // nfa nodes by id (an nfa numbers its nodes 0 to n - 1)
+      int num_nfa_nodes;
+      int* move_set;     // scratch: nfa ids of the move set being computed
+      int* move_stamps;  // move_stamps[id] == stamp if id is already in move_set
+      int stamp;
+      sparse_set_t closure;  // scratch: the eclosure being computed
+      int* closure_stack;    // scratch: nfa ids whose epsilon edges are still to follow
+      state_table_t states;
+} dfa_builder_t;
+
+static void dfa_builder_initialize(dfa_builder_t*, arena_t*, nfa_t*);
+static epsilon_closure_t* dfa_builder_add_state(dfa_builder_t*, int*, int, uint64_t);
+static int compute_move_set(dfa_builder_t*, epsilon_closure_t*, char);
+static epsilon_closure_t* compute_epsilon_closure(dfa_builder_t*, int*, int);
+
+static dfa_node_t* dfa_node_from_epsilon_closure(dfa_builder_t*, epsilon_closure_t*);
+static void dfa_add_node(dfa_t*, dfa_node_t*);
+static void dfa_node_add_edge(arena_t*, dfa_node_t*, char, dfa_node_t*);
+
+// State table
+static void state_table_initialize(state_table_t*);
+static dfa_node_t* state_table_find(state_table_t*, int*, int, uint64_t);
+static void state_table_insert(state_table_t*, dfa_node_t*);
+static void state_table_grow(state_table_t*);
+static uint64_t hash_nfa_states(int*, int);
+
+// Sparse set
+static bool sparse_set_contains(sparse_set_t*, int);
+static void sparse_set_add(sparse_set_t*, int);
+
+static DFALimit dfa_builder_exceeded(dfa_builder_t*, dfa_limits_t*);
+
+static int nfa_id_comparator(const void*, const void*);
 
 bool dfa_accepts(dfa_t* dfa, char* str, int len) {
    dfa_node_t* current = dfa->start;
@@ -72,240 +99,352 @@ bool dfa_accepts(dfa_t* dfa, char* str, int len) {
    return current->is_accepting;
 }
 
-dfa_t* dfa_from_nfa(nfa_t* nfa) {
-   // Create dfa
-   dfa_t* dfa = xmalloc(sizeof(dfa_t));
-   dfa->start = NULL;
-   dfa->__nodes = malloc(sizeof(list_t));
-   list_initialize(dfa->__nodes, free_dfa_list_node);
+dfa_t* dfa_from_nfa(arena_t* arena, nfa_t* nfa) {
+   dfa_limits_t limits = {.max_states = 0, .max_bytes = 0, .deadline = 0};
+   return dfa_from_nfa_with_limits(arena, nfa, &limits);
+}
 
-   // Create initial eclosure from starting node of nfa, then create dfa_node from the eclosure
-   epsilon_closure_t* initial_closure = compute_epsilon_closure(nfa->start);
+dfa_t* dfa_from_nfa_with_limits(arena_t* arena, nfa_t* nfa, dfa_limits_t* limits) {
+   limits->exceeded = DFA_LIMIT_NONE;
+   dfa_builder_t builder;
+   dfa_builder_initialize(&builder, arena, nfa);
+   dfa_t* dfa = builder.dfa;
+
+   // Create initial eclosure (and its dfa_node) from starting node of nfa
+   int start_id = nfa->start->id;
+   epsilon_closure_t* initial_closure =
+       dfa_builder_add_state(&builder, &start_id, 1, hash_nfa_states(&start_id, 1));
+   dfa->start = initial_closure->dfa_node;
 
    // Create a stack of eclosures to process - this stack is empty by end of while loop
-   list_t* eclosures_stack = malloc(sizeof(list_t));
-   list_initialize(eclosures_stack, NULL);
+   list_t* eclosures_stack = xmalloc(sizeof(list_t));
+   list_initialize(eclosures_stack, list_noop_data_destructor);
    list_push(eclosures_stack, initial_closure);
 
-   // Create initial dfa_node from initial eclosure and add to dfa
-   dfa_node_t* initial_dfa_node = dfa_node_from_epsilon_closure(initial_closure);
-   list_push(dfa->__nodes, initial_dfa_node);
-   dfa->start = initial_dfa_node;
-
    char* language = nfa_language(nfa);
 
    while (!list_empty(eclosures_stack)) {
-      // Have to free current_closure since it's being removed from list
       epsilon_closure_t* current_closure = (epsilon_closure_t*)list_deque(eclosures_stack);
-      dfa_node_t* current_dfa_node = dfa_find_node(dfa, current_closure->id);
-      assert(current_dfa_node != NULL);
 
       char* lptr = language;
       while (*lptr) {
          char transition_symbol = *lptr++;
 
-         // Get/create dfa_node and add edge from current_dfa_node to next_dfa_node
-         list_t* move_result = compute_move_set(current_closure->nodes, transition_symbol);
-         char* next_dfa_node_id = create_id_for_set(move_result);
-         dfa_node_t* next_dfa_node = dfa_find_node(dfa, next_dfa_node_id);
+         // Get/create dfa_node and add edge from the current dfa_node to next_dfa_node
+         int num_moves = compute_move_set(&builder, current_closure, transition_symbol);
+         // No nfa node moves on the symbol: leave the transition out instead of creating a dead
+         // node that every rejected input would keep looping in
+         if (num_moves == 0) {
+            continue;
+         }
+         uint64_t hash = hash_nfa_states(builder.move_set, num_moves);
+         dfa_node_t* next_dfa_node =
+             state_table_find(&builder.states, builder.move_set, num_moves, hash);
 
          if (next_dfa_node == NULL) {
             epsilon_closure_t* next_closure =
-                compute_epsilon_closure_for_set(move_result, next_dfa_node_id);
+                dfa_builder_add_state(&builder, builder.move_set, num_moves, hash);
             list_push(eclosures_stack, next_closure);
+            next_dfa_node = next_closure->dfa_node;
 
-            next_dfa_node = dfa_node_from_epsilon_closure(next_closure);
-            list_push(dfa->__nodes, next_dfa_node);
+            limits->exceeded = dfa_builder_exceeded(&builder, limits);
+            if (limits->exceeded != DFA_LIMIT_NONE) {
+               break;
+            }
          }
-         dfa_node_add_edge(current_dfa_node, transition_symbol, next_dfa_node);
-
-         free(next_dfa_node_id);
-         list_release(move_result);
+         dfa_node_add_edge(arena, current_closure->dfa_node, transition_symbol, next_dfa_node);
       };
-      free_epsilon_closure(current_closure);
+      if (limits->exceeded != DFA_LIMIT_NONE) {
+         break;
+      }
    }
    list_release(eclosures_stack);
+   free(builder.states.slots);
 
-   return dfa;
+   return limits->exceeded == DFA_LIMIT_NONE ? dfa : NULL;
 }
 
 void log_dfa(dfa_t* dfa) {
-   printf("DFA (start - %s):\n", dfa->start->id);
+   printf("DFA (start - %d):\n", dfa->start->index);
 
    list_node_t* current;
    list_traverse(dfa->__nodes, current) {
       dfa_node_t* node = (dfa_node_t*)current->data;
-      printf("Node %s - num_edges: %d, %s\n", node->id, list_size(node->edges),
+      printf("Node %d {", node->index);
+      for (int i = 0; i < node->num_nfa_states; i++) {
+         printf(i == 0 ? "%d" : ", %d", node->nfa_states[i]);
+      }
+      printf("} - num_edges: %d, %s\n", list_size(node->edges),
              node->is_accepting ? "accepting" : "not accepting");
 
       list_node_t* current_edge;
       list_traverse(node->edges, current_edge) {
          dfa_edge_t* edge = (dfa_edge_t*)current_edge->data;
-         printf("    Edge: %c -> %s\n", edge->value, edge->to->id);
+         printf("    Edge: %c -> %d\n", edge->value, edge->to->index);
       }
    }
 }
 
-static epsilon_closure_t* new_epsilon_closure() {
-   epsilon_closure_t* epsilon_closure = xmalloc(sizeof(epsilon_closure_t));
-   epsilon_closure->id = NULL;
+/**
+ * Subset construction (private)
+*/
 
-   epsilon_closure->nodes = xmalloc(sizeof(list_t));
-   list_initialize(epsilon_closure->nodes, list_noop_data_destructor);
+static void dfa_builder_initialize(dfa_builder_t* builder, arena_t* arena, nfa_t* nfa) {
+   dfa_t* dfa = arena_alloc(arena, sizeof(dfa_t));
+   dfa->start = NULL;
+   dfa->num_nodes = 0;
+   dfa->__nodes = arena_alloc(arena, sizeof(list_t));
+   list_initialize_in_arena(dfa->__nodes, arena);
+
+   builder->arena = arena;
+   builder->dfa = dfa;
+   builder->num_nfa_nodes = nfa_num_states(nfa);
+   builder->nfa_nodes = arena_alloc(arena, sizeof(nfa_node_t*) * builder->num_nfa_nodes);
+   builder->move_set = arena_alloc(arena, sizeof(int) * builder->num_nfa_nodes);
+   builder->move_stamps = arena_alloc(arena, sizeof(int) * builder->num_nfa_nodes);
+   memset(builder->move_stamps, 0, sizeof(int) * builder->num_nfa_nodes);
+   builder->stamp = 0;
+   builder->closure.dense = arena_alloc(arena, sizeof(int) * builder->num_nfa_nodes);
+   builder->closure.sparse = arena_alloc(arena, sizeof(int) * builder->num_nfa_nodes);
+   memset(builder->closure.sparse, 0, sizeof(int) * builder->num_nfa_nodes);
+   builder->closure.size = 0;
+   builder->closure_stack = arena_alloc(arena, sizeof(int) * builder->num_nfa_nodes);
+   state_table_initialize(&builder->states);
 
-   return epsilon_closure;
+   list_node_t* current;
+   list_traverse(nfa->__nodes, current) {
+      nfa_node_t* nfa_node = (nfa_node_t*)current->data;
+      assert(nfa_node->id >= 0 && nfa_node->id < builder->num_nfa_nodes);
+      builder->nfa_nodes[nfa_node->id] = nfa_node;
+   }
 }
 
-static epsilon_closure_t* compute_epsilon_closure(nfa_node_t* nfa_node) {
-   epsilon_closure_t* epsilon_closure = new_epsilon_closure();
-   epsilon_closure->id = xmalloc(sizeof(char) * num_places(nfa_node->id) + 1);
-   sprintf(epsilon_closure->id, "%d", nfa_node->id);
+// Creates the dfa node for a (sorted) set of nfa ids that isn't in the state table yet, and returns
+// the eclosure it was made from so its transitions can be computed
+static epsilon_closure_t* dfa_builder_add_state(dfa_builder_t* builder, int* nfa_ids, int num_ids,
+                                                uint64_t hash) {
+   epsilon_closure_t* epsilon_closure = compute_epsilon_closure(builder, nfa_ids, num_ids);
+
+   dfa_node_t* dfa_node = dfa_node_from_epsilon_closure(builder, epsilon_closure);
+   dfa_node->nfa_states = arena_alloc(builder->arena, sizeof(int) * num_ids);
+   memcpy(dfa_node->nfa_states, nfa_ids, sizeof(int) * num_ids);
+   dfa_node->num_nfa_states = num_ids;
+   dfa_node->__hash = hash;
 
-   __compute_epsilon_closure(nfa_node, epsilon_closure);
+   dfa_add_node(builder->dfa, dfa_node);
+   state_table_insert(&builder->states, dfa_node);
+   epsilon_closure->dfa_node = dfa_node;
 
    return epsilon_closure;
 }
 
-static epsilon_closure_t* compute_epsilon_closure_for_set(list_t* nfa_nodes, char* id) {
-   // Implementation would be a lot nicer with a proper set data structure
-   epsilon_closure_t* set_eclosure = new_epsilon_closure();
-   set_eclosure->id = xmalloc(sizeof(char) * strlen(id) + 1);
-   strcpy(set_eclosure->id, id);
-
-   list_node_t* current_nfa;
-   list_traverse(nfa_nodes, current_nfa) {
-      epsilon_closure_t* node_closure = compute_epsilon_closure((nfa_node_t*)current_nfa->data);
-
-      list_node_t* current_closure_nfa_node;
-      list_traverse(node_closure->nodes, current_closure_nfa_node) {
-         if (!list_contains(set_eclosure->nodes, current_closure_nfa_node->data, NULL)) {
-            list_push(set_eclosure->nodes, current_closure_nfa_node->data);
+// Writes the sorted, de-duplicated ids of the nfa nodes reachable from nfa_nodes on the symbol into
+// builder->move_set and returns how many there are
+static int compute_move_set(dfa_builder_t* builder, epsilon_closure_t* epsilon_closure,
+                            char symbol) {
+   int num_moves = 0;
+   builder->stamp++;
+
+   for (int i = 0; i < epsilon_closure->num_nodes; i++) {
+      nfa_node_t* nfa_node = builder->nfa_nodes[epsilon_closure->nodes[i]];
+      // A simplified nfa node can move to several nodes on the same symbol
+      for (int j = 0; j < nfa_node->num_edges; j++) {
+         nfa_node_t* to_nfa_node = nfa_node->edges[j].to;
+         if (nfa_edge_has_byte(&nfa_node->edges[j], symbol) &&
+             builder->move_stamps[to_nfa_node->id] != builder->stamp) {
+            builder->move_stamps[to_nfa_node->id] = builder->stamp;
+            builder->move_set[num_moves++] = to_nfa_node->id;
          }
       }
-      free_epsilon_closure(node_closure);
    }
 
-   return set_eclosure;
+   qsort(builder->move_set, num_moves, sizeof(int), nfa_id_comparator);
+   return num_moves;
 }
 
-static void __compute_epsilon_closure(nfa_node_t* nfa_node, epsilon_closure_t* epsilon_closure) {
-   if (list_contains(epsilon_closure->nodes, nfa_node, NULL)) {
-      return;
+// Computes the eclosure of a set of nfa ids in one pass: every nfa node in the closure is visited
+// once, however many of the ids reach it, and an explicit stack replaces recursion so long epsilon
+// chains can't overflow the call stack
+static epsilon_closure_t* compute_epsilon_closure(dfa_builder_t* builder, int* nfa_ids,
+                                                  int num_ids) {
+   sparse_set_t* closure = &builder->closure;
+   int* stack = builder->closure_stack;
+   int stack_size = 0;
+
+   closure->size = 0;
+   for (int i = 0; i < num_ids; i++) {
+      if (!sparse_set_contains(closure, nfa_ids[i])) {
+         sparse_set_add(closure, nfa_ids[i]);
+         stack[stack_size++] = nfa_ids[i];
+      }
    }
 
-   list_push(epsilon_closure->nodes, nfa_node);
-
-   for (int i = 0; i < nfa_node->num_edges; i++) {
-      if (nfa_node->edges[i].is_epsilon) {
-         __compute_epsilon_closure(nfa_node->edges[i].to, epsilon_closure);
+   // Each id is pushed at most once (when it joins the set), so the stack never outgrows the nfa
+   while (stack_size > 0) {
+      nfa_node_t* nfa_node = builder->nfa_nodes[stack[--stack_size]];
+      for (int i = 0; i < nfa_node->num_edges; i++) {
+         int to_id = nfa_node->edges[i].to->id;
+         if (nfa_node->edges[i].is_epsilon && !sparse_set_contains(closure, to_id)) {
+            sparse_set_add(closure, to_id);
+            stack[stack_size++] = to_id;
+         }
       }
    }
+
+   epsilon_closure_t* epsilon_closure = arena_alloc(builder->arena, sizeof(epsilon_closure_t));
+   epsilon_closure->nodes = arena_alloc(builder->arena, sizeof(int) * closure->size);
+   memcpy(epsilon_closure->nodes, closure->dense, sizeof(int) * closure->size);
+   epsilon_closure->num_nodes = closure->size;
+   epsilon_closure->dfa_node = NULL;
+
+   return epsilon_closure;
 }
 
-dfa_node_t* dfa_node_from_epsilon_closure(epsilon_closure_t* epsilon_closure) {
+static dfa_node_t* dfa_node_from_epsilon_closure(dfa_builder_t* builder,
+                                                 epsilon_closure_t* epsilon_closure) {
+   arena_t* arena = builder->arena;
+
    // Create dfa_node
-   dfa_node_t* dfa_node = xmalloc(sizeof(dfa_node_t));
-   dfa_node->id = xmalloc(sizeof(char) * strlen(epsilon_closure->id) + 1);
-   strcpy(dfa_node->id, epsilon_closure->id);
+   dfa_node_t* dfa_node = arena_alloc(arena, sizeof(dfa_node_t));
+   dfa_node->nfa_states = NULL;
+   dfa_node->num_nfa_states = 0;
+   dfa_node->index = -1;
    dfa_node->is_accepting = false;
-   dfa_node->edges = malloc(sizeof(list_t));
-   list_initialize(dfa_node->edges, NULL);
-
-   // Determine if dfa_node is accepting
-   list_node_t* current;
-   list_traverse(epsilon_closure->nodes, current) {
-      if (((nfa_node_t*)current->data)->is_accepting) {
+   dfa_node->accepting_rule = -1;
+   dfa_node->edges = arena_alloc(arena, sizeof(list_t));
+   list_initialize_in_arena(dfa_node->edges, arena);
+
+   // Determine if dfa_node is accepting, and which rule wins if several accept (lowest index)
+   for (int i = 0; i < epsilon_closure->num_nodes; i++) {
+      nfa_node_t* nfa_node = builder->nfa_nodes[epsilon_closure->nodes[i]];
+      if (nfa_node->is_accepting) {
          dfa_node->is_accepting = true;
-         break;
+         if (dfa_node->accepting_rule == -1 || nfa_node->rule < dfa_node->accepting_rule) {
+            dfa_node->accepting_rule = nfa_node->rule;
+         }
       }
    }
 
    return dfa_node;
 }
 
-static dfa_node_t* dfa_find_node(dfa_t* dfa, char* id) {
-   return list_find(dfa->__nodes, id, dfa_find_by_id_comparator);
+static void dfa_add_node(dfa_t* dfa, dfa_node_t* dfa_node) {
+   dfa_node->index = dfa->num_nodes++;
+   list_push(dfa->__nodes, dfa_node);
 }
 
-static void dfa_node_add_edge(dfa_node_t* dfa_node, char symbol, dfa_node_t* to) {
-   dfa_edge_t* edge = xmalloc(sizeof(dfa_edge_t));
+static void dfa_node_add_edge(arena_t* arena, dfa_node_t* dfa_node, char symbol, dfa_node_t* to) {
+   dfa_edge_t* edge = arena_alloc(arena, sizeof(dfa_edge_t));
    edge->value = symbol;
    edge->to = to;
 
    list_push(dfa_node->edges, edge);
 }
 
-static char* create_id_for_set(list_t* nfa_nodes) {
-   list_sort(nfa_nodes, nfa_node_comparator);
-   int id_length = 0;
-
-   // Calculate length of id
-   list_node_t* current;
-   list_traverse(nfa_nodes, current) {
-      id_length += num_places(((nfa_node_t*)current->data)->id) + 1;
+// Checked after each new state. The arena only grows, so its size bounds everything built so far;
+// what the states will take after construction is estimated from their number.
+static DFALimit dfa_builder_exceeded(dfa_builder_t* builder, dfa_limits_t* limits) {
+   int num_states = builder->dfa->num_nodes;
+   if (limits->max_states > 0 && num_states > limits->max_states) {
+      return DFA_LIMIT_STATES;
+   }
+   if (limits->max_bytes > 0 &&
+       arena_size(builder->arena) + (size_t)num_states * limits->bytes_per_state >
+           limits->max_bytes) {
+      return DFA_LIMIT_BYTES;
    }
+   if (limits->deadline > 0 && num_states % DEADLINE_CHECK_INTERVAL == 0 &&
+       monotonic_seconds() > limits->deadline) {
+      return DFA_LIMIT_TIME;
+   }
+   return DFA_LIMIT_NONE;
+}
 
-   // Don't need +1 for null terminator since length calculation always adds 1 extra
-   char* id = xmalloc(sizeof(char) * id_length);
-   id[0] = '\0';
+/**
+ * State table (private)
+ */
 
-   // Create id
-   list_traverse(nfa_nodes, current) {
-      if (id[0] == '\0') {
-         sprintf(id, "%d", ((nfa_node_t*)current->data)->id);
-      } else {
-         sprintf(id, "%s/%d", id, ((nfa_node_t*)current->data)->id);
+static void state_table_initialize(state_table_t* table) {
+   table->capacity = STATE_TABLE_INITIAL_CAPACITY;
+   table->size = 0;
+   table->slots = xmalloc(sizeof(dfa_node_t*) * table->capacity);
+   memset(table->slots, 0, sizeof(dfa_node_t*) * table->capacity);
+}
+
+static dfa_node_t* state_table_find(state_table_t* table, int* nfa_ids, int num_ids,
+                                    uint64_t hash) {
+   int mask = table->capacity - 1;
+   for (int i = hash & mask; table->slots[i] != NULL; i = (i + 1) & mask) {
+      dfa_node_t* node = table->slots[i];
+      if (node->__hash == hash && node->num_nfa_states == num_ids &&
+          memcmp(node->nfa_states, nfa_ids, sizeof(int) * num_ids) == 0) {
+         return node;
       }
    }
+   return NULL;
+}
+
+static void state_table_insert(state_table_t* table, dfa_node_t* dfa_node) {
+   // Keep the load factor at or below 1/2 so probe sequences stay short
+   if ((table->size + 1) * 2 > table->capacity) {
+      state_table_grow(table);
+   }
 
-   return id;
+   int mask = table->capacity - 1;
+   int i = dfa_node->__hash & mask;
+   while (table->slots[i] != NULL) {
+      i = (i + 1) & mask;
+   }
+   table->slots[i] = dfa_node;
+   table->size++;
 }
 
-static list_t* compute_move_set(list_t* nfa_nodes, char symbol) {
-   list_t* nfa_nodes_with_transition = xmalloc(sizeof(list_t));
-   list_initialize(nfa_nodes_with_transition, list_noop_data_destructor);
+static void state_table_grow(state_table_t* table) {
+   dfa_node_t** old_slots = table->slots;
+   int old_capacity = table->capacity;
 
-   list_node_t* current;
-   list_traverse(nfa_nodes, current) {
-      nfa_node_t* to_nfa_node = nfa_node_find_transition((nfa_node_t*)current->data, symbol);
-      if (to_nfa_node != NULL) {
-         list_push(nfa_nodes_with_transition, to_nfa_node);
+   table->capacity *= 2;
+   table->size = 0;
+   table->slots = xmalloc(sizeof(dfa_node_t*) * table->capacity);
+   memset(table->slots, 0, sizeof(dfa_node_t*) * table->capacity);
+
+   for (int i = 0; i < old_capacity; i++) {
+      if (old_slots[i] != NULL) {
+         state_table_insert(table, old_slots[i]);
       }
    }
+   free(old_slots);
+}
 
-   return nfa_nodes_with_transition;
+// FNV-1a over the bytes of the ids
+static uint64_t hash_nfa_states(int* nfa_ids, int num_ids) {
+   uint64_t hash = 14695981039346656037ULL;
+   const unsigned char* bytes = (const unsigned char*)nfa_ids;
+   for (size_t i = 0; i < sizeof(int) * num_ids; i++) {
+      hash ^= bytes[i];
+      hash *= 1099511628211ULL;
+   }
+   return hash;
 }
 
 /**
- * Destructors
+ * Sparse set (private)
  */
 
-void free_dfa(dfa_t* dfa) {
-   list_release(dfa->__nodes);
-   free(dfa);
-}
-
-static void free_dfa_list_node(void* data) {
-   dfa_node_t* node = (dfa_node_t*)data;
-   free(node->id);
-   list_release(node->edges);
-   free(node);
+static bool sparse_set_contains(sparse_set_t* set, int id) {
+   int position = set->sparse[id];
+   return position < set->size && set->dense[position] == id;
 }
 
-static void free_epsilon_closure(epsilon_closure_t* epsilon_closure) {
-   free(epsilon_closure->id);
-   list_release(epsilon_closure->nodes);
-   free(epsilon_closure);
+static void sparse_set_add(sparse_set_t* set, int id) {
+   set->sparse[id] = set->size;
+   set->dense[set->size++] = id;
 }
 
 /**
  * Comparators
  */
 
-static int nfa_node_comparator(void* data1, void* data2) {
-   return ((nfa_node_t*)data1)->id - ((nfa_node_t*)data2)->id;
-}
-
-static int dfa_find_by_id_comparator(void* data1, void* data2) {
-   return strcmp(((dfa_node_t*)data1)->id, (char*)data2);
+static int nfa_id_comparator(const void* data1, const void* data2) {
+   return *(const int*)data1 - *(const int*)data2;
 }
@@ -2,6 +2,7 @@
 #define DFA_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "list.h"
 #include "nfa.h"
@@ -9,10 +10,53 @@
 typedef struct dfa dfa_t;
 typedef struct dfa_node dfa_node_t;
 typedef struct dfa_edge dfa_edge_t;
+typedef struct dfa_limits dfa_limits_t;
+
+typedef enum {
+   DFA_LIMIT_NONE = 0,
+   DFA_LIMIT_STATES,
+   DFA_LIMIT_BYTES,
+   DFA_LIMIT_TIME,
+} DFALimit;
+
+struct dfa {
+      dfa_node_t* start;
+      int num_nodes;
+      list_t* __nodes;
+};
+
+struct dfa_node {
+      int* nfa_states;  // sorted ids of the nfa nodes the state was reached on (before eclosure)
+      int num_nfa_states;
+      int index;  // position in the dfa's node list (0 to num_nodes - 1)
+      bool is_accepting;
+      int accepting_rule;  // lowest rule of the accepting nfa nodes (see nfa_union), -1 if none
+      list_t* edges;
+      uint64_t __hash;  // of nfa_states, for interning
+};
+
+struct dfa_edge {
+      char value;
+      dfa_node_t* to;
+};
+
+// Bounds on subset construction, which can make exponentially many states (0 for no bound)
+struct dfa_limits {
+      int max_states;
+      // of the arena the dfa is built in (including what it already held), plus bytes_per_state
+      // for every state
+      size_t max_bytes;
+      size_t bytes_per_state;  // what each state will take once built on (e.g. its table row)
+      double deadline;   // monotonic_seconds() by which construction must be done
+      DFALimit exceeded;  // set by dfa_from_nfa_with_limits()
+};
 
 bool dfa_accepts(dfa_t* dfa, char* str, int len);
-dfa_t* dfa_from_nfa(nfa_t* nfa);
-void free_dfa(dfa_t* dfa);
+// The dfa is allocated from the arena and freed with it
+dfa_t* dfa_from_nfa(arena_t* arena, nfa_t* nfa);
+// Like dfa_from_nfa(), but gives up as soon as a limit is exceeded
+// @returns null (with limits->exceeded set) if a limit was exceeded, the arena keeps what was built
+dfa_t* dfa_from_nfa_with_limits(arena_t* arena, nfa_t* nfa, dfa_limits_t* limits);
 void log_dfa(dfa_t* dfa);
 
 #endif  // DFA_H
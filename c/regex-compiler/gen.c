@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sregex.h"
+
+#define DEFAULT_FUNCTION_NAME "sregex_match"
+
+// Build-time generator: compiles a pattern and writes a standalone C matcher for it
+int main(int argc, char** argv) {
+   int flags = REGEX_FLAG_NONE;
+   const char* function_name = DEFAULT_FUNCTION_NAME;
+
+   int i = 1;
+   for (; i < argc && argv[i][0] == '-'; i++) {
+      if (strcmp(argv[i], "-i") == 0) {
+         flags |= REGEX_FLAG_CASE_INSENSITIVE;
+      } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+         function_name = argv[++i];
+      } else {
+         break;
+      }
+   }
+
+   if (argc - i != 2) {
+      printf("Usage: %s [-i] [-n <function name>] <regex> <output file>\n", argv[0]);
+      return EXIT_FAILURE;
+   }
+   char* pattern = argv[i];
+   const char* output_path = argv[i + 1];
+
+   FILE* out = fopen(output_path, "w");
+   if (out == NULL) {
+      fprintf(stderr, "Error: could not open %s\n", output_path);
+      return EXIT_FAILURE;
+   }
+
+   regex_error_t error;
+   regex_t* regex = new_regex_with_error(pattern, flags, &error);
+   if (regex == NULL) {
+      fprintf(stderr, "Error: %s at offset %d\n", error.message, error.position);
+      fclose(out);
+      return EXIT_FAILURE;
+   }
+   int result = regex_emit_c(regex, out, function_name);
+   regex_release(regex);
+
+   if (fclose(out) != 0 || result != 0) {
+      fprintf(stderr, "Error: could not generate %s\n", output_path);
+      return EXIT_FAILURE;
+   }
+
+   return EXIT_SUCCESS;
+}
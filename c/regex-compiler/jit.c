@@ -0,0 +1,367 @@
+#include "jit.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JIT_X86_64 1
+#include <sys/mman.h>
+#endif
+
+#define JIT_MAX_CODE_SIZE (16 * 1024 * 1024)
+
+// Generated code is called with the full 64-bit length in rsi
+typedef bool (*jit_match_f)(const char* str, long len);
+
+struct jit {
+      jit_match_f match;
+      void* code;
+      size_t code_size;
+};
+
+bool jit_supported(void) {
+#ifdef JIT_X86_64
+   return true;
+#else
+   return false;
+#endif
+}
+
+bool jit_accepts(jit_t* jit, char* str, int len) { return jit->match(str, (long)len); }
+
+int jit_code_size(jit_t* jit) { return jit->code_size; }
+
+#ifndef JIT_X86_64
+
+jit_t* jit_compile(dfa_table_t* table) { return NULL; }
+
+void free_jit(jit_t* jit) { free(jit); }
+
+#else
+
+/**
+ * x86-64 code generation (System V calling convention)
+ *
+ * rdi = current position in the input, rdx = end of the input, eax = current byte.
+ * Every state is a block:
+ *
+ *    state_n:  cmp rdi, rdx              ; out of input?
+ *              jb next
+ *              mov eax, <accepting>
+ *              ret
+ *        next: movzx eax, byte [rdi]
+ *              inc rdi
+ *              cmp al, <byte>            ; a single byte...
+ *              je state_m
+ *              mov ecx, eax              ; ...a range of bytes...
+ *              sub ecx, <lo>
+ *              cmp ecx, <hi - lo>
+ *              jbe state_k
+ *              lea r8, [rip + <set>]     ; ...or a 256 byte membership set
+ *              cmp byte [r8 + rax], 0
+ *              jne state_j
+ *              jmp reject
+ *
+ * Bytes are grouped by the state they lead to, and the groups covering the most bytes are tested
+ * first. A group made of more than MAX_RANGE_CHECKS ranges is tested with one lookup in a
+ * membership set (stored after the code) instead of a chain of range checks.
+ * Jumps are emitted with 32-bit displacements and patched once every block's offset is known.
+*/
+
+#define LABEL_REJECT -1
+#define LABEL_SET(index) (-2 - (index))
+#define LABEL_SET_INDEX(label) (-2 - (label))
+#define MAX_RANGE_CHECKS 2
+
+typedef struct code_buffer {
+      uint8_t* bytes;
+      size_t size;
+      size_t capacity;
+} code_buffer_t;
+
+typedef struct fixup {
+      size_t offset;  // offset of the rel32 to patch
+      int label;      // state index, LABEL_REJECT or LABEL_SET(set index)
+} fixup_t;
+
+typedef struct fixups {
+      fixup_t* items;
+      int size;
+      int capacity;
+} fixups_t;
+
+// Membership sets (256 bytes each, 1 if the byte belongs to the set)
+typedef struct byte_sets {
+      uint8_t (*items)[TABLE_NUM_BYTES];
+      int size;
+      int capacity;
+} byte_sets_t;
+
+// The bytes of a state that lead to the same next state
+typedef struct target_group {
+      int32_t next;
+      int num_bytes;
+      int num_ranges;
+      uint8_t members[TABLE_NUM_BYTES];
+} target_group_t;
+
+static void emit_byte(code_buffer_t*, uint8_t);
+static void emit_bytes(code_buffer_t*, const uint8_t*, size_t);
+static void emit_u32(code_buffer_t*, uint32_t);
+static void emit_rel32(code_buffer_t*, fixups_t*, const uint8_t*, size_t, int);
+static void emit_state(code_buffer_t*, fixups_t*, byte_sets_t*, dfa_table_t*, int);
+static void emit_range_checks(code_buffer_t*, fixups_t*, target_group_t*);
+static void emit_set_check(code_buffer_t*, fixups_t*, byte_sets_t*, target_group_t*);
+static int group_targets(dfa_table_t*, int, target_group_t*);
+static int compare_groups_by_size(const void*, const void*);
+static int intern_byte_set(byte_sets_t*, const uint8_t*);
+static void* map_executable(code_buffer_t*);
+
+jit_t* jit_compile(dfa_table_t* table) {
+   code_buffer_t buffer = {.bytes = NULL, .size = 0, .capacity = 0};
+   fixups_t fixups = {.items = NULL, .size = 0, .capacity = 0};
+   byte_sets_t sets = {.items = NULL, .size = 0, .capacity = 0};
+   size_t* state_offsets = xmalloc(sizeof(size_t) * table->num_states);
+
+   // Entry: rdx = str + len, then start matching in the start state
+   static const uint8_t lea_rdx_rdi_rsi[] = {0x48, 0x8D, 0x14, 0x37};
+   static const uint8_t jmp[] = {0xE9};
+   emit_bytes(&buffer, lea_rdx_rdi_rsi, sizeof lea_rdx_rdi_rsi);
+   emit_rel32(&buffer, &fixups, jmp, sizeof jmp, table->start);
+
+   // Reject: return false
+   size_t reject_offset = buffer.size;
+   static const uint8_t xor_eax_ret[] = {0x31, 0xC0, 0xC3};
+   emit_bytes(&buffer, xor_eax_ret, sizeof xor_eax_ret);
+
+   for (int state = 0; state < table->num_states && buffer.size <= JIT_MAX_CODE_SIZE; state++) {
+      state_offsets[state] = buffer.size;
+      emit_state(&buffer, &fixups, &sets, table, state);
+   }
+
+   // Membership sets go after the code
+   size_t sets_offset = buffer.size;
+   for (int i = 0; i < sets.size; i++) {
+      emit_bytes(&buffer, sets.items[i], TABLE_NUM_BYTES);
+   }
+
+   void* code = NULL;
+   if (buffer.size <= JIT_MAX_CODE_SIZE) {
+      for (int i = 0; i < fixups.size; i++) {
+         int label = fixups.items[i].label;
+         size_t target;
+         if (label >= 0) {
+            target = state_offsets[label];
+         } else if (label == LABEL_REJECT) {
+            target = reject_offset;
+         } else {
+            target = sets_offset + (size_t)LABEL_SET_INDEX(label) * TABLE_NUM_BYTES;
+         }
+         int32_t rel = (int32_t)(target - (fixups.items[i].offset + 4));
+         memcpy(buffer.bytes + fixups.items[i].offset, &rel, sizeof rel);
+      }
+      code = map_executable(&buffer);
+   }
+
+   jit_t* jit = NULL;
+   if (code != NULL) {
+      jit = xmalloc(sizeof(jit_t));
+      jit->code = code;
+      jit->code_size = buffer.size;
+      jit->match = (jit_match_f)code;
+   }
+
+   free(state_offsets);
+   free(sets.items);
+   free(fixups.items);
+   free(buffer.bytes);
+
+   return jit;
+}
+
+void free_jit(jit_t* jit) {
+   munmap(jit->code, jit->code_size);
+   free(jit);
+}
+
+static void emit_state(code_buffer_t* buffer, fixups_t* fixups, byte_sets_t* sets,
+                       dfa_table_t* table, int state) {
+   // cmp rdi, rdx; jb +6; mov eax, <accepting>; ret
+   static const uint8_t cmp_rdi_rdx_jb[] = {0x48, 0x39, 0xD7, 0x72, 0x06};
+   emit_bytes(buffer, cmp_rdi_rdx_jb, sizeof cmp_rdi_rdx_jb);
+   emit_byte(buffer, 0xB8);
+   emit_u32(buffer, table->accepting[state] ? 1 : 0);
+   emit_byte(buffer, 0xC3);
+
+   // movzx eax, byte [rdi]; inc rdi
+   static const uint8_t load_byte[] = {0x0F, 0xB6, 0x07, 0x48, 0xFF, 0xC7};
+   emit_bytes(buffer, load_byte, sizeof load_byte);
+
+   target_group_t* groups = xmalloc(sizeof(target_group_t) * TABLE_NUM_BYTES);
+   int num_groups = group_targets(table, state, groups);
+   qsort(groups, num_groups, sizeof(target_group_t), compare_groups_by_size);
+
+   for (int i = 0; i < num_groups; i++) {
+      if (groups[i].num_ranges <= MAX_RANGE_CHECKS) {
+         emit_range_checks(buffer, fixups, &groups[i]);
+      } else {
+         emit_set_check(buffer, fixups, sets, &groups[i]);
+      }
+   }
+   free(groups);
+
+   static const uint8_t jmp[] = {0xE9};
+   emit_rel32(buffer, fixups, jmp, sizeof jmp, LABEL_REJECT);
+}
+
+static void emit_range_checks(code_buffer_t* buffer, fixups_t* fixups, target_group_t* group) {
+   int lo = 0;
+   while (lo < TABLE_NUM_BYTES) {
+      if (!group->members[lo]) {
+         lo++;
+         continue;
+      }
+      int hi = lo;
+      while (hi + 1 < TABLE_NUM_BYTES && group->members[hi + 1]) {
+         hi++;
+      }
+
+      if (lo == hi) {
+         // cmp al, <lo>; je state
+         static const uint8_t je[] = {0x0F, 0x84};
+         emit_byte(buffer, 0x3C);
+         emit_byte(buffer, lo);
+         emit_rel32(buffer, fixups, je, sizeof je, group->next);
+      } else {
+         // mov ecx, eax; sub ecx, <lo>; cmp ecx, <hi - lo>; jbe state
+         static const uint8_t mov_ecx_eax_sub[] = {0x89, 0xC1, 0x81, 0xE9};
+         static const uint8_t cmp_ecx[] = {0x81, 0xF9};
+         static const uint8_t jbe[] = {0x0F, 0x86};
+         emit_bytes(buffer, mov_ecx_eax_sub, sizeof mov_ecx_eax_sub);
+         emit_u32(buffer, lo);
+         emit_bytes(buffer, cmp_ecx, sizeof cmp_ecx);
+         emit_u32(buffer, hi - lo);
+         emit_rel32(buffer, fixups, jbe, sizeof jbe, group->next);
+      }
+      lo = hi + 1;
+   }
+}
+
+static void emit_set_check(code_buffer_t* buffer, fixups_t* fixups, byte_sets_t* sets,
+                           target_group_t* group) {
+   // lea r8, [rip + set]; cmp byte [r8 + rax], 0; jne state
+   static const uint8_t lea_r8_rip[] = {0x4C, 0x8D, 0x05};
+   static const uint8_t cmp_r8_rax_zero[] = {0x41, 0x80, 0x3C, 0x00, 0x00};
+   static const uint8_t jne[] = {0x0F, 0x85};
+   int set = intern_byte_set(sets, group->members);
+   emit_rel32(buffer, fixups, lea_r8_rip, sizeof lea_r8_rip, LABEL_SET(set));
+   emit_bytes(buffer, cmp_r8_rax_zero, sizeof cmp_r8_rax_zero);
+   emit_rel32(buffer, fixups, jne, sizeof jne, group->next);
+}
+
+// Splits the bytes with a transition out of the state into groups by next state
+static int group_targets(dfa_table_t* table, int state, target_group_t* groups) {
+   int num_groups = 0;
+
+   for (int byte = 0; byte < TABLE_NUM_BYTES; byte++) {
+      int32_t next = table_next(table, state, table->classes[byte]);
+      if (next == TABLE_NO_TRANSITION) {
+         continue;
+      }
+
+      target_group_t* group = NULL;
+      for (int i = 0; i < num_groups; i++) {
+         if (groups[i].next == next) {
+            group = &groups[i];
+            break;
+         }
+      }
+      if (group == NULL) {
+         group = &groups[num_groups++];
+         group->next = next;
+         group->num_bytes = 0;
+         group->num_ranges = 0;
+         memset(group->members, 0, sizeof group->members);
+      }
+
+      group->num_bytes++;
+      if (byte == 0 || !group->members[byte - 1]) {
+         group->num_ranges++;
+      }
+      group->members[byte] = 1;
+   }
+
+   return num_groups;
+}
+
+static int compare_groups_by_size(const void* a, const void* b) {
+   return ((const target_group_t*)b)->num_bytes - ((const target_group_t*)a)->num_bytes;
+}
+
+// Returns the index of an identical set if there is one, otherwise adds the set
+static int intern_byte_set(byte_sets_t* sets, const uint8_t* members) {
+   for (int i = 0; i < sets->size; i++) {
+      if (memcmp(sets->items[i], members, TABLE_NUM_BYTES) == 0) {
+         return i;
+      }
+   }
+   if (sets->size == sets->capacity) {
+      sets->capacity = sets->capacity == 0 ? 8 : sets->capacity * 2;
+      sets->items = xrealloc(sets->items, TABLE_NUM_BYTES * sets->capacity);
+   }
+   memcpy(sets->items[sets->size], members, TABLE_NUM_BYTES);
+   return sets->size++;
+}
+
+// Emits an instruction ending in a rel32 (a jump or a RIP-relative lea) with a placeholder that is
+// patched to point at the label
+static void emit_rel32(code_buffer_t* buffer, fixups_t* fixups, const uint8_t* opcode,
+                      size_t opcode_size, int label) {
+   emit_bytes(buffer, opcode, opcode_size);
+
+   if (fixups->size == fixups->capacity) {
+      fixups->capacity = fixups->capacity == 0 ? 64 : fixups->capacity * 2;
+      fixups->items = xrealloc(fixups->items, sizeof(fixup_t) * fixups->capacity);
+   }
+   fixups->items[fixups->size].offset = buffer->size;
+   fixups->items[fixups->size].label = label;
+   fixups->size++;
+
+   emit_u32(buffer, 0);
+}
+
+static void emit_byte(code_buffer_t* buffer, uint8_t byte) { emit_bytes(buffer, &byte, 1); }
+
+static void emit_bytes(code_buffer_t* buffer, const uint8_t* bytes, size_t size) {
+   while (buffer->size + size > buffer->capacity) {
+      buffer->capacity = buffer->capacity == 0 ? 4096 : buffer->capacity * 2;
+      buffer->bytes = xrealloc(buffer->bytes, buffer->capacity);
+   }
+   memcpy(buffer->bytes + buffer->size, bytes, size);
+   buffer->size += size;
+}
+
+static void emit_u32(code_buffer_t* buffer, uint32_t value) {
+   emit_bytes(buffer, (const uint8_t*)&value, sizeof value);
+}
+
+// Copies the code into fresh pages and flips them from writable to executable (never both)
+static void* map_executable(code_buffer_t* buffer) {
+   void* code =
+       mmap(NULL, buffer->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (code == MAP_FAILED) {
+      return NULL;
+   }
+   memcpy(code, buffer->bytes, buffer->size);
+   if (mprotect(code, buffer->size, PROT_READ | PROT_EXEC) != 0) {
+      munmap(code, buffer->size);
+      return NULL;
+   }
+   return code;
+}
+
+#endif  // JIT_X86_64
@@ -0,0 +1,38 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdbool.h>
+
+#include "table.h"
+
+typedef struct jit jit_t;
+
+/**
+ * Returns true if jit_compile() can generate native code on this architecture (x86-64 only).
+ */
+bool jit_supported(void);
+
+/**
+ * Compiles the table into native code: each state becomes a block of code that dispatches on the
+ * input byte with compare/jump chains over byte ranges.
+ * @returns null if the architecture isn't supported or the table is too large to compile, in which
+ * case callers should keep using table_accepts()
+ */
+jit_t* jit_compile(dfa_table_t*);
+
+/**
+ * Returns true if the compiled table accepts the first len characters of str (exact match).
+ */
+bool jit_accepts(jit_t*, char* str, int len);
+
+/**
+ * Returns the size of the generated code in bytes.
+ */
+int jit_code_size(jit_t*);
+
+/**
+ * Unmaps the generated code and frees the jit.
+ */
+void free_jit(jit_t*);
+
+#endif  // JIT_H
@@ -0,0 +1,106 @@
+#include "lexer.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "dfa.h"
+#include "nfa.h"
+#include "parse.h"
+#include "sregex.h"
+#include "table.h"
+#include "utils.h"
+
+struct lexer {
+      dfa_table_t* table;
+      int* token_ids;  // token id of each rule, indexed by rule
+      int num_rules;
+};
+
+lexer_t* new_lexer(lexer_rule_t* rules, int num_rules, int flags) {
+   if (num_rules <= 0) {
+      error("[new_lexer] a lexer needs at least one rule");
+   }
+
+   int nfa_flags = NFA_FLAG_NONE;
+   if (flags & REGEX_FLAG_CASE_INSENSITIVE) {
+      nfa_flags |= NFA_FLAG_CASE_INSENSITIVE;
+   }
+
+   lexer_t* lexer = xmalloc(sizeof(lexer_t));
+   lexer->num_rules = num_rules;
+   lexer->token_ids = xmalloc(sizeof(int) * num_rules);
+
+   // One nfa per rule, then a single nfa whose accepting nodes remember their rule
+   arena_t* arena = new_arena();
+   nfa_t** nfas = arena_alloc(arena, sizeof(nfa_t*) * num_rules);
+   for (int i = 0; i < num_rules; i++) {
+      ast_node_t* ast = parse_regex(arena, rules[i].pattern);
+      if (ast == NULL) {
+         arena_release(arena);
+         free(lexer->token_ids);
+         free(lexer);
+         return NULL;
+      }
+      nfas[i] = nfa_from_ast_with_flags(arena, optimize_ast(arena, ast), nfa_flags);
+      lexer->token_ids[i] = rules[i].token_id;
+   }
+   nfa_t* nfa = nfa_union(arena, nfas, num_rules);
+   nfa_simplify(nfa);
+
+   dfa_t* dfa = dfa_from_nfa(arena, nfa);
+   lexer->table = table_from_dfa(dfa, "", flags);
+   arena_release(arena);
+   // Lexer tables are never relaid out, so lexer_tokenize() can index every row directly
+   assert(lexer->table->num_dense == lexer->table->num_states);
+
+   return lexer;
+}
+
+int lexer_tokenize(lexer_t* lexer, char* input, int len, token_t* tokens, int max_tokens,
+                   int* consumed) {
+   const dfa_table_t* table = lexer->table;
+   int num_tokens = 0;
+   int position = 0;
+
+   while (position < len && num_tokens < max_tokens) {
+      int32_t state = table->start;
+      int last_rule = -1;
+      int last_end = position;
+
+      // Run until the dfa has no transition, remembering the last accepting state passed through
+      for (int i = position; i < len; i++) {
+         state = table->transitions[state * table->num_classes + table->classes[(uint8_t)input[i]]];
+         if (state == TABLE_NO_TRANSITION) {
+            break;
+         }
+         if (table->accepting[state]) {
+            last_rule = table->rules[state];
+            last_end = i + 1;
+         }
+      }
+
+      if (last_rule == -1) {
+         break;
+      }
+
+      tokens[num_tokens].token_id = lexer->token_ids[last_rule];
+      tokens[num_tokens].start = position;
+      tokens[num_tokens].length = last_end - position;
+      num_tokens++;
+      position = last_end;
+   }
+
+   if (consumed != NULL) {
+      *consumed = position;
+   }
+
+   return num_tokens;
+}
+
+void lexer_release(lexer_t* lexer) {
+   free_table(lexer->table);
+   free(lexer->token_ids);
+   free(lexer);
+}
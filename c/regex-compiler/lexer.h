@@ -0,0 +1,47 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+typedef struct lexer lexer_t;
+typedef struct lexer_rule lexer_rule_t;
+typedef struct token token_t;
+
+struct lexer_rule {
+      char* pattern;
+      int token_id;
+};
+
+struct token {
+      int token_id;
+      int start;   // offset of the token in the input
+      int length;  // always > 0
+};
+
+/**
+ * Compiles an ordered list of rules into a single dfa. When several rules match the same longest
+ * token, the rule that comes first in the list wins.
+ * @param rules The rules, highest priority first
+ * @param num_rules Number of rules
+ * @param flags Bitwise-or of RegexFlag values (see sregex.h), applied to every rule
+ * @return the lexer, or null if a rule's pattern is invalid
+ */
+lexer_t* new_lexer(lexer_rule_t*, int, int);
+
+/**
+ * Splits the input into tokens using maximal munch: each token is the longest prefix of the rest
+ * of the input that some rule matches. The input is scanned once, remembering the last accepting
+ * state seen, so nothing is rescanned. Empty matches never produce a token.
+ * Tokenizing stops at the end of the input, when no rule matches, or when the token array is full.
+ * @param lexer The lexer
+ * @param input The input to tokenize
+ * @param len Length of the input
+ * @param tokens Caller-provided array the tokens are written to
+ * @param max_tokens Capacity of the tokens array
+ * @param consumed Set to the number of input characters covered by the returned tokens (less than
+ * len if tokenizing stopped early)
+ * @return the number of tokens written
+ */
+int lexer_tokenize(lexer_t*, char*, int, token_t*, int, int*);
+
+void lexer_release(lexer_t*);
+
+#endif  // LEXER_H
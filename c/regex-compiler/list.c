@@ -11,6 +11,14 @@ void list_initialize(list_t* list, list_destructor_t destructor) {
    list->head = NULL;
    list->tail = NULL;
    list->destructor = destructor == NULL ? list_default_destructor : destructor;
+   list->__arena = NULL;
+}
+
+// Nodes of an arena list are allocated from the arena and freed with it, and the list doesn't own
+// its data (allocate the list_t itself from the same arena)
+void list_initialize_in_arena(list_t* list, arena_t* arena) {
+   list_initialize(list, list_noop_data_destructor);
+   list->__arena = arena;
 }
 
 int list_size(list_t* list) {
@@ -24,7 +32,8 @@ int list_size(list_t* list) {
 bool list_empty(list_t* list) { return list->head == NULL; }
 
 void list_push(list_t* list, void* data) {
-   list_node_t* node = (list_node_t*)malloc(sizeof(list_node_t));
+   list_node_t* node = list->__arena != NULL ? arena_alloc(list->__arena, sizeof(list_node_t))
+                                             : (list_node_t*)malloc(sizeof(list_node_t));
    node->data = data;
    node->next = NULL;
 
@@ -45,7 +54,9 @@ void* list_deque(list_t* list) {
    }
 
    list->head = node->next;
-   free(node);
+   if (list->__arena == NULL) {
+      free(node);
+   }
 
    return data;
 }
@@ -106,7 +117,8 @@ void list_sort(list_t* list, int (*compare)(void*, void*)) {
 
 // Deallocate the list using the defined destructor (or free if not defined)
 void list_release(list_t* list) {
-   if (!list) {
+   // Arena lists go away with their arena
+   if (!list || list->__arena != NULL) {
       return;
    }
 
@@ -3,6 +3,8 @@
 
 #include <stdbool.h>
 
+#include "arena.h"
+
 #define list_traverse(list, node) for (node = list->head; node != NULL; node = node->next)
 
 typedef struct list list_t;
@@ -14,6 +16,7 @@ struct list {
       list_node_t* head;
       list_node_t* tail;
       list_destructor_t destructor;
+      arena_t* __arena;  // where nodes come from; null for malloc
 };
 
 struct list_node {
@@ -22,6 +25,7 @@ struct list_node {
 };
 
 void list_initialize(list_t* list, list_destructor_t destructor);
+void list_initialize_in_arena(list_t* list, arena_t* arena);
 int list_size(list_t* list);
 bool list_empty(list_t* list);
 void list_push(list_t* list, void* data);
@@ -1,3 +1,4 @@
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,6 +6,9 @@
 #include "sregex.h"
 
 #define MAX_INPUT_SIZE 256
+#define MAX_GENERATED_SIZE 4096
+#define DEFAULT_GENERATED_LENGTH 32
+#define MAX_REJECTED_ATTEMPTS 16  // random strings to try before giving up on a rejected one
 
 // 1. [DONE] Add runner method that confirms if a string is accepted by the dfa`
 // 2. [DONE] Change how nfa consumes the input stream of regex
@@ -12,7 +16,7 @@
 // 4. Add more regex functions (find all matches in input string, etc.);
 // 5. [DONE - fixed leaks] Check for memory leaks?
 // 6. [DONE] Add tests
-// 7. Use this to generate a lexical-analyzer generator?
+// 7. [DONE - see lexer.h and sregex-gen] Use this to generate a lexical-analyzer generator?
 // 8. Try DFA minimization?
 // 9. Try NFA simulation?
 // 10. Construct the DFA directly by algorithm 3.36 in dragon book (p. 204)
@@ -29,14 +33,119 @@ void read_line(char* buffer, int size) {
    buffer[i] = '\0';
 }
 
+void print_stats(regex_t* regex) {
+   static const char* engines[] = {"table", "jit", "nfa simulation"};
+   regex_stats_t stats;
+   regex_stats(regex, &stats);
+
+   printf("Engine: %s\n", engines[stats.engine]);
+   printf("  Ast nodes: %d (%d optimized)\n", stats.ast_nodes, stats.optimized_ast_nodes);
+   printf("  Nfa: %d states, %d edges\n", stats.nfa_states, stats.nfa_edges);
+   printf("  Dfa: %d states, %d byte classes of %d bytes used\n", stats.dfa_states,
+          stats.byte_classes, stats.alphabet_size);
+   printf("  Table: %zu bytes, jit: %zu bytes\n", stats.table_bytes, stats.jit_bytes);
+   printf("  Time (ms): parse %.3f, optimize %.3f, nfa %.3f, determinize %.3f, table %.3f, "
+          "total %.3f\n",
+          stats.parse_seconds * 1e3, stats.optimize_seconds * 1e3, stats.nfa_seconds * 1e3,
+          stats.determinize_seconds * 1e3, stats.table_seconds * 1e3, stats.total_seconds * 1e3);
+}
+
+// Prints count lines generated from the regex: accepted strings, near misses and random strings
+// the regex rejects, in proportion to the weights of mix. Regexes with no near miss get random
+// strings instead. Fails, rather than print fewer lines or a line of the wrong kind, if the regex
+// accepts no string to generate or no random string it rejects turns up.
+int generate(regex_t* regex, int count, int length, int mix[3], unsigned int seed) {
+   regex_generator_t* generator = new_regex_generator(regex, seed);
+   if (generator == NULL) {
+      fprintf(stderr, "Error: the regex has no dfa to generate from\n");
+      return EXIT_FAILURE;
+   }
+
+   char line[MAX_GENERATED_SIZE];
+   int total = mix[0] + mix[1] + mix[2];
+   int result = EXIT_SUCCESS;
+   for (int i = 0; i < count; i++) {
+      int kind = rand_r(&seed) % total;
+      int len = -1;
+      if (kind < mix[0]) {
+         len = regex_generate(generator, line, MAX_GENERATED_SIZE, length);
+         if (len == -1) {
+            fprintf(stderr, "Error: the regex accepts no string of up to %d bytes\n",
+                    MAX_GENERATED_SIZE - 1);
+            result = EXIT_FAILURE;
+            break;
+         }
+      } else if (kind < mix[0] + mix[1]) {
+         len = regex_generate_near_miss(generator, line, MAX_GENERATED_SIZE, length);
+      }
+      for (int attempt = 0; len == -1 && attempt < MAX_REJECTED_ATTEMPTS; attempt++) {
+         for (int c = 0; c < length && c < MAX_GENERATED_SIZE - 1; c++) {
+            line[c] = ' ' + rand_r(&seed) % ('~' - ' ' + 1);
+         }
+         line[length < MAX_GENERATED_SIZE ? length : MAX_GENERATED_SIZE - 1] = '\0';
+         len = regex_accepts(regex, line) ? -1 : length;
+      }
+      if (len == -1) {
+         fprintf(stderr, "Error: no random string the regex rejects in %d attempts\n",
+                 MAX_REJECTED_ATTEMPTS);
+         result = EXIT_FAILURE;
+         break;
+      }
+      printf("%s\n", line);
+   }
+
+   free_regex_generator(generator);
+   return result;
+}
+
 int main(int argc, char** argv) {
-   if (argc < 2) {
-      printf("Usage: %s <regex>\n", argv[0]);
+   bool show_stats = false;
+   int count = 0;  // lines to generate instead of reading input
+   int length = DEFAULT_GENERATED_LENGTH;
+   int mix[3] = {1, 0, 0};
+   unsigned int seed = 42;
+
+   int i = 1;
+   for (; i < argc - 1 && argv[i][0] == '-'; i++) {
+      if (strcmp(argv[i], "--stats") == 0) {
+         show_stats = true;
+      } else if (strcmp(argv[i], "--generate") == 0 && i + 2 < argc) {
+         count = atoi(argv[++i]);
+      } else if (strcmp(argv[i], "--length") == 0 && i + 2 < argc) {
+         length = atoi(argv[++i]);
+      } else if (strcmp(argv[i], "--mix") == 0 && i + 2 < argc &&
+                 sscanf(argv[++i], "%d:%d:%d", &mix[0], &mix[1], &mix[2]) == 3) {
+         continue;
+      } else if (strcmp(argv[i], "--seed") == 0 && i + 2 < argc) {
+         seed = strtoul(argv[++i], NULL, 10);
+      } else {
+         break;
+      }
+   }
+   if (argc - i != 1 || count < 0 || length < 0 || mix[0] < 0 || mix[1] < 0 || mix[2] < 0 ||
+       mix[0] + mix[1] + mix[2] == 0) {
+      printf("Usage: %s [--stats] <regex>\n", argv[0]);
+      printf("       %s --generate <count> [--length <bytes>] [--mix <accepted>:<near miss>:"
+             "<random>] [--seed <n>] <regex>\n",
+             argv[0]);
       return EXIT_FAILURE;
    }
 
-   char* pattern = argv[1];
-   regex_t* regex = new_regex(pattern);
+   char* pattern = argv[i];
+   regex_error_t error;
+   regex_t* regex = new_regex_with_error(pattern, REGEX_FLAG_NONE, &error);
+   if (regex == NULL) {
+      fprintf(stderr, "Error: %s at offset %d\n", error.message, error.position);
+      return EXIT_FAILURE;
+   }
+   if (show_stats) {
+      print_stats(regex);
+   }
+   if (count > 0) {
+      int status = generate(regex, count, length, mix, seed);
+      regex_release(regex);
+      return status;
+   }
 
    char input[MAX_INPUT_SIZE];
    while (input[0] != '\n') {
@@ -1,6 +1,7 @@
 #include "nfa.h"
 
 #include <assert.h>
+#include <ctype.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,124 +10,181 @@
 #include "utils.h"
 
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
-
+#define NFA_MAX_EDGE_GROWTH 4     // see eliminate_epsilons()
+#define NFA_MAX_CLOSURE_VISITS 16  // per node, see eliminate_epsilons()
+
+// Everything one compilation needs besides the ast, so that concurrent compilations share no state
+typedef struct nfa_context {
+      arena_t* arena;  // holds every nfa, node and edge built
+      int flags;
+      int next_id;                      // node ids are unique within one nfa
+      char characters[ASCII_SIZE + 1];  // scratch for building character sets
+} nfa_context_t;
+
+// An ast node whose nfa is being built, and how many of its children have been visited
+typedef struct build_frame {
+      ast_node_t* node;
+      int next_child;
+} build_frame_t;
+
+static nfa_t* nfa_from_ast_node(nfa_context_t*, ast_node_t*);
+static nfa_t* new_node_nfa(nfa_context_t*, ast_node_t*, nfa_t**);
+
+// Scratch for nfa_simplify(), indexed by node id
+typedef struct simplifier {
+      nfa_t* nfa;
+      nfa_node_t** nodes;  // by id
+      int num_nodes;
+      nfa_node_t** merged_into;  // node a node was merged into, null if it wasn't
+      bool* live;                // not dropped or merged away (yet)
+      int* stamps;               // stamps[id] == stamp if the node was visited in the current walk
+      int stamp;
+      nfa_node_t** stack;
+      nfa_edge_t* edges;  // growable buffer for the edges of one eclosure
+      int edges_capacity;
+      long visited;  // nodes visited by gather_closure_edges() so far
+} simplifier_t;
 // Primitive NFA constructors
-static nfa_t* new_choice_nfa(nfa_t*, nfa_t*);      // 'a|b'
-static nfa_t* new_concat_nfa(nfa_t*, nfa_t*);      // 'ab'
-static nfa_t* new_repetition_nfa(nfa_t*);          // 'a*'
-static nfa_t* new_min_one_repetition_nfa(nfa_t*);  // 'a+'
-static nfa_t* new_optional_nfa(nfa_t*);            // 'a?'
-static nfa_t* new_literal_nfa(char);               // 'a'
+static nfa_t* new_choice_nfa(nfa_context_t*, nfa_t**, int);        // 'a|b|c'
+static nfa_t* new_concat_nfa(nfa_context_t*, nfa_t*, nfa_t*);      // 'ab'
+static nfa_t* new_repetition_nfa(nfa_context_t*, nfa_t*);          // 'a*'
+static nfa_t* new_min_one_repetition_nfa(nfa_context_t*, nfa_t*);  // 'a+'
+static nfa_t* new_optional_nfa(nfa_context_t*, nfa_t*);            // 'a?'
+static nfa_t* new_literal_nfa(nfa_context_t*, char);               // 'a'
+static nfa_t* new_string_nfa(nfa_context_t*, ast_node_string_t*);  // 'abc'
+static void get_literal_characters(nfa_context_t*, char, char*);
 // Chracter classes
-static nfa_t* new_any_character_nfa();
-static nfa_t* new_class_bracketed_nfa(ast_node_class_bracketed_t*);
-static char* get_character_class_characters(CharacterClassKind);
-static nfa_t* nfa_from_character_set(char*);
-static char* get_characters_from_seen_map(char*, int, int);
-static void set_characters_into_seen_map(char*, char*);
+static nfa_t* new_any_character_nfa(nfa_context_t*);
+static nfa_t* new_class_bracketed_nfa(nfa_context_t*, ast_node_class_bracketed_t*);
+static void get_character_class_characters(CharacterClassKind, char*);
+static nfa_t* nfa_from_character_set(nfa_context_t*, const char*);
+static void get_characters_from_seen_map(char*, int, int, char*);
+static void set_characters_into_seen_map(char*, const char*);
+static void fold_case_in_seen_map(char*);
 
 // Helpers for the NFA constructors
-static nfa_t* new_nfa();
+static nfa_t* new_nfa(nfa_context_t*);
 static void nfa_consume_nodes(nfa_t*, nfa_t*);
 static void nfa_set_start_end(nfa_t*, nfa_node_t*, nfa_node_t*);
-static nfa_node_t* nfa_new_node(nfa_t*, int);
-static nfa_node_t* new_node(int);
-static nfa_edge_t* new_edges(int);
+static nfa_node_t* nfa_new_node(nfa_context_t*, nfa_t*, int);
+static nfa_node_t* new_node(nfa_context_t*, int);
+static nfa_edge_t* new_edges(nfa_context_t*, int);
 static void node_set_edges(nfa_node_t*, nfa_edge_t*, int);
 static void init_epsilon(nfa_edge_t*);
+static void init_byte_set(nfa_edge_t*, const char*);
+static void log_byte_set(nfa_edge_t*);
 // Traversal
 typedef void (*on_node_f)(nfa_node_t*);
 static void nfa_traverse(nfa_t*, on_node_f);
 static void nodes_traverse(nfa_node_t*, on_node_f, list_t*);
-static void free_nfa_list_node(void*);
 static void log_node(nfa_node_t*);
-
-static int node_id = 0;
+// Simplification
+static void simplifier_initialize(simplifier_t*, nfa_t*);
+static void eliminate_epsilons(simplifier_t*);
+static int gather_closure_edges(simplifier_t*, nfa_node_t*, bool*, int*);
+static int canonicalize_edges(simplifier_t*, nfa_edge_t*, int);
+static bool merge_equivalent_nodes(simplifier_t*);
+static void drop_unreachable_nodes(simplifier_t*);
+static bool edge_is_empty(nfa_edge_t*);
+static bool nodes_equivalent(nfa_node_t*, nfa_node_t*);
+static uint64_t hash_node(nfa_node_t*);
+static int edge_target_comparator(const void*, const void*);
 
 /**
  * Public API
 */
 
-nfa_t* nfa_from_ast(ast_node_t* root) {
-   nfa_t* nfa;
+nfa_t* nfa_from_ast(arena_t* arena, ast_node_t* root) {
+   return nfa_from_ast_with_flags(arena, root, NFA_FLAG_NONE);
+}
 
-   switch (root->kind) {
-      case NODE_KIND_OPTION: {
-         nfa_t* left = nfa_from_ast(root->option->left);
-         nfa_t* right = nfa_from_ast(root->option->right);
-         nfa = new_choice_nfa(left, right);
-         break;
-      }
-      case NODE_KIND_CONCAT: {
-         nfa_t* left = nfa_from_ast(root->concat->left);
-         nfa_t* right = nfa_from_ast(root->concat->right);
-         nfa = new_concat_nfa(left, right);
-         break;
-      }
-      case NODE_KIND_REPITITION: {
-         nfa_t* child = nfa_from_ast(root->repitition->child);
-         switch (root->repitition->kind) {
-            case REPITITION_KIND_ZERO_OR_MORE:
-               nfa = new_repetition_nfa(child);
-               break;
-            case REPITITION_KIND_ZERO_OR_ONE:
-               nfa = new_optional_nfa(child);
-               break;
-            case REPITITION_KIND_ONE_OR_MORE:
-               nfa = new_min_one_repetition_nfa(child);
-               break;
-            default:
-               error("[nfa_from_ast] unexpected repitition kind");
-         }
-         break;
-      }
-      case NODE_KIND_DOT: {
-         nfa = new_any_character_nfa();
-         break;
-      }
-      case NODE_KIND_LITERAL: {
-         nfa = new_literal_nfa(root->literal->value);
-         break;
-      }
-      case NODE_KIND_CHARACTER_CLASS: {
-         nfa = nfa_from_character_set(get_character_class_characters(root->character_class->kind));
-         break;
-      }
-      case NODE_KIND_CLASS_BRACKETED: {
-         nfa = new_class_bracketed_nfa(root->class_bracketed);
-         break;
-      }
+nfa_t* nfa_from_ast_with_flags(arena_t* arena, ast_node_t* root, int flags) {
+   nfa_context_t ctx = {.arena = arena, .flags = flags, .next_id = 0};
+   return nfa_from_ast_node(&ctx, root);
+}
+
+nfa_t* nfa_union(arena_t* arena, nfa_t** nfas, int num_nfas) {
+   nfa_context_t ctx = {.arena = arena, .flags = NFA_FLAG_NONE, .next_id = 0};
+   nfa_t* nfa = new_nfa(&ctx);
+   nfa_node_t* start_node = nfa_new_node(&ctx, nfa, num_nfas);
+
+   for (int i = 0; i < num_nfas; i++) {
+      nfa_consume_nodes(nfa, nfas[i]);
+      nfas[i]->end->rule = i;
+
+      init_epsilon(&start_node->edges[i]);
+      start_node->edges[i].to = nfas[i]->start;
    }
+
+   // There is no single end node; each rule's end node stays accepting
+   nfa->start = start_node;
+   nfa->end = NULL;
+
+   // Each nfa numbered its nodes from 0, so renumber them to keep ids unique
+   ctx.next_id = 0;
+   list_node_t* current;
+   list_traverse(nfa->__nodes, current) { ((nfa_node_t*)current->data)->id = ctx.next_id++; }
+
    return nfa;
 }
 
 int nfa_num_states(nfa_t* nfa) { return list_size(nfa->__nodes); }
 
+void nfa_stats(nfa_t* nfa, nfa_stats_t* stats) {
+   stats->num_states = 0;
+   stats->num_edges = 0;
+   stats->num_epsilon_edges = 0;
+
+   list_node_t* current;
+   list_traverse(nfa->__nodes, current) {
+      nfa_node_t* node = (nfa_node_t*)current->data;
+      stats->num_states++;
+      stats->num_edges += node->num_edges;
+      for (int i = 0; i < node->num_edges; i++) {
+         stats->num_epsilon_edges += node->edges[i].is_epsilon ? 1 : 0;
+      }
+   }
+}
+
+void nfa_simplify(nfa_t* nfa) {
+   simplifier_t s;
+   simplifier_initialize(&s, nfa);
+
+   eliminate_epsilons(&s);
+   while (merge_equivalent_nodes(&s)) {
+   }
+   drop_unreachable_nodes(&s);
+   free(s.edges);
+
+   // Accepting may be spread over several nodes now, and unreachable bytes gone from the language
+   nfa->end = NULL;
+   nfa->__language = NULL;
+}
+
 char* nfa_language(nfa_t* nfa) {
    if (nfa->__language != NULL) {
       return nfa->__language;
    }
 
-   static char seen_characters[128];
-   memset(seen_characters, 0, sizeof seen_characters);
-
-   nfa->__language = malloc(sizeof(char) * 128);
-   int lang_index = 0;
-   char edge_value = '\0';
+   // Union of the bytes of every edge (epsilon edges have none)
+   nfa_edge_t all_bytes;
+   init_epsilon(&all_bytes);
 
    list_node_t* current;
    list_traverse(nfa->__nodes, current) {
       nfa_node_t* nfa_node = (nfa_node_t*)current->data;
       for (int i = 0; i < nfa_node->num_edges; i++) {
-         if (nfa_node->edges[i].is_epsilon) {
-            continue;
+         for (int word = 0; word < NFA_EDGE_NUM_WORDS; word++) {
+            all_bytes.bytes[word] |= nfa_node->edges[i].bytes[word];
          }
+      }
+   }
 
-         edge_value = nfa_node->edges[i].value;
-         if (seen_characters[(int)edge_value] == 0) {
-            nfa->__language[lang_index++] = edge_value;
-            seen_characters[(int)edge_value] = 1;
-         }
+   nfa->__language = arena_alloc(nfa->__arena, sizeof(char) * ASCII_SIZE);
+   int lang_index = 0;
+   for (int ch = 1; ch < ASCII_SIZE; ch++) {
+      if (nfa_edge_has_byte(&all_bytes, ch)) {
+         nfa->__language[lang_index++] = ch;
       }
    }
    nfa->__language[lang_index] = '\0';
@@ -136,22 +194,13 @@ char* nfa_language(nfa_t* nfa) {
 
 nfa_node_t* nfa_node_find_transition(nfa_node_t* nfa_node, char ch) {
    for (int i = 0; i < nfa_node->num_edges; i++) {
-      if (nfa_node->edges[i].value == ch) {
+      if (nfa_edge_has_byte(&nfa_node->edges[i], ch)) {
          return nfa_node->edges[i].to;
       }
    }
    return NULL;
 }
 
-void free_nfa(nfa_t* nfa) {
-   // Releaase all nodes in the nfa
-   list_release(nfa->__nodes);
-   if (nfa->__language != NULL) {
-      free(nfa->__language);
-   }
-   free(nfa);
-}
-
 void log_nfa(nfa_t* nfa) {
    printf("NFA (start - %d):\n", nfa->start->id);
    nfa_traverse(nfa, log_node);
@@ -161,50 +210,138 @@ void log_nfa(nfa_t* nfa) {
  * Primitive NFA constructors
 */
 
-static nfa_t* new_choice_nfa(nfa_t* left, nfa_t* right) {
-   nfa_t* nfa = new_nfa();
-   nfa_consume_nodes(nfa, left);
-   nfa_consume_nodes(nfa, right);
+// Builds the nfa bottom-up, walking the ast with an explicit stack so that deeply nested patterns
+// can't overflow the call stack: a node is built once all its children are, from the nfas they left
+// on the results stack
+static nfa_t* nfa_from_ast_node(nfa_context_t* ctx, ast_node_t* root) {
+   int frames_capacity = 64;
+   int results_capacity = 64;
+   build_frame_t* frames = xmalloc(sizeof(build_frame_t) * frames_capacity);
+   nfa_t** results = xmalloc(sizeof(nfa_t*) * results_capacity);
+   int num_frames = 0;
+   int num_results = 0;
+
+   frames[num_frames++] = (build_frame_t){.node = root, .next_child = 0};
+   while (num_frames > 0) {
+      build_frame_t* frame = &frames[num_frames - 1];
+      ast_node_t** children;
+      int num_children = ast_node_children(frame->node, &children);
+
+      if (frame->next_child < num_children) {
+         ast_node_t* child = children[frame->next_child++];
+         if (num_frames == frames_capacity) {
+            frames_capacity *= 2;
+            frames = xrealloc(frames, sizeof(build_frame_t) * frames_capacity);
+         }
+         frames[num_frames++] = (build_frame_t){.node = child, .next_child = 0};
+         continue;
+      }
 
-   // Turn off 'accepting' of both sides
-   left->end->is_accepting = false;
-   right->end->is_accepting = false;
+      num_frames--;
+      num_results -= num_children;
+      nfa_t* nfa = new_node_nfa(ctx, frame->node, &results[num_results]);
+      if (num_results == results_capacity) {
+         results_capacity *= 2;
+         results = xrealloc(results, sizeof(nfa_t*) * results_capacity);
+      }
+      results[num_results++] = nfa;
+   }
+
+   nfa_t* nfa = results[0];
+   free(frames);
+   free(results);
+   return nfa;
+}
+
+// Builds the nfa of an ast node from the nfas of its children (in order)
+static nfa_t* new_node_nfa(nfa_context_t* ctx, ast_node_t* root, nfa_t** children) {
+   nfa_t* nfa = NULL;
+
+   switch (root->kind) {
+      case NODE_KIND_OPTION: {
+         nfa = new_choice_nfa(ctx, children, root->option->num_children);
+         break;
+      }
+      case NODE_KIND_CONCAT: {
+         nfa = children[0];
+         for (int i = 1; i < root->concat->num_children; i++) {
+            nfa = new_concat_nfa(ctx, nfa, children[i]);
+         }
+         break;
+      }
+      case NODE_KIND_REPITITION: {
+         nfa_t* child = children[0];
+         switch (root->repitition->kind) {
+            case REPITITION_KIND_ZERO_OR_MORE:
+               nfa = new_repetition_nfa(ctx, child);
+               break;
+            case REPITITION_KIND_ZERO_OR_ONE:
+               nfa = new_optional_nfa(ctx, child);
+               break;
+            case REPITITION_KIND_ONE_OR_MORE:
+               nfa = new_min_one_repetition_nfa(ctx, child);
+               break;
+            default:
+               error("[nfa_from_ast_node] unexpected repitition kind");
+         }
+         break;
+      }
+      case NODE_KIND_DOT: {
+         nfa = new_any_character_nfa(ctx);
+         break;
+      }
+      case NODE_KIND_LITERAL: {
+         nfa = new_literal_nfa(ctx, root->literal->value);
+         break;
+      }
+      case NODE_KIND_CHARACTER_CLASS: {
+         get_character_class_characters(root->character_class->kind, ctx->characters);
+         nfa = nfa_from_character_set(ctx, ctx->characters);
+         break;
+      }
+      case NODE_KIND_CLASS_BRACKETED: {
+         nfa = new_class_bracketed_nfa(ctx, root->class_bracketed);
+         break;
+      }
+      case NODE_KIND_STRING: {
+         nfa = new_string_nfa(ctx, root->string);
+         break;
+      }
+   }
+   return nfa;
+}
+
+static nfa_t* new_choice_nfa(nfa_context_t* ctx, nfa_t** choices, int num_choices) {
+   nfa_t* nfa = new_nfa(ctx);
+   for (int i = 0; i < num_choices; i++) {
+      nfa_consume_nodes(nfa, choices[i]);
+      // Turn off 'accepting' of every choice
+      choices[i]->end->is_accepting = false;
+   }
 
    // Create the start and end nodes of choice nfa
-   nfa_node_t* start_node = nfa_new_node(nfa, 2);
-   nfa_node_t* end_node = nfa_new_node(nfa, 0);
+   nfa_node_t* start_node = nfa_new_node(ctx, nfa, num_choices);
+   nfa_node_t* end_node = nfa_new_node(ctx, nfa, 0);
 
-   // Initialize epsilon edges for start node
-   for (int i = 0; i < start_node->num_edges; i++) {
+   // Epsilon edges from the start to every choice, and from every choice to the end
+   for (int i = 0; i < num_choices; i++) {
       init_epsilon(&start_node->edges[i]);
+      start_node->edges[i].to = choices[i]->start;
+
+      nfa_edge_t* edge_to_end = new_edges(ctx, 1);
+      init_epsilon(edge_to_end);
+      edge_to_end->to = end_node;
+      node_set_edges(choices[i]->end, edge_to_end, 1);
    }
-   start_node->edges[0].to = left->start;
-   start_node->edges[1].to = right->start;
-
-   // Create epsilon edges that connect to end node
-   // Left-end -> end
-   nfa_edge_t* left_edge_to_end = new_edges(1);
-   init_epsilon(left_edge_to_end);
-   left_edge_to_end->to = end_node;
-   node_set_edges(left->end, left_edge_to_end, 1);
-   // Right-end -> end
-   nfa_edge_t* right_edge_to_end = new_edges(1);
-   init_epsilon(right_edge_to_end);
-   right_edge_to_end->to = end_node;
-   node_set_edges(right->end, right_edge_to_end, 1);
 
    // Hook up start and end to nfa
    nfa_set_start_end(nfa, start_node, end_node);
 
-   // Free the old nfas, but not their contents
-   free(left);
-   free(right);
-
    return nfa;
 }
 
-static nfa_t* new_concat_nfa(nfa_t* left, nfa_t* right) {
-   nfa_t* nfa = new_nfa();
+static nfa_t* new_concat_nfa(nfa_context_t* ctx, nfa_t* left, nfa_t* right) {
+   nfa_t* nfa = new_nfa(ctx);
    nfa_consume_nodes(nfa, left);
    nfa_consume_nodes(nfa, right);
 
@@ -213,7 +350,7 @@ static nfa_t* new_concat_nfa(nfa_t* left, nfa_t* right) {
    right->end->is_accepting = false;
 
    // Create the connecting epsilon edge
-   nfa_edge_t* edges = new_edges(1);
+   nfa_edge_t* edges = new_edges(ctx, 1);
    init_epsilon(edges);
    // Make the connection between the left and right side using the new 'edge'
    edges->to = right->start;
@@ -222,23 +359,19 @@ static nfa_t* new_concat_nfa(nfa_t* left, nfa_t* right) {
    // Hook up start and end to nfa
    nfa_set_start_end(nfa, left->start, right->end);
 
-   // Free the old nfas, but not their contents
-   free(left);
-   free(right);
-
    return nfa;
 }
 
-static nfa_t* new_repetition_nfa(nfa_t* old_nfa) {
-   nfa_t* nfa = new_nfa();
+static nfa_t* new_repetition_nfa(nfa_context_t* ctx, nfa_t* old_nfa) {
+   nfa_t* nfa = new_nfa(ctx);
    nfa_consume_nodes(nfa, old_nfa);
 
    // Turn off 'accepting' of previous nfa
    old_nfa->end->is_accepting = false;
 
    // Create the start and end nodes of repetition nfa
-   nfa_node_t* start_node = nfa_new_node(nfa, 2);
-   nfa_node_t* end_node = nfa_new_node(nfa, 0);
+   nfa_node_t* start_node = nfa_new_node(ctx, nfa, 2);
+   nfa_node_t* end_node = nfa_new_node(ctx, nfa, 0);
 
    // Initialize epsilon edges for start node
    for (int i = 0; i < start_node->num_edges; i++) {
@@ -248,7 +381,7 @@ static nfa_t* new_repetition_nfa(nfa_t* old_nfa) {
    start_node->edges[1].to = end_node;
 
    // Create epsilon edges for old end node
-   nfa_edge_t* old_end_edges = new_edges(2);
+   nfa_edge_t* old_end_edges = new_edges(ctx, 2);
    for (int i = 0; i < 2; i++) {
       init_epsilon(&old_end_edges[i]);
    }
@@ -259,29 +392,26 @@ static nfa_t* new_repetition_nfa(nfa_t* old_nfa) {
    // Hook up start and end to nfa
    nfa_set_start_end(nfa, start_node, end_node);
 
-   // Free the old nfa, but not its contents;
-   free(old_nfa);
-
    return nfa;
 }
 
-static nfa_t* new_min_one_repetition_nfa(nfa_t* old_nfa) {
-   nfa_t* nfa = new_nfa();
+static nfa_t* new_min_one_repetition_nfa(nfa_context_t* ctx, nfa_t* old_nfa) {
+   nfa_t* nfa = new_nfa(ctx);
    nfa_consume_nodes(nfa, old_nfa);
 
    // Turn off 'accepting' of previous nfa
    old_nfa->end->is_accepting = false;
 
    // Create the start and end nodes of repetition nfa
-   nfa_node_t* start_node = nfa_new_node(nfa, 1);
-   nfa_node_t* end_node = nfa_new_node(nfa, 0);
+   nfa_node_t* start_node = nfa_new_node(ctx, nfa, 1);
+   nfa_node_t* end_node = nfa_new_node(ctx, nfa, 0);
 
    // Initialize epsilon edges for start node
    init_epsilon(&start_node->edges[0]);
    start_node->edges[0].to = old_nfa->start;
 
    // Create epsilon edges for old end node
-   nfa_edge_t* old_end_edges = new_edges(2);
+   nfa_edge_t* old_end_edges = new_edges(ctx, 2);
    for (int i = 0; i < 2; i++) {
       init_epsilon(&old_end_edges[i]);
    }
@@ -292,22 +422,19 @@ static nfa_t* new_min_one_repetition_nfa(nfa_t* old_nfa) {
    // Hook up start and end to nfa
    nfa_set_start_end(nfa, start_node, end_node);
 
-   // Free the old nfa, but not its contents;
-   free(old_nfa);
-
    return nfa;
 }
 
-static nfa_t* new_optional_nfa(nfa_t* old_nfa) {
-   nfa_t* nfa = new_nfa();
+static nfa_t* new_optional_nfa(nfa_context_t* ctx, nfa_t* old_nfa) {
+   nfa_t* nfa = new_nfa(ctx);
    nfa_consume_nodes(nfa, old_nfa);
 
    // Turn off 'accepting' of previous nfa
    old_nfa->end->is_accepting = false;
 
    // Create the start and end nodes of repetition nfa
-   nfa_node_t* start_node = nfa_new_node(nfa, 2);
-   nfa_node_t* end_node = nfa_new_node(nfa, 0);
+   nfa_node_t* start_node = nfa_new_node(ctx, nfa, 2);
+   nfa_node_t* end_node = nfa_new_node(ctx, nfa, 0);
 
    // Initialize epsilon edges for start node
    for (int i = 0; i < start_node->num_edges; i++) {
@@ -317,7 +444,7 @@ static nfa_t* new_optional_nfa(nfa_t* old_nfa) {
    start_node->edges[1].to = end_node;
 
    // Create epsilon edges for old end node
-   nfa_edge_t* old_end_edges = new_edges(1);
+   nfa_edge_t* old_end_edges = new_edges(ctx, 1);
    init_epsilon(old_end_edges);
    old_end_edges->to = end_node;
    node_set_edges(old_nfa->end, old_end_edges, 1);
@@ -325,52 +452,65 @@ static nfa_t* new_optional_nfa(nfa_t* old_nfa) {
    // Hook up start and end to nfa
    nfa_set_start_end(nfa, start_node, end_node);
 
-   // Free the old nfa, but not its contents;
-   free(old_nfa);
-
    return nfa;
 }
 
-static nfa_t* new_literal_nfa(char value) {
-   nfa_t* nfa = new_nfa();
-
-   // Create start and end nodes of literal nfa
-   nfa_node_t* start_node = nfa_new_node(nfa, 1);
-   nfa_node_t* end_node = nfa_new_node(nfa, 0);
-
-   // Init connecting edge with the literal value and make connection
-   start_node->edges[0].value = value;
-   start_node->edges[0].is_epsilon = false;
-   start_node->edges[0].to = end_node;
+static nfa_t* new_literal_nfa(nfa_context_t* ctx, char value) {
+   // A literal is a one character set (two with both cases, which costs the same: one edge)
+   char characters[3];
+   get_literal_characters(ctx, value, characters);
+   return nfa_from_character_set(ctx, characters);
+}
 
-   // Hook up start and end to nfa
-   nfa_set_start_end(nfa, start_node, end_node);
+static nfa_t* new_string_nfa(nfa_context_t* ctx, ast_node_string_t* string) {
+   // A chain of length + 1 nodes, without the epsilon edges concatenating literals would need
+   nfa_t* nfa = new_nfa(ctx);
+   nfa_node_t* start_node = nfa_new_node(ctx, nfa, 1);
+   nfa_node_t* node = start_node;
+   char characters[3];
+
+   for (int i = 0; i < string->length; i++) {
+      nfa_node_t* next_node = nfa_new_node(ctx, nfa, i + 1 < string->length ? 1 : 0);
+      get_literal_characters(ctx, string->value[i], characters);
+      init_byte_set(&node->edges[0], characters);
+      node->edges[0].to = next_node;
+      node = next_node;
+   }
 
+   nfa_set_start_end(nfa, start_node, node);
    return nfa;
 }
 
+// Writes the characters a literal matches (both cases if case insensitive) into `characters`, which
+// must have room for 3
+static void get_literal_characters(nfa_context_t* ctx, char value, char* characters) {
+   characters[0] = value;
+   characters[1] = '\0';
+   characters[2] = '\0';
+   if ((ctx->flags & NFA_FLAG_CASE_INSENSITIVE) && isalpha(value)) {
+      characters[0] = tolower(value);
+      characters[1] = toupper(value);
+   }
+}
+
 /**
  * Character classes
 */
 
-static nfa_t* new_any_character_nfa() {
+static nfa_t* new_any_character_nfa(nfa_context_t* ctx) {
    // '.' matches any single character except line terminators \n, \r (but includes \t)
-   static char any_characters[NUM_LITERALS + 2] = {0};
-
-   if (any_characters[0] == 0) {
-      int index_offset = 0;
-      for (char cl = LITERAL_START; cl <= LITERAL_END; cl++) {
-         any_characters[index_offset++] = cl;
-      }
-      any_characters[index_offset++] = '\t';
-      any_characters[index_offset] = '\0';
+   int index_offset = 0;
+   for (char cl = LITERAL_START; cl <= LITERAL_END; cl++) {
+      ctx->characters[index_offset++] = cl;
    }
-   return nfa_from_character_set(any_characters);
+   ctx->characters[index_offset++] = '\t';
+   ctx->characters[index_offset] = '\0';
+
+   return nfa_from_character_set(ctx, ctx->characters);
 }
 
-static nfa_t* new_class_bracketed_nfa(ast_node_class_bracketed_t* node) {
-   static char seen_characters[ASCII_SIZE];
-   memset(seen_characters, 0, sizeof seen_characters);
+static nfa_t* new_class_bracketed_nfa(nfa_context_t* ctx, ast_node_class_bracketed_t* node) {
+   char seen_characters[ASCII_SIZE] = {0};
 
    for (int i = 0; i < node->num_items; i++) {
       switch (node->items[i].kind) {
@@ -383,81 +523,73 @@ static nfa_t* new_class_bracketed_nfa(ast_node_class_bracketed_t* node) {
             }
             break;
          case CLASS_SET_ITEM_KIND_CHARACTER_CLASS:
-            set_characters_into_seen_map(seen_characters, get_character_class_characters(
-                                                              node->items[i].character_class.kind));
+            get_character_class_characters(node->items[i].character_class.kind, ctx->characters);
+            set_characters_into_seen_map(seen_characters, ctx->characters);
             break;
       }
    }
 
-   return nfa_from_character_set(
-       get_characters_from_seen_map(seen_characters, ASCII_SIZE, node->negated));
+   // Fold before negating so that '[^a]' excludes both 'a' and 'A'
+   if (ctx->flags & NFA_FLAG_CASE_INSENSITIVE) {
+      fold_case_in_seen_map(seen_characters);
+   }
+
+   get_characters_from_seen_map(seen_characters, ASCII_SIZE, node->negated, ctx->characters);
+   return nfa_from_character_set(ctx, ctx->characters);
 }
 
-static char* get_character_class_characters(CharacterClassKind kind) {
-   static char seen_characters[ASCII_SIZE];
-   static char digit_characters[] = "0123456789";
-   static char whitespace_characters[] = " \t\n\r\f\v";
-   static char word_characters[] =
+// Writes the characters of a character class into `characters` (at least ASCII_SIZE + 1 long)
+static void get_character_class_characters(CharacterClassKind kind, char* characters) {
+   static const char digit_characters[] = "0123456789";
+   static const char whitespace_characters[] = " \t\n\r\f\v";
+   static const char word_characters[] =
        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
-   static char non_digit_characters[ASCII_SIZE] = {0};
-   static char non_whitespace_characters[ASCII_SIZE] = {0};
-   static char non_word_characters[ASCII_SIZE] = {0};
+   char seen_characters[ASCII_SIZE] = {0};
 
    switch (kind) {
       case CHARACTER_CLASS_KIND_DIGIT:
-         return digit_characters;
+         strcpy(characters, digit_characters);
+         break;
       case CHARACTER_CLASS_KIND_NON_DIGIT:
-         if (non_digit_characters[0] == 0) {
-            memset(seen_characters, 0, sizeof seen_characters);
-            set_characters_into_seen_map(seen_characters, digit_characters);
-            strcpy(non_digit_characters,
-                   get_characters_from_seen_map(seen_characters, ASCII_SIZE, 1));
-         }
-         return non_digit_characters;
+         set_characters_into_seen_map(seen_characters, digit_characters);
+         get_characters_from_seen_map(seen_characters, ASCII_SIZE, 1, characters);
+         break;
       case CHARACTER_CLASS_KIND_WHITESPACE:
-         return whitespace_characters;
+         strcpy(characters, whitespace_characters);
+         break;
       case CHARACTER_CLASS_KIND_NON_WHITESPACE:
-         if (non_whitespace_characters[0] == 0) {
-            memset(seen_characters, 0, sizeof seen_characters);
-            set_characters_into_seen_map(seen_characters, whitespace_characters);
-            strcpy(non_whitespace_characters,
-                   get_characters_from_seen_map(seen_characters, ASCII_SIZE, 1));
-         }
-         return non_whitespace_characters;
+         set_characters_into_seen_map(seen_characters, whitespace_characters);
+         get_characters_from_seen_map(seen_characters, ASCII_SIZE, 1, characters);
+         break;
       case CHARACTER_CLASS_KIND_WORD:
-         return word_characters;
+         strcpy(characters, word_characters);
+         break;
       case CHARACTER_CLASS_KIND_NON_WORD:
-         if (non_word_characters[0] == 0) {
-            memset(seen_characters, 0, sizeof seen_characters);
-            set_characters_into_seen_map(seen_characters, word_characters);
-            strcpy(non_word_characters,
-                   get_characters_from_seen_map(seen_characters, ASCII_SIZE, 1));
-         }
-         return non_word_characters;
+         set_characters_into_seen_map(seen_characters, word_characters);
+         get_characters_from_seen_map(seen_characters, ASCII_SIZE, 1, characters);
+         break;
       default:
          error("[get_character_class_characters] unexpected character class kind");
    }
-   return NULL;
 }
 
-static nfa_t* nfa_from_character_set(char* characters) {
-   nfa_t* nfa = new_nfa();
-   nfa_node_t* start_node = nfa_new_node(nfa, strlen(characters));
-   nfa_node_t* end_node = nfa_new_node(nfa, 0);
+static nfa_t* nfa_from_character_set(nfa_context_t* ctx, const char* characters) {
+   nfa_t* nfa = new_nfa(ctx);
+   nfa_node_t* start_node = nfa_new_node(ctx, nfa, 1);
+   nfa_node_t* end_node = nfa_new_node(ctx, nfa, 0);
    nfa_set_start_end(nfa, start_node, end_node);
 
-   for (int i = 0; i < strlen(characters); i++) {
-      nfa->start->edges[i].value = characters[i];
-      nfa->start->edges[i].is_epsilon = false;
-      nfa->start->edges[i].to = nfa->end;
-   }
+   // A single edge for the whole set (an empty set, e.g. from a negated class, never matches)
+   init_byte_set(&start_node->edges[0], characters);
+   start_node->edges[0].to = end_node;
+
    return nfa;
 }
 
-static char* get_characters_from_seen_map(char* seen_map, int map_size, int negated) {
-   static char characters[ASCII_SIZE];
-   memset(characters, 0, sizeof characters);
-
+// Writes the characters marked in the seen map (or, if negated, the valid ones not marked) into
+// `characters`, which must have room for map_size + 1 characters
+static void get_characters_from_seen_map(char* seen_map, int map_size, int negated,
+                                         char* characters) {
    int index_offset = 0;
    for (int i = 0; i < map_size; i++) {
       if (negated == 1) {
@@ -469,36 +601,44 @@ static char* get_characters_from_seen_map(char* seen_map, int map_size, int nega
       }
    }
    characters[index_offset] = '\0';
-
-   return characters;
 }
 
-void set_characters_into_seen_map(char* seen_map, char* characters) {
+static void set_characters_into_seen_map(char* seen_map, const char* characters) {
    for (int i = 0; i < strlen(characters); i++) {
       seen_map[(int)characters[i]] = 1;
    }
 }
 
+// Marks the other case of every letter in the seen map
+static void fold_case_in_seen_map(char* seen_map) {
+   for (int ch = 'a'; ch <= 'z'; ch++) {
+      if (seen_map[ch] == 1 || seen_map[toupper(ch)] == 1) {
+         seen_map[ch] = 1;
+         seen_map[toupper(ch)] = 1;
+      }
+   }
+}
+
 /**
  * Helprs for the NFA constructors (private)
 */
 
-static nfa_t* new_nfa() {
-   nfa_t* nfa = xmalloc(sizeof(nfa_t));
+static nfa_t* new_nfa(nfa_context_t* ctx) {
+   nfa_t* nfa = arena_alloc(ctx->arena, sizeof(nfa_t));
    nfa->start = NULL;
    nfa->end = NULL;
    nfa->__language = NULL;
+   nfa->__arena = ctx->arena;
 
-   nfa->__nodes = xmalloc(sizeof(list_t));
-   list_initialize(nfa->__nodes, free_nfa_list_node);
+   nfa->__nodes = arena_alloc(ctx->arena, sizeof(list_t));
+   list_initialize_in_arena(nfa->__nodes, ctx->arena);
 
    return nfa;
 }
 
-// Adds nodes from the 'other' nfa to target nfa and frees the 'other' nodes list (but not its elements whuch have been transfered)
+// Adds nodes from the 'other' nfa to target nfa (the 'other' nfa is left in the arena, unused)
 static void nfa_consume_nodes(nfa_t* nfa, nfa_t* other) {
    list_concat(nfa->__nodes, other->__nodes);
-   free(other->__nodes);
 }
 
 // Set start and end node, and set end node to be accepting
@@ -508,21 +648,22 @@ static void nfa_set_start_end(nfa_t* nfa, nfa_node_t* start, nfa_node_t* end) {
    nfa->end->is_accepting = true;
 }
 
-static nfa_node_t* nfa_new_node(nfa_t* nfa, int num_edges) {
-   nfa_node_t* node = new_node(num_edges);
+static nfa_node_t* nfa_new_node(nfa_context_t* ctx, nfa_t* nfa, int num_edges) {
+   nfa_node_t* node = new_node(ctx, num_edges);
    list_push(nfa->__nodes, node);
 
    return node;
 }
 
 // Alloc a node and its edges -> edges are empty and need to be initialized
-static nfa_node_t* new_node(int num_edges) {
-   nfa_node_t* node = xmalloc(sizeof(nfa_node_t));
-   node->id = node_id++;
+static nfa_node_t* new_node(nfa_context_t* ctx, int num_edges) {
+   nfa_node_t* node = arena_alloc(ctx->arena, sizeof(nfa_node_t));
+   node->id = ctx->next_id++;
    node->is_accepting = false;
+   node->rule = 0;
 
    if (num_edges > 0) {
-      nfa_edge_t* edges = new_edges(num_edges);
+      nfa_edge_t* edges = new_edges(ctx, num_edges);
       node->edges = edges;
       node->num_edges = num_edges;
    } else {
@@ -533,8 +674,8 @@ static nfa_node_t* new_node(int num_edges) {
    return node;
 }
 
-static nfa_edge_t* new_edges(int num) {
-   nfa_edge_t* edges = xmalloc(num * sizeof(nfa_edge_t));
+static nfa_edge_t* new_edges(nfa_context_t* ctx, int num) {
+   nfa_edge_t* edges = arena_alloc(ctx->arena, num * sizeof(nfa_edge_t));
    for (int i = 0; i < num; i++) {
       edges[i].to = NULL;
    }
@@ -551,11 +692,19 @@ static void node_set_edges(nfa_node_t* node, nfa_edge_t* edges, int num_edges) {
 }
 
 static void init_epsilon(nfa_edge_t* edge) {
-   edge->value = '\0';
    edge->is_epsilon = true;
+   memset(edge->bytes, 0, sizeof edge->bytes);
    edge->to = NULL;
 }
 
+static void init_byte_set(nfa_edge_t* edge, const char* characters) {
+   edge->is_epsilon = false;
+   memset(edge->bytes, 0, sizeof edge->bytes);
+   for (const char* ch = characters; *ch != '\0'; ch++) {
+      edge->bytes[(uint8_t)*ch >> 6] |= (uint64_t)1 << ((uint8_t)*ch & 63);
+   }
+}
+
 static void nfa_traverse(nfa_t* nfa, on_node_f on_node) {
    list_t* seen_nodes = xmalloc(sizeof(list_t));
    list_initialize(seen_nodes, list_noop_data_destructor);
@@ -579,16 +728,6 @@ static void nodes_traverse(nfa_node_t* node, on_node_f on_node, list_t* seen_nod
    }
 }
 
-static void free_nfa_list_node(void* data) {
-   nfa_node_t* node = (nfa_node_t*)data;
-   // printf("freeing node %d\n", node->id);
-   if (node->edges != NULL) {
-      free(node->edges);
-   }
-   // printf("freed node\n");
-   free(node);
-}
-
 static void log_node(nfa_node_t* node) {
    printf("Node %d - num_edges: %d, %s\n", node->id, node->num_edges,
           node->is_accepting ? "accepting" : "not accepting");
@@ -599,7 +738,305 @@ static void log_node(nfa_node_t* node) {
       if (edge->is_epsilon) {
          printf("Edge: epsilon, to: %d\n", to_id);
       } else {
-         printf("Edge: %c, to: %d\n", edge->value, to_id);
+         printf("Edge: ");
+         log_byte_set(edge);
+         printf(", to: %d\n", to_id);
+      }
+   }
+}
+
+// Logs the edge's bytes as ranges, e.g. [0-9a-f]
+static void log_byte_set(nfa_edge_t* edge) {
+   printf("[");
+   for (int byte = 0; byte < 256; byte++) {
+      if (!nfa_edge_has_byte(edge, byte)) {
+         continue;
+      }
+      int end = byte;
+      while (end + 1 < 256 && nfa_edge_has_byte(edge, end + 1)) {
+         end++;
+      }
+      printf(byte >= LITERAL_START && byte <= LITERAL_END ? "%c" : "\\x%02x", byte);
+      if (end > byte) {
+         printf(end >= LITERAL_START && end <= LITERAL_END ? "-%c" : "-\\x%02x", end);
+      }
+      byte = end;
+   }
+   printf("]");
+}
+
+/**
+ * Simplification (private)
+*/
+
+static void simplifier_initialize(simplifier_t* s, nfa_t* nfa) {
+   arena_t* arena = nfa->__arena;
+   s->nfa = nfa;
+   s->num_nodes = nfa_num_states(nfa);
+   s->nodes = arena_alloc(arena, sizeof(nfa_node_t*) * s->num_nodes);
+   s->merged_into = arena_alloc(arena, sizeof(nfa_node_t*) * s->num_nodes);
+   s->live = arena_alloc(arena, sizeof(bool) * s->num_nodes);
+   s->stamps = arena_alloc(arena, sizeof(int) * s->num_nodes);
+   memset(s->stamps, 0, sizeof(int) * s->num_nodes);
+   s->stamp = 0;
+   s->stack = arena_alloc(arena, sizeof(nfa_node_t*) * s->num_nodes);
+   s->edges = NULL;
+   s->edges_capacity = 0;
+   s->visited = 0;
+
+   list_node_t* current;
+   list_traverse(nfa->__nodes, current) {
+      nfa_node_t* node = (nfa_node_t*)current->data;
+      assert(node->id >= 0 && node->id < s->num_nodes);
+      s->nodes[node->id] = node;
+      s->merged_into[node->id] = NULL;
+      s->live[node->id] = true;
+   }
+}
+
+// Gives every node that can be reached by a character (and the start) the character edges and the
+// acceptance of everything in its eclosure, then drops the epsilon edges. The other nodes are only
+// ever entered through epsilon edges, so nothing reaches them anymore.
+// Copying edges out of eclosures is quadratic on chains of optional parts (a?a?a?...), and walking
+// them is quadratic on deeply nested groups ('(a|(a|(a|...)))'), so the nfa is left as it is if
+// that would grow its edges by more than NFA_MAX_EDGE_GROWTH times, or visit more than
+// NFA_MAX_CLOSURE_VISITS nodes per node.
+static void eliminate_epsilons(simplifier_t* s) {
+   arena_t* arena = s->nfa->__arena;
+   bool* important = arena_alloc(arena, sizeof(bool) * s->num_nodes);
+   memset(important, 0, sizeof(bool) * s->num_nodes);
+   important[s->nfa->start->id] = true;
+   int max_edges = 0;
+   for (int id = 0; id < s->num_nodes; id++) {
+      nfa_node_t* node = s->nodes[id];
+      for (int i = 0; i < node->num_edges; i++) {
+         if (!node->edges[i].is_epsilon) {
+            important[node->edges[i].to->id] = true;
+         }
+      }
+      max_edges += node->num_edges * NFA_MAX_EDGE_GROWTH;
+   }
+
+   // Closures read the original epsilon edges, so the new edges are only installed at the end
+   nfa_edge_t** new_edges = arena_alloc(arena, sizeof(nfa_edge_t*) * s->num_nodes);
+   int* new_num_edges = arena_alloc(arena, sizeof(int) * s->num_nodes);
+   bool* new_accepting = arena_alloc(arena, sizeof(bool) * s->num_nodes);
+   int* new_rule = arena_alloc(arena, sizeof(int) * s->num_nodes);
+
+   int total_edges = 0;
+   long max_visited = (long)s->num_nodes * NFA_MAX_CLOSURE_VISITS;
+   for (int id = 0; id < s->num_nodes; id++) {
+      if (!important[id]) {
+         continue;
+      }
+      int num_edges = gather_closure_edges(s, s->nodes[id], &new_accepting[id], &new_rule[id]);
+      total_edges += num_edges;
+      if (total_edges > max_edges || s->visited > max_visited) {
+         return;
+      }
+      new_edges[id] = arena_alloc(arena, sizeof(nfa_edge_t) * num_edges);
+      memcpy(new_edges[id], s->edges, sizeof(nfa_edge_t) * num_edges);
+      new_num_edges[id] = num_edges;
+   }
+
+   for (int id = 0; id < s->num_nodes; id++) {
+      nfa_node_t* node = s->nodes[id];
+      s->live[id] = important[id];
+      if (important[id]) {
+         node->edges = new_num_edges[id] > 0 ? new_edges[id] : NULL;
+         node->num_edges = new_num_edges[id];
+         node->is_accepting = new_accepting[id];
+         node->rule = new_rule[id];
+      }
+   }
+}
+
+// Collects the character edges of the node's eclosure into s->edges (one edge per target) and
+// returns how many there are. The node accepts if anything in its eclosure does, with the lowest
+// rule among them, which is what subset construction would have picked.
+static int gather_closure_edges(simplifier_t* s, nfa_node_t* node, bool* accepting, int* rule) {
+   int num_edges = 0;
+   int stack_size = 0;
+   *accepting = false;
+   *rule = 0;
+
+   s->stamp++;
+   s->stamps[node->id] = s->stamp;
+   s->stack[stack_size++] = node;
+
+   while (stack_size > 0) {
+      nfa_node_t* current = s->stack[--stack_size];
+      s->visited++;
+      if (current->is_accepting && (!*accepting || current->rule < *rule)) {
+         *accepting = true;
+         *rule = current->rule;
+      }
+
+      for (int i = 0; i < current->num_edges; i++) {
+         nfa_edge_t* edge = &current->edges[i];
+         if (!edge->is_epsilon) {
+            if (num_edges == s->edges_capacity) {
+               s->edges_capacity = s->edges_capacity == 0 ? 16 : s->edges_capacity * 2;
+               s->edges = xrealloc(s->edges, sizeof(nfa_edge_t) * s->edges_capacity);
+            }
+            s->edges[num_edges++] = *edge;
+         } else if (s->stamps[edge->to->id] != s->stamp) {
+            s->stamps[edge->to->id] = s->stamp;
+            s->stack[stack_size++] = edge->to;
+         }
+      }
+   }
+
+   return canonicalize_edges(s, s->edges, num_edges);
+}
+
+// Points the edges at the nodes their targets were merged into, sorts them by target and merges
+// edges to the same target into one (keeping epsilon edges apart from character edges). Returns
+// the new number of edges (never more than before).
+static int canonicalize_edges(simplifier_t* s, nfa_edge_t* edges, int num_edges) {
+   int num_kept = 0;
+   for (int i = 0; i < num_edges; i++) {
+      if (edge_is_empty(&edges[i])) {
+         continue;  // e.g. from a negated class that excludes everything, never taken
+      }
+      while (s->merged_into[edges[i].to->id] != NULL) {
+         edges[i].to = s->merged_into[edges[i].to->id];
+      }
+      edges[num_kept++] = edges[i];
+   }
+   qsort(edges, num_kept, sizeof(nfa_edge_t), edge_target_comparator);
+
+   int num_merged = 0;
+   for (int i = 0; i < num_kept; i++) {
+      if (num_merged > 0 && edges[num_merged - 1].to == edges[i].to &&
+          edges[num_merged - 1].is_epsilon == edges[i].is_epsilon) {
+         for (int word = 0; word < NFA_EDGE_NUM_WORDS; word++) {
+            edges[num_merged - 1].bytes[word] |= edges[i].bytes[word];
+         }
+      } else {
+         edges[num_merged++] = edges[i];
+      }
+   }
+   return num_merged;
+}
+
+// Merges nodes with the same acceptance and the same (canonical) edges, which accept the same
+// suffixes. Merging can make more nodes equal, so callers repeat until nothing merges.
+// @returns true if any nodes were merged
+static bool merge_equivalent_nodes(simplifier_t* s) {
+   int capacity = 16;
+   while (capacity < s->num_nodes * 2) {
+      capacity *= 2;
+   }
+   nfa_node_t** slots = xmalloc(sizeof(nfa_node_t*) * capacity);
+   memset(slots, 0, sizeof(nfa_node_t*) * capacity);
+   bool merged = false;
+
+   for (int id = 0; id < s->num_nodes; id++) {
+      if (!s->live[id]) {
+         continue;
+      }
+      nfa_node_t* node = s->nodes[id];
+      node->num_edges = canonicalize_edges(s, node->edges, node->num_edges);
+
+      int i = hash_node(node) & (capacity - 1);
+      while (slots[i] != NULL && !nodes_equivalent(slots[i], node)) {
+         i = (i + 1) & (capacity - 1);
+      }
+      if (slots[i] == NULL) {
+         slots[i] = node;
+      } else {
+         s->merged_into[id] = slots[i];
+         s->live[id] = false;
+         merged = true;
+      }
+   }
+
+   free(slots);
+   while (s->merged_into[s->nfa->start->id] != NULL) {
+      s->nfa->start = s->merged_into[s->nfa->start->id];
+   }
+   return merged;
+}
+
+// Rebuilds the node list from the nodes the start can reach, numbering them densely again
+static void drop_unreachable_nodes(simplifier_t* s) {
+   arena_t* arena = s->nfa->__arena;
+   int stack_size = 0;
+
+   s->stamp++;
+   s->stamps[s->nfa->start->id] = s->stamp;
+   s->stack[stack_size++] = s->nfa->start;
+   while (stack_size > 0) {
+      nfa_node_t* node = s->stack[--stack_size];
+      for (int i = 0; i < node->num_edges; i++) {
+         if (s->stamps[node->edges[i].to->id] != s->stamp) {
+            s->stamps[node->edges[i].to->id] = s->stamp;
+            s->stack[stack_size++] = node->edges[i].to;
+         }
+      }
+   }
+
+   list_t* nodes = arena_alloc(arena, sizeof(list_t));
+   list_initialize_in_arena(nodes, arena);
+   int next_id = 0;
+   for (int id = 0; id < s->num_nodes; id++) {
+      if (s->live[id] && s->stamps[id] == s->stamp) {
+         list_push(nodes, s->nodes[id]);
+      }
+   }
+   // Ids are only renumbered once every lookup by old id is done
+   list_node_t* current;
+   list_traverse(nodes, current) { ((nfa_node_t*)current->data)->id = next_id++; }
+
+   s->nfa->__nodes = nodes;
+}
+
+static bool edge_is_empty(nfa_edge_t* edge) {
+   if (edge->is_epsilon) {
+      return false;
+   }
+   for (int word = 0; word < NFA_EDGE_NUM_WORDS; word++) {
+      if (edge->bytes[word] != 0) {
+         return false;
+      }
+   }
+   return true;
+}
+
+static bool nodes_equivalent(nfa_node_t* a, nfa_node_t* b) {
+   if (a->is_accepting != b->is_accepting || (a->is_accepting && a->rule != b->rule) ||
+       a->num_edges != b->num_edges) {
+      return false;
+   }
+   for (int i = 0; i < a->num_edges; i++) {
+      if (a->edges[i].to != b->edges[i].to || a->edges[i].is_epsilon != b->edges[i].is_epsilon ||
+          memcmp(a->edges[i].bytes, b->edges[i].bytes, sizeof a->edges[i].bytes) != 0) {
+         return false;
       }
    }
+   return true;
+}
+
+// FNV-1a over what nodes_equivalent() compares
+static uint64_t hash_node(nfa_node_t* node) {
+   uint64_t hash = 14695981039346656037ULL;
+   hash = (hash ^ (node->is_accepting ? node->rule + 1 : 0)) * 1099511628211ULL;
+   for (int i = 0; i < node->num_edges; i++) {
+      hash = (hash ^ node->edges[i].to->id) * 1099511628211ULL;
+      hash = (hash ^ node->edges[i].is_epsilon) * 1099511628211ULL;
+      for (int word = 0; word < NFA_EDGE_NUM_WORDS; word++) {
+         hash = (hash ^ node->edges[i].bytes[word]) * 1099511628211ULL;
+      }
+   }
+   return hash;
+}
+
+static int edge_target_comparator(const void* data1, const void* data2) {
+   const nfa_edge_t* edge1 = (const nfa_edge_t*)data1;
+   const nfa_edge_t* edge2 = (const nfa_edge_t*)data2;
+   if (edge1->to->id != edge2->to->id) {
+      return edge1->to->id - edge2->to->id;
+   }
+   return edge1->is_epsilon - edge2->is_epsilon;
 }
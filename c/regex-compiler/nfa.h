@@ -1,12 +1,27 @@
 #ifndef NFA_H
 #define NFA_H
 
+#include <stdint.h>
+
+#include "arena.h"
 #include "list.h"
 #include "parse.h"
 
 typedef struct nfa nfa_t;
 typedef struct nfa_node nfa_node_t;
 typedef struct nfa_edge nfa_edge_t;
+typedef struct nfa_stats nfa_stats_t;
+
+#define NFA_EDGE_NUM_WORDS 4  // 256 bits, one per byte value
+
+// True if the edge is taken on the byte
+#define nfa_edge_has_byte(edge, byte) \
+   ((((edge)->bytes[(uint8_t)(byte) >> 6]) >> ((uint8_t)(byte) & 63)) & 1)
+
+typedef enum {
+   NFA_FLAG_NONE = 0,
+   NFA_FLAG_CASE_INSENSITIVE = 1 << 0,
+} NFAFlag;
 
 struct nfa {
       nfa_node_t* start;
@@ -15,47 +30,82 @@ struct nfa {
       list_t* __nodes;
       // Character set for this NFA
       char* __language;
+      // Arena the nfa was built in (nfas have no destructor, they're freed with their arena)
+      arena_t* __arena;
 };
 
 struct nfa_node {
       int id;
       bool is_accepting;
+      int rule;  // which nfa of an nfa_union() an accepting node belongs to (0 otherwise)
       nfa_edge_t* edges;  // (might be better as a linked list)
       int num_edges;
 };
 
 struct nfa_edge {
-      char value;  // null character if is_epsilon is true
       bool is_epsilon;
+      // Bitmap of the bytes the edge is taken on (empty if is_epsilon), so a character class is one
+      // edge however many characters it has
+      uint64_t bytes[NFA_EDGE_NUM_WORDS];
       nfa_node_t* to;
 };
 
+struct nfa_stats {
+      int num_states;
+      int num_edges;  // including epsilon edges
+      int num_epsilon_edges;
+};
+
 /**
- * Creates an nfa from an ast.
+ * Creates an nfa from an ast, allocating it from the arena.
  */
-nfa_t* nfa_from_ast(ast_node_t*);
+nfa_t* nfa_from_ast(arena_t*, ast_node_t*);
+
+/**
+ * Creates an nfa from an ast using a bitwise-or of NFAFlag values.
+ * With NFA_FLAG_CASE_INSENSITIVE, letters in literals and classes get an edge for both cases.
+ */
+nfa_t* nfa_from_ast_with_flags(arena_t*, ast_node_t*, int);
+
+/**
+ * Combines nfas into one that accepts what any of them accepts. Each accepting node remembers the
+ * index of the nfa it came from in `rule`. Takes over the nodes of the nfas, which must have been
+ * built in the same arena.
+ */
+nfa_t* nfa_union(arena_t*, nfa_t**, int);
 
 /**
  * Returns the number of states in the nfa.
  */
 int nfa_num_states(nfa_t*);
 
+/**
+ * Counts the states and edges of the nfa.
+ */
+void nfa_stats(nfa_t*, nfa_stats_t*);
+
+/**
+ * Shrinks the nfa without changing what it accepts (or which rule accepts):
+ * - removes epsilon edges: each node takes over the edges and acceptance of its eclosure (skipped
+ *   when that would multiply the number of edges, as on long chains of optional parts)
+ * - merges nodes with the same acceptance and outgoing edges, and edges with the same target
+ * - drops nodes the start can no longer reach, and renumbers the rest densely
+ * Afterwards several nodes may accept, so `end` is null.
+ */
+void nfa_simplify(nfa_t*);
+
 /**
  * Returns the language of the nfa as a null-terminated string.
  */
 char* nfa_language(nfa_t*);
 
 /**
- * Finds the nfa_node a given nfa_node transtions to on a character.
+ * Finds the nfa_node a given nfa_node transtions to on a character (a bitmap test per edge). After
+ * nfa_simplify() a node can have several, and this returns the first.
  * @returns null if no nfa node with a transition on the character is found
  */
 nfa_node_t* nfa_node_find_transition(nfa_node_t*, char);
 
-/**
- * Frees the nfa.
- */
-void free_nfa(nfa_t*);
-
 /**
  * Logs the nfa to stdout.
  */
@@ -10,8 +10,9 @@
  * <class-bracketed> -> Letter [ - Letter ] <class-bracketed>
  * <quantifier-symbol> -> * | + | ?
  * 
- * Inputs a line of text from stdin
- * Outputs "Error" or the result.
+ * Parsed in one pass with an explicit stack of open groups (see regexp()) instead of recursive
+ * descent, so very large or deeply nested patterns can't overflow the call stack. Invalid patterns
+ * are reported through parse_error_t rather than ending the process.
  * 
 */
 
@@ -19,17 +20,36 @@
 
 #include <ctype.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "utils.h"
 
+#define OPTIMIZE_MAX_DEPTH 1000  // see optimize_ast()
+
 typedef struct state {
       const char* pattern;
       char* current;
+      arena_t* arena;  // every node of the ast is allocated here
+      parse_error_t* error;
 } state_t;
 
+// A '(' that hasn't been closed yet (or the whole pattern, at the bottom of the stack)
+typedef struct group {
+      ast_node_t* option;  // alternatives before the current one, null until the first '|'
+      ast_node_t* concat;  // nodes of the current alternative, null while it's empty
+      bool quantified;     // whether the last node of the current alternative has a quantifier
+      int position;        // of the '('
+} group_t;
+
+// A run of nodes matched one after another: the children of a concat, or a single other node
+typedef struct sequence {
+      ast_node_t** items;
+      int length;
+} sequence_t;
+
 typedef enum ChracterConfigColumn {
    VALID_CHARACTER = 0,
    SPECIAL_CHARACTER = 1,
@@ -39,28 +59,60 @@ typedef enum ChracterConfigColumn {
 
 static char peek(state_t*);
 static void match(state_t*, char);
+static char next(state_t*);
+static ast_node_t* parse_fail(state_t*, int, const char*);
+static int position(state_t*);
 
-// Recursive descent functions
+// Parsing functions
 static ast_node_t* regexp(state_t*);
-static ast_node_t* concat(state_t*);
-static ast_node_t* quantifier(state_t*);
+static void group_begin(group_t*, int);
+static void group_add(state_t*, group_t*, ast_node_t*);
+static bool group_end_alternative(state_t*, group_t*);
+static ast_node_t* group_end(state_t*, group_t*);
+static ast_node_t* concat_result(ast_node_t*);
+static void quantifier(state_t*, group_t*);
 static ast_node_t* factor(state_t*);
 static ast_node_t* class_bracketed(state_t*);
 
 // Constructors for AST nodes
-static ast_node_t* ast_new_option_node(ast_node_t*, ast_node_t*);         // 'a|b'
-static ast_node_t* ast_new_concat_node(ast_node_t*, ast_node_t*);         // 'ab'
-static ast_node_t* ast_new_repetition_node(RepetitionKind, ast_node_t*);  // 'a*|a+|a?'
-static ast_node_t* ast_new_dot_node();                                    // '.'
-static ast_node_t* ast_new_literal_node(char);                            // 'a'
-static ast_node_t* ast_new_character_class_node(CharacterClassKind);      // '\d|\D|\w|\W|\s|\S'
-static ast_node_t* ast_new_class_bracketed_node();                        // '[a-z]'
-
-static class_set_item_t* class_bracketed_node_add_literal(ast_node_class_bracketed_t*, char);
-static class_set_item_t* class_bracketed_node_add_range(ast_node_class_bracketed_t*, char, char);
-static class_set_item_t* class_bracketed_node_add_character_class(ast_node_class_bracketed_t*,
+static ast_node_t* ast_new_node(arena_t*, NodeKind);
+static ast_node_t* ast_new_option_node(arena_t*);                                   // 'a|b'
+static ast_node_t* ast_new_concat_node(arena_t*);                                   // 'ab'
+static ast_node_t* ast_new_repetition_node(arena_t*, RepetitionKind, ast_node_t*);  // 'a*|a+|a?'
+static ast_node_t* ast_new_dot_node(arena_t*);                                      // '.'
+static ast_node_t* ast_new_literal_node(arena_t*, char);                            // 'a'
+static ast_node_t* ast_new_character_class_node(arena_t*, CharacterClassKind);  // '\d|\D|\w|\W|\s|\S'
+static ast_node_t* ast_new_class_bracketed_node(arena_t*);                       // '[a-z]'
+static ast_node_t* ast_new_string_node(arena_t*, ast_node_t**, int);             // 'abc'
+
+static void ast_node_add_child(arena_t*, ast_node_t*, ast_node_t*);
+
+static class_set_item_t* class_bracketed_node_add_literal(arena_t*, ast_node_class_bracketed_t*,
+                                                          char);
+static class_set_item_t* class_bracketed_node_add_range(arena_t*, ast_node_class_bracketed_t*, char,
+                                                        char);
+static class_set_item_t* class_bracketed_node_add_character_class(arena_t*,
+                                                                  ast_node_class_bracketed_t*,
                                                                   CharacterClassKind);
-static void class_bracketed_maybe_resize_items(ast_node_class_bracketed_t*);
+static void class_bracketed_maybe_resize_items(arena_t*, ast_node_class_bracketed_t*);
+
+// Optimizer
+static ast_node_t* optimize_node(arena_t*, ast_node_t*);
+static ast_node_t* optimize_repetition(arena_t*, ast_node_t*);
+static ast_node_t* optimize_concat(arena_t*, ast_node_t*);
+static ast_node_t* optimize_option(arena_t*, ast_node_t*);
+static ast_node_t* factor_alternatives(arena_t*, sequence_t*, int);
+static int group_alternatives(arena_t*, sequence_t*, int, bool, ast_node_t**);
+static ast_node_t* merge_single_characters(arena_t*, ast_node_t**, int);
+static ast_node_t* merge_literals(arena_t*, ast_node_t*);
+static sequence_t node_sequence(arena_t*, ast_node_t*);
+static ast_node_t* sequence_node(arena_t*, ast_node_t**, int);
+static ast_node_t* sequence_item(sequence_t, int, bool);
+static bool is_single_character(ast_node_t*);
+static bool ast_equal(ast_node_t*, ast_node_t*);
+static bool ast_children_equal(ast_node_t**, int, ast_node_t**, int);
+static uint64_t ast_hash(ast_node_t*);
+static bool ast_deeper_than(ast_node_t*, int);
 
 // Character helpers
 static int is_special_character(char);
@@ -68,7 +120,6 @@ static int is_quantifier_symbol(char);
 static int is_character_class(char);
 static CharacterClassKind get_character_class_kind(char);
 static int get_character_config(char, CCCol_t);
-static int in_factor_first_set(char);
 
 /**
  * ascii table from 32 to 126 
@@ -212,62 +263,30 @@ const int CHARACTER_CONFIG[][4] = {
  * Parser
 */
 
-ast_node_t* parse_regex(char* pattern) {
+ast_node_t* parse_regex(arena_t* arena, char* pattern) {
+   parse_error_t error;
+   return parse_regex_with_error(arena, pattern, &error);
+}
+
+ast_node_t* parse_regex_with_error(arena_t* arena, char* pattern, parse_error_t* error) {
    state_t state = {
        .pattern = pattern,
        .current = pattern,
+       .arena = arena,
+       .error = error,
    };
-   ast_node_t* result = regexp(&state);
+   error->message = NULL;
+   error->position = 0;
 
-   if (peek(&state) != '\0') {
-      error("Expected end of input ('\\0')");
-   }
-
-   return result;
-}
-
-void free_ast(ast_node_t* root) {
-   if (root == NULL) {
-      return;
-   }
-   switch (root->kind) {
-      case NODE_KIND_OPTION:
-         free_ast(root->option->left);
-         free_ast(root->option->right);
-         free(root->option);
-         break;
-      case NODE_KIND_CONCAT:
-         free_ast(root->concat->left);
-         free_ast(root->concat->right);
-         free(root->concat);
-         break;
-      case NODE_KIND_REPITITION:
-         free_ast(root->repitition->child);
-         free(root->repitition);
-         break;
-      case NODE_KIND_LITERAL:
-         free(root->literal);
-         break;
-      case NODE_KIND_CHARACTER_CLASS:
-         free(root->character_class);
-         break;
-      case NODE_KIND_CLASS_BRACKETED:
-         free(root->class_bracketed->items);
-         free(root->class_bracketed);
-         break;
-      default:
-         break;
-   }
-   free(root);
+   return regexp(&state);
 }
 
 static char peek(state_t* state) { return *state->current; }
 
 static void match(state_t* state, char expectedToken) {
+   // Callers peek first, so this only ever consumes the expected token
    if (peek(state) == expectedToken) {
       state->current++;
-   } else {
-      error("Unexpected token");
    }
 }
 
@@ -277,79 +296,206 @@ static char next(state_t* state) {
    return c;
 }
 
-static ast_node_t* regexp(state_t* state) {
-   ast_node_t* temp = concat(state);
-   while (peek(state) == '|') {
-      match(state, '|');
-      temp = ast_new_option_node(temp, concat(state));
+// Records the first error and the position it refers to, and returns null for callers to pass on
+static ast_node_t* parse_fail(state_t* state, int position, const char* message) {
+   if (state->error->message == NULL) {
+      state->error->message = message;
+      state->error->position = position;
    }
-   return temp;
+   return NULL;
 }
 
-static ast_node_t* concat(state_t* state) {
-   ast_node_t* temp = quantifier(state);
-   while (in_factor_first_set(peek(state)) == true) {
-      // We don't match here since current token is part of first set of `factor`, so if we matched the conditions in factor will fail
-      temp = ast_new_concat_node(temp, quantifier(state));
-   }
-   return temp;
-}
+static int position(state_t* state) { return state->current - state->pattern; }
+
+// Parses the whole pattern in a single left-to-right pass. Open groups live on an explicit stack
+// rather than the call stack, so the nesting depth is only limited by memory.
+static ast_node_t* regexp(state_t* state) {
+   int groups_capacity = 16;
+   group_t* groups = xmalloc(sizeof(group_t) * groups_capacity);
+   int depth = 0;
+   group_begin(&groups[0], 0);
 
-static ast_node_t* quantifier(state_t* state) {
-   ast_node_t* temp = factor(state);
-   if (is_quantifier_symbol(peek(state)) == true) {
-      char symbol = next(state);
-      RepetitionKind rep_kind = -1;
-      switch (symbol) {
-         case '*':
-            rep_kind = REPITITION_KIND_ZERO_OR_MORE;
+   ast_node_t* result = NULL;
+   while (state->error->message == NULL) {
+      char c = peek(state);
+      if (c == '\0') {
+         if (depth > 0) {
+            parse_fail(state, groups[depth].position, "Missing ')'");
+         } else {
+            result = group_end(state, &groups[0]);
+         }
+         break;
+      }
+
+      if (c == '(') {
+         if (depth + 1 == groups_capacity) {
+            groups_capacity *= 2;
+            groups = xrealloc(groups, sizeof(group_t) * groups_capacity);
+         }
+         group_begin(&groups[++depth], position(state));
+         match(state, '(');
+      } else if (c == ')') {
+         if (depth == 0) {
+            parse_fail(state, position(state), "Unmatched ')'");
             break;
-         case '+':
-            rep_kind = REPITITION_KIND_ONE_OR_MORE;
+         }
+         ast_node_t* group = group_end(state, &groups[depth]);
+         if (group == NULL) {
             break;
-         case '?':
-            rep_kind = REPITITION_KIND_ZERO_OR_ONE;
+         }
+         match(state, ')');
+         group->start = groups[depth].position;
+         group->end = position(state);
+         group_add(state, &groups[--depth], group);
+      } else if (c == '|') {
+         if (!group_end_alternative(state, &groups[depth])) {
             break;
-         default:
-            error("Invalid quantifier symbol");
+         }
+         match(state, '|');
+      } else if (is_quantifier_symbol(c) == true) {
+         quantifier(state, &groups[depth]);
+      } else {
+         int start = position(state);
+         ast_node_t* node = factor(state);
+         if (node != NULL) {
+            node->start = start;
+            node->end = position(state);
+            group_add(state, &groups[depth], node);
+         }
       }
-      temp = ast_new_repetition_node(rep_kind, temp);
    }
-   return temp;
+
+   free(groups);
+   return result;
+}
+
+static void group_begin(group_t* group, int position) {
+   group->option = NULL;
+   group->concat = NULL;
+   group->quantified = false;
+   group->position = position;
+}
+
+// Appends a node to the group's current alternative
+static void group_add(state_t* state, group_t* group, ast_node_t* node) {
+   if (group->concat == NULL) {
+      group->concat = ast_new_concat_node(state->arena);
+      group->concat->start = node->start;
+   }
+   ast_node_add_child(state->arena, group->concat, node);
+   group->concat->end = node->end;
+   group->quantified = false;
+}
+
+// Adds the current alternative (which can't be empty) to the group's option
+static bool group_end_alternative(state_t* state, group_t* group) {
+   if (group->concat == NULL) {
+      parse_fail(state, position(state), "Empty alternative");
+      return false;
+   }
+   if (group->option == NULL) {
+      group->option = ast_new_option_node(state->arena);
+   }
+   ast_node_t* alternative = concat_result(group->concat);
+   ast_node_add_child(state->arena, group->option, alternative);
+   if (group->option->option->num_children == 1) {
+      group->option->start = alternative->start;
+   }
+   group->option->end = alternative->end;
+   group->concat = NULL;
+   return true;
+}
+
+// Returns the node for the whole group, or null if it ends with an empty alternative
+static ast_node_t* group_end(state_t* state, group_t* group) {
+   if (group->option == NULL) {
+      if (group->concat == NULL) {
+         return parse_fail(state, position(state), "Empty alternative");
+      }
+      return concat_result(group->concat);
+   }
+   if (!group_end_alternative(state, group)) {
+      return NULL;
+   }
+   return group->option;
+}
+
+// A concat of one node is just that node
+static ast_node_t* concat_result(ast_node_t* concat) {
+   if (concat->concat->num_children == 1) {
+      return concat->concat->children[0];
+   }
+   return concat;
 }
 
+// Applies a quantifier to the last node of the group's current alternative
+static void quantifier(state_t* state, group_t* group) {
+   if (group->concat == NULL || group->quantified) {
+      parse_fail(state, position(state), "Nothing to repeat");
+      return;
+   }
+
+   char symbol = next(state);
+   RepetitionKind rep_kind = REPITITION_KIND_ZERO_OR_ONE;
+   switch (symbol) {
+      case '*':
+         rep_kind = REPITITION_KIND_ZERO_OR_MORE;
+         break;
+      case '+':
+         rep_kind = REPITITION_KIND_ONE_OR_MORE;
+         break;
+      case '?':
+         rep_kind = REPITITION_KIND_ZERO_OR_ONE;
+         break;
+   }
+
+   ast_node_concat_t* concat = group->concat->concat;
+   ast_node_t** last = &concat->children[concat->num_children - 1];
+   ast_node_t* repetition = ast_new_repetition_node(state->arena, rep_kind, *last);
+   repetition->start = (*last)->start;
+   repetition->end = position(state);
+   *last = repetition;
+   group->concat->end = repetition->end;
+   group->quantified = true;
+}
+
+// Parses a single character, escape, '.' or bracketed class
 static ast_node_t* factor(state_t* state) {
    ast_node_t* temp = NULL;
-   if (peek(state) == '(') {
-      match(state, '(');
-      temp = regexp(state);
-      match(state, ')');
-   } else if (peek(state) == '\\') {
+   if (peek(state) == '\\') {
       match(state, '\\');
+      if (peek(state) == '\0') {
+         return parse_fail(state, position(state) - 1, "Trailing '\\'");
+      }
       char value = next(state);
       if (is_character_class(value) == true) {
-         temp = ast_new_character_class_node(get_character_class_kind(value));
+         temp = ast_new_character_class_node(state->arena, get_character_class_kind(value));
       } else {
-         temp = ast_new_literal_node(value);
+         temp = ast_new_literal_node(state->arena, value);
       }
-   } else if (is_special_character(peek(state)) == false) {
+   } else if (is_valid_character(peek(state)) == true &&
+              is_special_character(peek(state)) == false) {
       char value = next(state);
-      temp = ast_new_literal_node(value);
+      temp = ast_new_literal_node(state->arena, value);
    } else if (peek(state) == '.') {
       match(state, '.');
-      temp = ast_new_dot_node();
+      temp = ast_new_dot_node(state->arena);
    } else if (peek(state) == '[') {
+      int start = position(state);
       match(state, '[');
       temp = class_bracketed(state);
+      if (temp != NULL && peek(state) != ']') {
+         return parse_fail(state, start, "Missing ']'");
+      }
       match(state, ']');
    } else {
-      error("[factor] Unexpected token");
+      return parse_fail(state, position(state), "Unexpected character");
    }
    return temp;
 }
 
 static ast_node_t* class_bracketed(state_t* state) {
-   ast_node_t* temp = ast_new_class_bracketed_node();
+   ast_node_t* temp = ast_new_class_bracketed_node(state->arena);
    if (peek(state) == '^') {
       match(state, '^');
       temp->class_bracketed->negated = true;
@@ -358,12 +504,15 @@ static ast_node_t* class_bracketed(state_t* state) {
    while (is_valid_character(peek(state)) == true && peek(state) != ']') {
       if (peek(state) == '\\') {
          match(state, '\\');
+         if (peek(state) == '\0') {
+            return parse_fail(state, position(state) - 1, "Trailing '\\'");
+         }
          char value = next(state);
          if (is_character_class(value) == true) {
-            class_bracketed_node_add_character_class(temp->class_bracketed,
+            class_bracketed_node_add_character_class(state->arena, temp->class_bracketed,
                                                      get_character_class_kind(value));
          } else {
-            class_bracketed_node_add_literal(temp->class_bracketed, value);
+            class_bracketed_node_add_literal(state->arena, temp->class_bracketed, value);
          }
          continue;
       }
@@ -372,92 +521,134 @@ static ast_node_t* class_bracketed(state_t* state) {
       if (peek(state) == '-') {
          match(state, '-');
          if (is_valid_character(peek(state)) == false) {
-            error("Invalid character in range");
+            return parse_fail(state, position(state), "Invalid character in range");
          }
          char end = next(state);
          if (start > end) {
             continue;
          }
-         class_bracketed_node_add_range(temp->class_bracketed, start, end);
+         class_bracketed_node_add_range(state->arena, temp->class_bracketed, start, end);
       } else {
-         class_bracketed_node_add_literal(temp->class_bracketed, start);
+         class_bracketed_node_add_literal(state->arena, temp->class_bracketed, start);
       }
    }
 
    return temp;
 }
 
-static ast_node_t* ast_new_option_node(ast_node_t* left, ast_node_t* right) {
-   ast_node_t* node = xmalloc(sizeof(ast_node_t));
-   node->kind = NODE_KIND_OPTION;
-   node->option = xmalloc(sizeof(ast_node_option_t));
-   node->option->left = left;
-   node->option->right = right;
+static ast_node_t* ast_new_node(arena_t* arena, NodeKind kind) {
+   ast_node_t* node = arena_alloc(arena, sizeof(ast_node_t));
+   node->kind = kind;
+   node->start = -1;
+   node->end = -1;
+   return node;
+}
+
+static ast_node_t* ast_new_option_node(arena_t* arena) {
+   ast_node_t* node = ast_new_node(arena, NODE_KIND_OPTION);
+   node->option = arena_alloc(arena, sizeof(ast_node_option_t));
+   node->option->num_children = 0;
+   node->option->children_capacity = 0;
+   node->option->children = NULL;
    return node;
 }
 
-static ast_node_t* ast_new_concat_node(ast_node_t* left, ast_node_t* right) {
-   ast_node_t* node = xmalloc(sizeof(ast_node_t));
-   node->kind = NODE_KIND_CONCAT;
-   node->concat = xmalloc(sizeof(ast_node_concat_t));
-   node->concat->left = left;
-   node->concat->right = right;
+static ast_node_t* ast_new_concat_node(arena_t* arena) {
+   ast_node_t* node = ast_new_node(arena, NODE_KIND_CONCAT);
+   node->concat = arena_alloc(arena, sizeof(ast_node_concat_t));
+   node->concat->num_children = 0;
+   node->concat->children_capacity = 0;
+   node->concat->children = NULL;
    return node;
 }
 
-static ast_node_t* ast_new_repetition_node(RepetitionKind rep_kind, ast_node_t* child) {
-   ast_node_t* node = xmalloc(sizeof(ast_node_t));
-   node->kind = NODE_KIND_REPITITION;
-   node->repitition = xmalloc(sizeof(ast_node_repitition_t));
+static ast_node_t* ast_new_repetition_node(arena_t* arena, RepetitionKind rep_kind, ast_node_t* child) {
+   ast_node_t* node = ast_new_node(arena, NODE_KIND_REPITITION);
+   node->repitition = arena_alloc(arena, sizeof(ast_node_repitition_t));
    node->repitition->kind = rep_kind;
    node->repitition->child = child;
    return node;
 }
 
-static ast_node_t* ast_new_dot_node() {
-   ast_node_t* node = xmalloc(sizeof(ast_node_t));
-   node->kind = NODE_KIND_DOT;
+static ast_node_t* ast_new_dot_node(arena_t* arena) {
+   ast_node_t* node = ast_new_node(arena, NODE_KIND_DOT);
    return node;
 }
 
-static ast_node_t* ast_new_literal_node(char value) {
-   ast_node_t* node = xmalloc(sizeof(ast_node_t));
-   node->kind = NODE_KIND_LITERAL;
-   node->literal = xmalloc(sizeof(ast_node_literal_t));
+static ast_node_t* ast_new_literal_node(arena_t* arena, char value) {
+   ast_node_t* node = ast_new_node(arena, NODE_KIND_LITERAL);
+   node->literal = arena_alloc(arena, sizeof(ast_node_literal_t));
    node->literal->value = value;
    return node;
 }
 
-static ast_node_t* ast_new_character_class_node(CharacterClassKind kind) {
-   ast_node_t* node = xmalloc(sizeof(ast_node_t));
-   node->kind = NODE_KIND_CHARACTER_CLASS;
-   node->character_class = xmalloc(sizeof(ast_character_class_t));
+static ast_node_t* ast_new_character_class_node(arena_t* arena, CharacterClassKind kind) {
+   ast_node_t* node = ast_new_node(arena, NODE_KIND_CHARACTER_CLASS);
+   node->character_class = arena_alloc(arena, sizeof(ast_character_class_t));
    node->character_class->kind = kind;
    return node;
 }
 
-static ast_node_t* ast_new_class_bracketed_node() {
-   ast_node_t* node = xmalloc(sizeof(ast_node_t));
-   node->kind = NODE_KIND_CLASS_BRACKETED;
-   node->class_bracketed = xmalloc(sizeof(ast_node_class_bracketed_t));
+static ast_node_t* ast_new_class_bracketed_node(arena_t* arena) {
+   ast_node_t* node = ast_new_node(arena, NODE_KIND_CLASS_BRACKETED);
+   node->class_bracketed = arena_alloc(arena, sizeof(ast_node_class_bracketed_t));
    node->class_bracketed->negated = false;
    node->class_bracketed->num_items = 0;
+   node->class_bracketed->items_capacity = 0;
    node->class_bracketed->items = NULL;
    return node;
 }
 
-static class_set_item_t* class_bracketed_node_add_literal(ast_node_class_bracketed_t* node,
+static ast_node_t* ast_new_string_node(arena_t* arena, ast_node_t** literals, int length) {
+   ast_node_t* node = ast_new_node(arena, NODE_KIND_STRING);
+   node->string = arena_alloc(arena, sizeof(ast_node_string_t));
+   node->string->length = length;
+   node->string->value = arena_alloc(arena, length + 1);
+   for (int i = 0; i < length; i++) {
+      node->string->value[i] = literals[i]->literal->value;
+   }
+   node->string->value[length] = '\0';
+   return node;
+}
+
+// Appends a child to an option or concat node
+static void ast_node_add_child(arena_t* arena, ast_node_t* node, ast_node_t* child) {
+   ast_node_t*** children;
+   int* num_children;
+   int* children_capacity;
+   if (node->kind == NODE_KIND_OPTION) {
+      children = &node->option->children;
+      num_children = &node->option->num_children;
+      children_capacity = &node->option->children_capacity;
+   } else {
+      children = &node->concat->children;
+      num_children = &node->concat->num_children;
+      children_capacity = &node->concat->children_capacity;
+   }
+
+   if (*num_children == *children_capacity) {
+      int old_capacity = *children_capacity;
+      *children_capacity = old_capacity == 0 ? 2 : old_capacity * 2;
+      *children = arena_grow(arena, *children, old_capacity * sizeof(ast_node_t*),
+                             *children_capacity * sizeof(ast_node_t*));
+   }
+   (*children)[(*num_children)++] = child;
+}
+
+static class_set_item_t* class_bracketed_node_add_literal(arena_t* arena,
+                                                          ast_node_class_bracketed_t* node,
                                                           char value) {
-   class_bracketed_maybe_resize_items(node);
+   class_bracketed_maybe_resize_items(arena, node);
    class_set_item_t* item = &node->items[node->num_items++];
    item->kind = CLASS_SET_ITEM_KIND_LITERAL;
    item->literal = value;
    return item;
 }
 
-static class_set_item_t* class_bracketed_node_add_range(ast_node_class_bracketed_t* node,
+static class_set_item_t* class_bracketed_node_add_range(arena_t* arena,
+                                                        ast_node_class_bracketed_t* node,
                                                         char start, char end) {
-   class_bracketed_maybe_resize_items(node);
+   class_bracketed_maybe_resize_items(arena, node);
    class_set_item_t* item = &node->items[node->num_items++];
    item->kind = CLASS_SET_ITEM_KIND_RANGE;
    item->range.start = start;
@@ -465,22 +656,536 @@ static class_set_item_t* class_bracketed_node_add_range(ast_node_class_bracketed
    return item;
 }
 
-static class_set_item_t* class_bracketed_node_add_character_class(ast_node_class_bracketed_t* node,
+static class_set_item_t* class_bracketed_node_add_character_class(arena_t* arena,
+                                                                  ast_node_class_bracketed_t* node,
                                                                   CharacterClassKind kind) {
-   class_bracketed_maybe_resize_items(node);
+   class_bracketed_maybe_resize_items(arena, node);
    class_set_item_t* item = &node->items[node->num_items++];
    item->kind = CLASS_SET_ITEM_KIND_CHARACTER_CLASS;
    item->character_class.kind = kind;
    return item;
 }
 
-static void class_bracketed_maybe_resize_items(ast_node_class_bracketed_t* node) {
+static void class_bracketed_maybe_resize_items(arena_t* arena, ast_node_class_bracketed_t* node) {
    if (node->num_items == node->items_capacity) {
-      node->items_capacity = node->items_capacity == 0 ? 1 : node->items_capacity * 2;
-      node->items = xrealloc(node->items, node->items_capacity * sizeof(class_set_item_t));
+      int old_capacity = node->items_capacity;
+      node->items_capacity = old_capacity == 0 ? 1 : old_capacity * 2;
+      node->items = arena_grow(arena, node->items, old_capacity * sizeof(class_set_item_t),
+                               node->items_capacity * sizeof(class_set_item_t));
+   }
+}
+
+int ast_node_children(ast_node_t* node, ast_node_t*** children) {
+   switch (node->kind) {
+      case NODE_KIND_OPTION:
+         *children = node->option->children;
+         return node->option->num_children;
+      case NODE_KIND_CONCAT:
+         *children = node->concat->children;
+         return node->concat->num_children;
+      case NODE_KIND_REPITITION:
+         *children = &node->repitition->child;
+         return 1;
+      default:
+         *children = NULL;
+         return 0;
    }
 }
 
+int ast_num_nodes(ast_node_t* root) {
+   int capacity = 64;
+   ast_node_t** stack = xmalloc(sizeof(ast_node_t*) * capacity);
+   int size = 0;
+   int num_nodes = 0;
+
+   stack[size++] = root;
+   while (size > 0) {
+      ast_node_t* node = stack[--size];
+      num_nodes++;
+
+      ast_node_t** children;
+      int num_children = ast_node_children(node, &children);
+      if (size + num_children > capacity) {
+         capacity = (size + num_children) * 2;
+         stack = xrealloc(stack, sizeof(ast_node_t*) * capacity);
+      }
+      for (int i = 0; i < num_children; i++) {
+         stack[size++] = children[i];
+      }
+   }
+
+   free(stack);
+   return num_nodes;
+}
+
+/**
+ * Optimizer
+*/
+
+ast_node_t* optimize_ast(arena_t* arena, ast_node_t* root) {
+   // The rewrites recurse on the tree, so pathologically nested patterns are left as they are
+   if (ast_deeper_than(root, OPTIMIZE_MAX_DEPTH)) {
+      return root;
+   }
+   // Literals are merged into strings last, since factoring compares alternatives node by node
+   return merge_literals(arena, optimize_node(arena, root));
+}
+
+static ast_node_t* optimize_node(arena_t* arena, ast_node_t* node) {
+   switch (node->kind) {
+      case NODE_KIND_OPTION:
+         return optimize_option(arena, node);
+      case NODE_KIND_CONCAT:
+         return optimize_concat(arena, node);
+      case NODE_KIND_REPITITION:
+         return optimize_repetition(arena, node);
+      default:
+         return node;
+   }
+}
+
+static ast_node_t* optimize_repetition(arena_t* arena, ast_node_t* node) {
+   ast_node_t* child = optimize_node(arena, node->repitition->child);
+   RepetitionKind kind = node->repitition->kind;
+
+   // A repetition of a repetition of the same kind is just one of them, and of different kinds
+   // matches any number: (a+)+ = a+, (a?)+ = (a+)? = (a*)? = a*
+   if (child->kind == NODE_KIND_REPITITION) {
+      if (child->repitition->kind != kind) {
+         kind = REPITITION_KIND_ZERO_OR_MORE;
+      }
+      child = child->repitition->child;
+   }
+   return ast_new_repetition_node(arena, kind, child);
+}
+
+static ast_node_t* optimize_concat(arena_t* arena, ast_node_t* node) {
+   ast_node_t* concat = ast_new_concat_node(arena);
+   for (int i = 0; i < node->concat->num_children; i++) {
+      // 'a(bc)d' is 'abcd'
+      sequence_t child = node_sequence(arena, optimize_node(arena, node->concat->children[i]));
+      for (int j = 0; j < child.length; j++) {
+         ast_node_add_child(arena, concat, child.items[j]);
+      }
+   }
+   return concat;
+}
+
+static ast_node_t* optimize_option(arena_t* arena, ast_node_t* node) {
+   ast_node_t** children = arena_alloc(arena, sizeof(ast_node_t*) * node->option->num_children);
+   int num_alternatives = 0;
+   for (int i = 0; i < node->option->num_children; i++) {
+      children[i] = optimize_node(arena, node->option->children[i]);
+      num_alternatives +=
+          children[i]->kind == NODE_KIND_OPTION ? children[i]->option->num_children : 1;
+   }
+
+   // '(a|b)|c' is 'a|b|c'
+   sequence_t* alternatives = arena_alloc(arena, sizeof(sequence_t) * num_alternatives);
+   num_alternatives = 0;
+   for (int i = 0; i < node->option->num_children; i++) {
+      if (children[i]->kind == NODE_KIND_OPTION) {
+         ast_node_option_t* option = children[i]->option;
+         for (int j = 0; j < option->num_children; j++) {
+            alternatives[num_alternatives++] = node_sequence(arena, option->children[j]);
+         }
+      } else {
+         alternatives[num_alternatives++] = node_sequence(arena, children[i]);
+      }
+   }
+
+   return factor_alternatives(arena, alternatives, num_alternatives);
+}
+
+// Factors common prefixes, then common suffixes, out of the alternatives and merges the ones left
+// matching a single character into a class. Alternatives may be empty (what's left of 'ab' after
+// factoring 'ab' out of 'ab|abc'), which makes the result optional.
+// @returns null if every alternative is empty
+static ast_node_t* factor_alternatives(arena_t* arena, sequence_t* alternatives,
+                                       int num_alternatives) {
+   bool has_empty = false;
+   sequence_t* non_empty = arena_alloc(arena, sizeof(sequence_t) * num_alternatives);
+   int num_non_empty = 0;
+   for (int i = 0; i < num_alternatives; i++) {
+      if (alternatives[i].length == 0) {
+         has_empty = true;
+      } else {
+         non_empty[num_non_empty++] = alternatives[i];
+      }
+   }
+   if (num_non_empty == 0) {
+      return NULL;
+   }
+
+   ast_node_t** nodes = arena_alloc(arena, sizeof(ast_node_t*) * num_non_empty);
+   int num_nodes = group_alternatives(arena, non_empty, num_non_empty, false, nodes);
+   for (int i = 0; i < num_nodes; i++) {
+      non_empty[i] = node_sequence(arena, nodes[i]);
+   }
+   num_nodes = group_alternatives(arena, non_empty, num_nodes, true, nodes);
+
+   ast_node_t* result = merge_single_characters(arena, nodes, num_nodes);
+   if (!has_empty) {
+      return result;
+   }
+   if (result->kind != NODE_KIND_REPITITION) {
+      return ast_new_repetition_node(arena, REPITITION_KIND_ZERO_OR_ONE, result);
+   }
+   if (result->repitition->kind == REPITITION_KIND_ONE_OR_MORE) {
+      return ast_new_repetition_node(arena, REPITITION_KIND_ZERO_OR_MORE,
+                                     result->repitition->child);
+   }
+   return result;  // already matches ''
+}
+
+// Groups the alternatives by their first (or, from the end, last) node and factors the longest run
+// each group shares out of it: 'ab|ac|d' -> 'a(b|c)|d'. Writes one node per group to `grouped`
+// (which has room for every alternative) and returns how many there are.
+static int group_alternatives(arena_t* arena, sequence_t* alternatives, int num_alternatives,
+                              bool from_end, ast_node_t** grouped) {
+   // Number the groups in order of first appearance, finding them with a hash table so that tens of
+   // thousands of alternatives (e.g. a blocklist) don't take quadratic time
+   int* group_of = arena_alloc(arena, sizeof(int) * num_alternatives);
+   int* group_first = arena_alloc(arena, sizeof(int) * num_alternatives);  // first member
+   int* group_size = arena_alloc(arena, sizeof(int) * num_alternatives);
+   int capacity = 16;
+   while (capacity < num_alternatives * 2) {
+      capacity *= 2;
+   }
+   int* slots = arena_alloc(arena, sizeof(int) * capacity);
+   memset(slots, -1, sizeof(int) * capacity);
+   int num_groups = 0;
+
+   for (int i = 0; i < num_alternatives; i++) {
+      ast_node_t* item = sequence_item(alternatives[i], 0, from_end);
+      int slot = ast_hash(item) & (capacity - 1);
+      while (slots[slot] != -1 &&
+             !ast_equal(sequence_item(alternatives[group_first[slots[slot]]], 0, from_end), item)) {
+         slot = (slot + 1) & (capacity - 1);
+      }
+      if (slots[slot] == -1) {
+         slots[slot] = num_groups;
+         group_first[num_groups] = i;
+         group_size[num_groups] = 0;
+         num_groups++;
+      }
+      group_of[i] = slots[slot];
+      group_size[group_of[i]]++;
+   }
+
+   // Lay the members of each group out together, keeping their order
+   int* group_start = arena_alloc(arena, sizeof(int) * num_groups);
+   int* group_filled = arena_alloc(arena, sizeof(int) * num_groups);
+   for (int g = 0, start = 0; g < num_groups; start += group_size[g], g++) {
+      group_start[g] = start;
+      group_filled[g] = 0;
+   }
+   sequence_t* by_group = arena_alloc(arena, sizeof(sequence_t) * num_alternatives);
+   for (int i = 0; i < num_alternatives; i++) {
+      int g = group_of[i];
+      by_group[group_start[g] + group_filled[g]++] = alternatives[i];
+   }
+
+   int num_grouped = 0;
+   for (int g = 0; g < num_groups; g++) {
+      sequence_t* members = &by_group[group_start[g]];
+      int num_members = group_size[g];
+      if (num_members == 1) {
+         grouped[num_grouped++] = sequence_node(arena, members[0].items, members[0].length);
+         continue;
+      }
+
+      int shared_length = 1;
+      bool all_share = true;
+      while (all_share && shared_length < members[0].length) {
+         for (int m = 1; m < num_members && all_share; m++) {
+            all_share = shared_length < members[m].length &&
+                        ast_equal(sequence_item(members[0], shared_length, from_end),
+                                  sequence_item(members[m], shared_length, from_end));
+         }
+         shared_length += all_share ? 1 : 0;
+      }
+
+      ast_node_t** shared = from_end ? members[0].items + members[0].length - shared_length
+                                     : members[0].items;
+      for (int m = 0; m < num_members; m++) {
+         members[m].items += from_end ? 0 : shared_length;
+         members[m].length -= shared_length;
+      }
+      ast_node_t* rest_node = factor_alternatives(arena, members, num_members);
+      sequence_t rest = {NULL, 0};
+      if (rest_node != NULL) {
+         rest = node_sequence(arena, rest_node);
+      }
+
+      int length = shared_length + rest.length;
+      ast_node_t** items = arena_alloc(arena, sizeof(ast_node_t*) * length);
+      memcpy(items + (from_end ? 0 : shared_length), rest.items, sizeof(ast_node_t*) * rest.length);
+      memcpy(items + (from_end ? rest.length : 0), shared, sizeof(ast_node_t*) * shared_length);
+      grouped[num_grouped++] = sequence_node(arena, items, length);
+   }
+
+   return num_grouped;
+}
+
+// Merges the alternatives that match a single character into one class ('a|[bc]|\d' -> '[abc\d]')
+// and returns the alternation of the nodes left (or the node, if only one is left)
+static ast_node_t* merge_single_characters(arena_t* arena, ast_node_t** nodes, int num_nodes) {
+   int num_single = 0;
+   for (int i = 0; i < num_nodes; i++) {
+      num_single += is_single_character(nodes[i]) ? 1 : 0;
+   }
+   if (num_nodes == 1) {
+      return nodes[0];
+   }
+
+   ast_node_t* class = NULL;
+   ast_node_t* option = ast_new_option_node(arena);
+   for (int i = 0; i < num_nodes; i++) {
+      if (num_single < 2 || !is_single_character(nodes[i])) {
+         ast_node_add_child(arena, option, nodes[i]);
+         continue;
+      }
+      if (class == NULL) {
+         class = ast_new_class_bracketed_node(arena);
+         ast_node_add_child(arena, option, class);
+      }
+
+      switch (nodes[i]->kind) {
+         case NODE_KIND_LITERAL:
+            class_bracketed_node_add_literal(arena, class->class_bracketed,
+                                             nodes[i]->literal->value);
+            break;
+         case NODE_KIND_CHARACTER_CLASS:
+            class_bracketed_node_add_character_class(arena, class->class_bracketed,
+                                                     nodes[i]->character_class->kind);
+            break;
+         default:
+            for (int j = 0; j < nodes[i]->class_bracketed->num_items; j++) {
+               class_bracketed_maybe_resize_items(arena, class->class_bracketed);
+               class->class_bracketed->items[class->class_bracketed->num_items++] =
+                   nodes[i]->class_bracketed->items[j];
+            }
+            break;
+      }
+   }
+
+   if (option->option->num_children == 1) {
+      return option->option->children[0];
+   }
+   return option;
+}
+
+// Replaces every run of two or more literals in a concat with a string
+static ast_node_t* merge_literals(arena_t* arena, ast_node_t* node) {
+   switch (node->kind) {
+      case NODE_KIND_OPTION: {
+         ast_node_t* option = ast_new_option_node(arena);
+         for (int i = 0; i < node->option->num_children; i++) {
+            ast_node_add_child(arena, option, merge_literals(arena, node->option->children[i]));
+         }
+         return option;
+      }
+      case NODE_KIND_REPITITION:
+         return ast_new_repetition_node(arena, node->repitition->kind,
+                                        merge_literals(arena, node->repitition->child));
+      case NODE_KIND_CONCAT: {
+         ast_node_t** children = node->concat->children;
+         int num_children = node->concat->num_children;
+         ast_node_t* concat = ast_new_concat_node(arena);
+         for (int i = 0; i < num_children;) {
+            int run = 0;
+            while (i + run < num_children && children[i + run]->kind == NODE_KIND_LITERAL) {
+               run++;
+            }
+            if (run >= 2) {
+               ast_node_add_child(arena, concat, ast_new_string_node(arena, &children[i], run));
+               i += run;
+            } else {
+               ast_node_add_child(arena, concat, merge_literals(arena, children[i]));
+               i++;
+            }
+         }
+         if (concat->concat->num_children == 1) {
+            return concat->concat->children[0];
+         }
+         return concat;
+      }
+      default:
+         return node;
+   }
+}
+
+// Returns the nodes a node matches one after another: the children of a concat, or just the node
+static sequence_t node_sequence(arena_t* arena, ast_node_t* node) {
+   sequence_t sequence;
+   if (node->kind == NODE_KIND_CONCAT) {
+      sequence.items = node->concat->children;
+      sequence.length = node->concat->num_children;
+   } else {
+      sequence.items = arena_alloc(arena, sizeof(ast_node_t*));
+      sequence.items[0] = node;
+      sequence.length = 1;
+   }
+   return sequence;
+}
+
+// The inverse of node_sequence() for a sequence of at least one node
+static ast_node_t* sequence_node(arena_t* arena, ast_node_t** items, int length) {
+   if (length == 1) {
+      return items[0];
+   }
+   ast_node_t* concat = ast_new_concat_node(arena);
+   for (int i = 0; i < length; i++) {
+      ast_node_add_child(arena, concat, items[i]);
+   }
+   return concat;
+}
+
+// Returns the i-th node of the sequence, counting from the end if from_end
+static ast_node_t* sequence_item(sequence_t sequence, int i, bool from_end) {
+   return sequence.items[from_end ? sequence.length - 1 - i : i];
+}
+
+static bool is_single_character(ast_node_t* node) {
+   return node->kind == NODE_KIND_LITERAL || node->kind == NODE_KIND_CHARACTER_CLASS ||
+          (node->kind == NODE_KIND_CLASS_BRACKETED && !node->class_bracketed->negated);
+}
+
+// Whether two asts have the same shape and values (so they match the same strings)
+static bool ast_equal(ast_node_t* a, ast_node_t* b) {
+   if (a->kind != b->kind) {
+      return false;
+   }
+
+   switch (a->kind) {
+      case NODE_KIND_OPTION:
+         return ast_children_equal(a->option->children, a->option->num_children,
+                                   b->option->children, b->option->num_children);
+      case NODE_KIND_CONCAT:
+         return ast_children_equal(a->concat->children, a->concat->num_children,
+                                   b->concat->children, b->concat->num_children);
+      case NODE_KIND_REPITITION:
+         return a->repitition->kind == b->repitition->kind &&
+                ast_equal(a->repitition->child, b->repitition->child);
+      case NODE_KIND_DOT:
+         return true;
+      case NODE_KIND_LITERAL:
+         return a->literal->value == b->literal->value;
+      case NODE_KIND_CHARACTER_CLASS:
+         return a->character_class->kind == b->character_class->kind;
+      case NODE_KIND_CLASS_BRACKETED: {
+         ast_node_class_bracketed_t* class_a = a->class_bracketed;
+         ast_node_class_bracketed_t* class_b = b->class_bracketed;
+         if (class_a->negated != class_b->negated || class_a->num_items != class_b->num_items) {
+            return false;
+         }
+         for (int i = 0; i < class_a->num_items; i++) {
+            class_set_item_t* item_a = &class_a->items[i];
+            class_set_item_t* item_b = &class_b->items[i];
+            if (item_a->kind != item_b->kind ||
+                (item_a->kind == CLASS_SET_ITEM_KIND_LITERAL &&
+                 item_a->literal != item_b->literal) ||
+                (item_a->kind == CLASS_SET_ITEM_KIND_RANGE &&
+                 (item_a->range.start != item_b->range.start ||
+                  item_a->range.end != item_b->range.end)) ||
+                (item_a->kind == CLASS_SET_ITEM_KIND_CHARACTER_CLASS &&
+                 item_a->character_class.kind != item_b->character_class.kind)) {
+               return false;
+            }
+         }
+         return true;
+      }
+      case NODE_KIND_STRING:
+         return strcmp(a->string->value, b->string->value) == 0;
+   }
+   return false;
+}
+
+// Hashes what ast_equal() compares at the root (children are left to ast_equal())
+static uint64_t ast_hash(ast_node_t* node) {
+   uint64_t hash = node->kind;
+   switch (node->kind) {
+      case NODE_KIND_OPTION:
+         hash = hash * 31 + node->option->num_children;
+         break;
+      case NODE_KIND_CONCAT:
+         hash = hash * 31 + node->concat->num_children;
+         break;
+      case NODE_KIND_REPITITION:
+         hash = (hash * 31 + node->repitition->kind) * 31 + node->repitition->child->kind;
+         break;
+      case NODE_KIND_LITERAL:
+         hash = hash * 31 + (uint8_t)node->literal->value;
+         break;
+      case NODE_KIND_CHARACTER_CLASS:
+         hash = hash * 31 + node->character_class->kind;
+         break;
+      case NODE_KIND_CLASS_BRACKETED:
+         hash = hash * 31 + node->class_bracketed->negated;
+         hash = hash * 31 + node->class_bracketed->num_items;
+         break;
+      case NODE_KIND_STRING:
+         for (int i = 0; i < node->string->length; i++) {
+            hash = hash * 31 + (uint8_t)node->string->value[i];
+         }
+         break;
+      case NODE_KIND_DOT:
+         break;
+   }
+   // Mix the high bits into the low ones, which pick the slot
+   hash ^= hash >> 29;
+   hash *= 0xbf58476d1ce4e5b9ULL;
+   return hash ^ (hash >> 32);
+}
+
+// Whether the ast is nested more than max_depth levels deep, found without recursing
+static bool ast_deeper_than(ast_node_t* root, int max_depth) {
+   int capacity = 64;
+   ast_node_t** nodes = xmalloc(sizeof(ast_node_t*) * capacity);
+   int* depths = xmalloc(sizeof(int) * capacity);
+   int size = 0;
+   bool deeper = false;
+
+   nodes[size] = root;
+   depths[size++] = 1;
+   while (size > 0 && !deeper) {
+      ast_node_t* node = nodes[--size];
+      int depth = depths[size];
+      deeper = depth > max_depth;
+
+      ast_node_t** children;
+      int num_children = ast_node_children(node, &children);
+
+      if (size + num_children > capacity) {
+         capacity = (size + num_children) * 2;
+         nodes = xrealloc(nodes, sizeof(ast_node_t*) * capacity);
+         depths = xrealloc(depths, sizeof(int) * capacity);
+      }
+      for (int i = 0; i < num_children; i++) {
+         nodes[size] = children[i];
+         depths[size++] = depth + 1;
+      }
+   }
+
+   free(nodes);
+   free(depths);
+   return deeper;
+}
+
+static bool ast_children_equal(ast_node_t** children_a, int num_a, ast_node_t** children_b,
+                               int num_b) {
+   if (num_a != num_b) {
+      return false;
+   }
+   for (int i = 0; i < num_a; i++) {
+      if (!ast_equal(children_a[i], children_b[i])) {
+         return false;
+      }
+   }
+   return true;
+}
+
 /**
  * Character helpers
 */
@@ -503,9 +1208,3 @@ static int get_character_config(char c, CCCol_t col) {
    }
    return CHARACTER_CONFIG[(int)c][col];
 }
-
-// Whether the character is in the first set of 'factor'
-static int in_factor_first_set(char c) {
-   return (is_valid_character(c) == true && is_special_character(c) == false) || c == '(' ||
-          c == '\\' || c == '.' || c == '[';
-}
@@ -1,6 +1,8 @@
 #ifndef PARSE_H
 #define PARSE_H
 
+#include "arena.h"
+
 #define LITERAL_START 32
 #define LITERAL_END 126
 #define NUM_LITERALS (LITERAL_END - LITERAL_START + 1)
@@ -12,10 +14,12 @@ typedef struct ast_node_concat ast_node_concat_t;
 typedef struct ast_node_repitition ast_node_repitition_t;
 typedef struct ast_node_dot ast_node_dot_t;
 typedef struct ast_node_literal ast_node_literal_t;
+typedef struct ast_node_string ast_node_string_t;
 typedef struct ast_character_class ast_character_class_t;
 typedef struct ast_node_class_bracketed ast_node_class_bracketed_t;
 
 typedef struct class_set_item class_set_item_t;
+typedef struct parse_error parse_error_t;
 typedef struct class_set_range class_set_range_t;
 
 typedef enum {
@@ -26,6 +30,7 @@ typedef enum {
    NODE_KIND_LITERAL,
    NODE_KIND_CHARACTER_CLASS,
    NODE_KIND_CLASS_BRACKETED,
+   NODE_KIND_STRING,  // only made by optimize_ast()
 } NodeKind;
 
 typedef enum {
@@ -51,6 +56,10 @@ typedef enum {
 
 struct ast_node {
       NodeKind kind;
+      // Part of the pattern the node was parsed from, [start, end) (-1 for nodes made by the
+      // optimizer). A group's node includes its parentheses.
+      int start;
+      int end;
       union {
             ast_node_option_t* option;
             ast_node_concat_t* concat;
@@ -59,18 +68,20 @@ struct ast_node {
             ast_node_literal_t* literal;
             ast_character_class_t* character_class;
             ast_node_class_bracketed_t* class_bracketed;
+            ast_node_string_t* string;
       };
 };
 
 struct ast_node_option {
-      // Could be a list of child nodes
-      ast_node_t* left;
-      ast_node_t* right;
+      int num_children;       // at least 2
+      int children_capacity;  // capacity of the children array (>= num_children)
+      ast_node_t** children;
 };
 
 struct ast_node_concat {
-      ast_node_t* left;
-      ast_node_t* right;
+      int num_children;       // at least 2
+      int children_capacity;  // capacity of the children array (>= num_children)
+      ast_node_t** children;
 };
 
 struct ast_node_repitition {
@@ -86,6 +97,11 @@ struct ast_node_literal {
       char value;
 };
 
+struct ast_node_string {
+      int length;  // at least 2
+      char* value;  // null-terminated
+};
+
 struct ast_character_class {
       CharacterClassKind kind;
 };
@@ -111,15 +127,45 @@ struct class_set_item {
       };
 };
 
+struct parse_error {
+      const char* message;  // null if the pattern is valid
+      int position;         // offset in the pattern the error refers to
+};
+
+/**
+ * Parses a regex pattern into an AST allocated from the arena (freed with it).
+ * Takes time linear in the pattern length, whatever its nesting depth.
+ * @returns null if the pattern is invalid
+ */
+ast_node_t* parse_regex(arena_t*, char* pattern);
+
+/**
+ * Like parse_regex(), and describes what's wrong with an invalid pattern in `error`.
+ */
+ast_node_t* parse_regex_with_error(arena_t*, char* pattern, parse_error_t* error);
+
+/**
+ * Points `children` at the children of an option, concat or repetition node.
+ * @returns the number of children (0 for every other kind of node)
+ */
+int ast_node_children(ast_node_t*, ast_node_t*** children);
+
 /**
- * Parses a regex pattern into an AST.
+ * Returns the number of nodes in the ast.
  */
-ast_node_t* parse_regex(char* pattern);
+int ast_num_nodes(ast_node_t*);
 
 /**
- * Frees the AST.
+ * Rewrites an ast into a smaller one that matches the same strings, allocating new nodes from the
+ * arena (the old ones may be reused):
+ * - nested alternations and concatenations are flattened into one n-ary node
+ * - common prefixes and suffixes are factored out of alternatives ('ab|ac' -> 'a(b|c)')
+ * - alternated single characters and classes become one class ('a|b|\d' -> '[ab\d]')
+ * - nested repetitions collapse ('(a+)*' -> 'a*')
+ * - runs of literals become strings
+ * Asts nested more than a thousand levels deep are returned as they are.
  */
-void free_ast(ast_node_t*);
+ast_node_t* optimize_ast(arena_t*, ast_node_t*);
 
 /**
  * Returns if a character is a valid chracter in the regex language.
@@ -0,0 +1,208 @@
+#include "profile.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "table.h"
+#include "utils.h"
+
+#define CLASS_DESCRIPTION_SIZE 4096  // enough for 128 ranges written as '\xNN-\xNN'
+
+static void describe_class(dfa_table_t*, int, char*);
+static void describe_byte(int, char*);
+static void write_json_quoted(FILE*, const char*);
+static void write_dot_quoted(FILE*, const char*);
+static uint64_t state_rejections(dfa_table_t*, int);
+
+/**
+ * Public API
+*/
+
+table_profile_t* new_table_profile(int num_states, int num_classes) {
+   table_profile_t* profile = xmalloc(sizeof(table_profile_t));
+   profile->state_visits = xmalloc(sizeof(uint64_t) * num_states);
+   profile->transitions = xmalloc(sizeof(uint64_t) * num_states * num_classes);
+   table_profile_reset(profile, num_states, num_classes);
+   return profile;
+}
+
+void table_profile_reset(table_profile_t* profile, int num_states, int num_classes) {
+   profile->matches = 0;
+   profile->accepted = 0;
+   profile->bytes_scanned = 0;
+   memset(profile->state_visits, 0, sizeof(uint64_t) * num_states);
+   memset(profile->transitions, 0, sizeof(uint64_t) * num_states * num_classes);
+}
+
+int table_profile_write_json(dfa_table_t* table, FILE* out) {
+   table_profile_t* profile = table->profile;
+   if (profile == NULL) {
+      return -1;
+   }
+
+   fprintf(out, "{\n  \"pattern\": ");
+   write_json_quoted(out, table->pattern);
+   fprintf(out, ",\n  \"matches\": %" PRIu64 ",\n  \"accepted\": %" PRIu64, profile->matches,
+           profile->accepted);
+   fprintf(out, ",\n  \"bytes_scanned\": %" PRIu64 ",\n  \"start\": %d,\n  \"classes\": [",
+           profile->bytes_scanned, table->start);
+
+   char description[CLASS_DESCRIPTION_SIZE];
+   for (int class = 0; class < table->num_classes; class++) {
+      describe_class(table, class, description);
+      fprintf(out, class == 0 ? "" : ", ");
+      write_json_quoted(out, description);
+   }
+   fprintf(out, "],\n  \"states\": [");
+
+   // Only transitions that were taken, so a large table with a narrow workload stays readable
+   for (int state = 0; state < table->num_states; state++) {
+      fprintf(out, "%s\n    {\"id\": %d, \"accepting\": %s, \"visits\": %" PRIu64
+                   ", \"transitions\": [",
+              state == 0 ? "" : ",", state, table->accepting[state] ? "true" : "false",
+              profile->state_visits[state]);
+      bool first = true;
+      for (int class = 0; class < table->num_classes; class++) {
+         uint64_t count = profile->transitions[state * table->num_classes + class];
+         if (count > 0) {
+            fprintf(out, "%s{\"class\": %d, \"to\": %d, \"count\": %" PRIu64 "}",
+                    first ? "" : ", ", class,
+                    table_next(table, state, class), count);
+            first = false;
+         }
+      }
+      fprintf(out, "]}");
+   }
+   fprintf(out, "\n  ]\n}\n");
+
+   return ferror(out) ? -1 : 0;
+}
+
+int table_profile_write_dot(dfa_table_t* table, FILE* out) {
+   table_profile_t* profile = table->profile;
+   if (profile == NULL) {
+      return -1;
+   }
+
+   fprintf(out, "digraph sregex {\n  rankdir=LR;\n  label=");
+   write_dot_quoted(out, table->pattern);
+   fprintf(out, ";\n  node [shape=circle];\n  start [shape=point];\n  start -> s%d;\n",
+           table->start);
+
+   char description[CLASS_DESCRIPTION_SIZE];
+   for (int state = 0; state < table->num_states; state++) {
+      fprintf(out, "  s%d [shape=%s, label=\"%d\\n%" PRIu64 " visits", state,
+              table->accepting[state] ? "doublecircle" : "circle", state,
+              profile->state_visits[state]);
+      uint64_t rejections = state_rejections(table, state);
+      if (rejections > 0) {
+         fprintf(out, "\\n%" PRIu64 " rejected", rejections);
+      }
+      fprintf(out, "\"];\n");
+
+      for (int class = 0; class < table->num_classes; class++) {
+         int next = table_next(table, state, class);
+         if (next == TABLE_NO_TRANSITION) {
+            continue;
+         }
+         uint64_t count = profile->transitions[state * table->num_classes + class];
+         describe_class(table, class, description);
+         fprintf(out, "  s%d -> s%d [label=", state, next);
+         write_dot_quoted(out, description);
+         fprintf(out, count > 0 ? ", xlabel=\"%" PRIu64 "\"];\n" : ", style=dashed];\n", count);
+      }
+   }
+   fprintf(out, "}\n");
+
+   return ferror(out) ? -1 : 0;
+}
+
+void free_table_profile(table_profile_t* profile) {
+   free(profile->state_visits);
+   free(profile->transitions);
+   free(profile);
+}
+
+/**
+ * Helpers (private)
+*/
+
+// Writes the bytes of a class as ranges, e.g. 'a-z_' or '\x00-\x1f'
+static void describe_class(dfa_table_t* table, int class, char* description) {
+   char* end = description;
+   for (int byte = 0; byte < TABLE_NUM_BYTES; byte++) {
+      if (table->classes[byte] != class) {
+         continue;
+      }
+      int last = byte;
+      while (last + 1 < TABLE_NUM_BYTES && table->classes[last + 1] == class) {
+         last++;
+      }
+
+      describe_byte(byte, end);
+      end += strlen(end);
+      if (last > byte) {
+         *end++ = '-';
+         describe_byte(last, end);
+         end += strlen(end);
+      }
+      byte = last;
+   }
+   *end = '\0';
+}
+
+// Like a bracketed class would: '\' and '-' are escaped, unprintable bytes are written in hex
+static void describe_byte(int byte, char* out) {
+   if (byte == '\\' || byte == '-') {
+      sprintf(out, "\\%c", byte);
+   } else if (byte >= LITERAL_START && byte <= LITERAL_END) {
+      sprintf(out, "%c", byte);
+   } else {
+      sprintf(out, "\\x%02x", byte);
+   }
+}
+
+// Writes a string as a double-quoted JSON string
+static void write_json_quoted(FILE* out, const char* str) {
+   fputc('"', out);
+   for (const unsigned char* c = (const unsigned char*)str; *c; c++) {
+      if (*c == '"' || *c == '\\') {
+         fprintf(out, "\\%c", *c);
+      } else if (*c < LITERAL_START || *c > LITERAL_END) {
+         fprintf(out, "\\u%04x", *c);
+      } else {
+         fputc(*c, out);
+      }
+   }
+   fputc('"', out);
+}
+
+// Writes a string as a double-quoted DOT string. DOT only knows the escapes '\"' and '\\' (and line
+// breaks), so other unprintable bytes are written as character entities, e.g. '&#128;'.
+static void write_dot_quoted(FILE* out, const char* str) {
+   fputc('"', out);
+   for (const unsigned char* c = (const unsigned char*)str; *c; c++) {
+      if (*c == '"' || *c == '\\') {
+         fprintf(out, "\\%c", *c);
+      } else if (*c < LITERAL_START || *c > LITERAL_END) {
+         fprintf(out, "&#%d;", *c);
+      } else {
+         fputc(*c, out);
+      }
+   }
+   fputc('"', out);
+}
+
+// Lookups from the state that found no transition, i.e. inputs the state rejected
+static uint64_t state_rejections(dfa_table_t* table, int state) {
+   uint64_t rejections = 0;
+   for (int class = 0; class < table->num_classes; class++) {
+      if (table_next(table, state, class) == TABLE_NO_TRANSITION) {
+         rejections += table->profile->transitions[state * table->num_classes + class];
+      }
+   }
+   return rejections;
+}
@@ -0,0 +1,53 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct dfa_table dfa_table_t;
+typedef struct table_profile table_profile_t;
+
+/**
+ * Match-time counters for one table. Only builds with SREGEX_PROFILE defined (make PROFILE=1) give
+ * tables a profile and count into it, so the normal matcher has no instrumentation at all.
+ * Counters are updated with relaxed atomics, so a profiled table can still be shared by threads.
+ */
+struct table_profile {
+      uint64_t matches;        // calls to table_accepts()
+      uint64_t accepted;       // of which returned true
+      uint64_t bytes_scanned;  // bytes consumed, up to the end of the input or a missing transition
+      uint64_t* state_visits;  // [num_states]: times each state was entered (start: once a match)
+      // [num_states * num_classes]: times each transition was looked up, including missing ones
+      uint64_t* transitions;
+};
+
+/**
+ * Allocates zeroed counters for a table of the given size.
+ */
+table_profile_t* new_table_profile(int num_states, int num_classes);
+
+/**
+ * Zeroes every counter.
+ */
+void table_profile_reset(table_profile_t*, int num_states, int num_classes);
+
+/**
+ * Writes the table's profile as a JSON object: the totals, the bytes of each class, and every state
+ * with its visits and the transitions taken from it.
+ * @returns 0 on success, -1 if the table has no profile or writing fails
+ */
+int table_profile_write_json(dfa_table_t*, FILE*);
+
+/**
+ * Writes the table as a Graphviz DOT graph, with the states labelled by their visits and the edges
+ * by their bytes and how often they were taken. Edges that were never taken are dashed.
+ * @returns 0 on success, -1 if the table has no profile or writing fails
+ */
+int table_profile_write_dot(dfa_table_t*, FILE*);
+
+/**
+ * Frees the counters.
+ */
+void free_table_profile(table_profile_t*);
+
+#endif  // PROFILE_H
@@ -0,0 +1,282 @@
+#include "sample.h"
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "utils.h"
+
+#define UNREACHABLE -1          // distance of a state that can't reach an accepting state
+#define NEAR_MISS_ATTEMPTS 8    // accepted strings to try to find an edit in
+#define EDIT_REPLACE 0          // kinds of edit of table_sample_near_miss()
+#define EDIT_CUT 1
+
+struct table_sampler {
+      dfa_table_t* table;
+      int* distances;  // [num_states]: fewest bytes to an accepting state, or UNREACHABLE
+      // The bytes of class c are bytes[class_offsets[c]] to bytes[class_offsets[c + 1] - 1], the
+      // first num_printable[c] of which are printable
+      uint8_t bytes[TABLE_NUM_BYTES];
+      int class_offsets[TABLE_NUM_BYTES + 1];
+      int num_printable[TABLE_NUM_BYTES];
+};
+
+static int* distances_to_accepting(dfa_table_t*);
+static int sample_walk(table_sampler_t*, char*, int, int, unsigned int*, int32_t*);
+static int class_byte(table_sampler_t*, int, unsigned int*);
+static int class_weight(table_sampler_t*, int);
+static int pick_class(table_sampler_t*, int*, int, unsigned int*);
+static int dead_byte(table_sampler_t*, int32_t, unsigned int*);
+static bool is_live(table_sampler_t*, int32_t);
+static int sample_random(unsigned int*, int);
+
+/**
+ * Public API
+*/
+
+table_sampler_t* new_table_sampler(dfa_table_t* table) {
+   table_sampler_t* sampler = xmalloc(sizeof(table_sampler_t));
+   sampler->table = table;
+   sampler->distances = distances_to_accepting(table);
+
+   // Group the bytes by class, printable ones first. Null bytes and newlines are left out.
+   int offset = 0;
+   for (int class = 0; class < table->num_classes; class++) {
+      sampler->class_offsets[class] = offset;
+      for (int pass = 0; pass < 2; pass++) {
+         for (int byte = 1; byte < TABLE_NUM_BYTES; byte++) {
+            bool printable = isprint(byte);
+            if (table->classes[byte] == class && byte != '\n' && printable == (pass == 0)) {
+               sampler->bytes[offset++] = byte;
+            }
+         }
+         if (pass == 0) {
+            sampler->num_printable[class] = offset - sampler->class_offsets[class];
+         }
+      }
+   }
+   sampler->class_offsets[table->num_classes] = offset;
+   return sampler;
+}
+
+int table_sample_accepted(table_sampler_t* sampler, char* out, int size, int length,
+                          unsigned int* seed) {
+   return sample_walk(sampler, out, size, length, seed, NULL);
+}
+
+int table_sample_near_miss(table_sampler_t* sampler, char* out, int size, int length,
+                           unsigned int* seed) {
+   int32_t* path = xmalloc(sizeof(int32_t) * size);
+   int* edits = xmalloc(sizeof(int) * 2 * size);
+   int result = -1;
+
+   for (int attempt = 0; attempt < NEAR_MISS_ATTEMPTS && result == -1; attempt++) {
+      int len = sample_walk(sampler, out, size, length, seed, path);
+      if (len == -1) {
+         break;
+      }
+
+      // Every edit that makes the string rejected, as 2 * position + kind. Replacing the byte at
+      // len means appending one.
+      int num_edits = 0;
+      for (int i = 0; i <= len; i++) {
+         if ((i < len || len + 1 < size) && dead_byte(sampler, path[i], seed) != -1) {
+            edits[num_edits++] = 2 * i + EDIT_REPLACE;
+         }
+         if (i > 0 && i < len && !sampler->table->accepting[path[i]]) {
+            edits[num_edits++] = 2 * i + EDIT_CUT;
+         }
+      }
+      if (num_edits == 0) {
+         continue;
+      }
+
+      int edit = edits[sample_random(seed, num_edits)];
+      int position = edit / 2;
+      if (edit % 2 == EDIT_CUT) {
+         out[position] = '\0';
+         result = position;
+      } else {
+         out[position] = dead_byte(sampler, path[position], seed);
+         result = position == len ? len + 1 : len;
+         out[result] = '\0';
+      }
+   }
+
+   free(edits);
+   free(path);
+   return result;
+}
+
+void free_table_sampler(table_sampler_t* sampler) {
+   free(sampler->distances);
+   free(sampler);
+}
+
+/**
+ * Helpers
+*/
+
+// Breadth-first search backwards from every accepting state
+static int* distances_to_accepting(dfa_table_t* table) {
+   int num_states = table->num_states;
+   int num_classes = table->num_classes;
+
+   // Predecessors of each state, in one array indexed by offsets
+   int* offsets = xmalloc(sizeof(int) * (num_states + 1));
+   for (int state = 0; state <= num_states; state++) {
+      offsets[state] = 0;
+   }
+   for (int state = 0; state < num_states; state++) {
+      for (int class = 0; class < num_classes; class++) {
+         int32_t next = table_next(table, state, class);
+         if (next != TABLE_NO_TRANSITION) {
+            offsets[next + 1]++;
+         }
+      }
+   }
+   for (int state = 0; state < num_states; state++) {
+      offsets[state + 1] += offsets[state];
+   }
+   int* predecessors = xmalloc(sizeof(int) * (offsets[num_states] + 1));
+   int* filled = xmalloc(sizeof(int) * num_states);
+   for (int state = 0; state < num_states; state++) {
+      filled[state] = offsets[state];
+   }
+   for (int state = 0; state < num_states; state++) {
+      for (int class = 0; class < num_classes; class++) {
+         int32_t next = table_next(table, state, class);
+         if (next != TABLE_NO_TRANSITION) {
+            predecessors[filled[next]++] = state;
+         }
+      }
+   }
+
+   int* distances = xmalloc(sizeof(int) * num_states);
+   int* queue = filled;  // no longer needed, and just as large
+   int head = 0;
+   int tail = 0;
+   for (int state = 0; state < num_states; state++) {
+      distances[state] = table->accepting[state] ? 0 : UNREACHABLE;
+      if (table->accepting[state]) {
+         queue[tail++] = state;
+      }
+   }
+   while (head < tail) {
+      int state = queue[head++];
+      for (int i = offsets[state]; i < offsets[state + 1]; i++) {
+         int predecessor = predecessors[i];
+         if (distances[predecessor] == UNREACHABLE) {
+            distances[predecessor] = distances[state] + 1;
+            queue[tail++] = predecessor;
+         }
+      }
+   }
+
+   free(queue);
+   free(predecessors);
+   free(offsets);
+   return distances;
+}
+
+// Walks the table from the start writing an accepted string (see table_sample_accepted()). Each
+// step keeps an accepting state within reach of the space left in out. When path isn't null it
+// gets the state before each byte, and the final state.
+static int sample_walk(table_sampler_t* sampler, char* out, int size, int length,
+                       unsigned int* seed, int32_t* path) {
+   dfa_table_t* table = sampler->table;
+   int32_t state = table->start;
+   int budget = size - 1;
+   if (sampler->distances[state] == UNREACHABLE || sampler->distances[state] > budget) {
+      return -1;
+   }
+
+   int candidates[TABLE_NUM_BYTES];
+   int len = 0;
+   while (!(table->accepting[state] && len >= length)) {
+      int num_candidates = 0;
+      for (int class = 0; class < table->num_classes; class++) {
+         int32_t next = table_next(table, state, class);
+         if (!is_live(sampler, next) || len + 1 + sampler->distances[next] > budget ||
+             sampler->class_offsets[class] == sampler->class_offsets[class + 1]) {
+            continue;
+         }
+         // Past the length, only steps toward the nearest accepting state
+         if (len < length || sampler->distances[next] < sampler->distances[state]) {
+            candidates[num_candidates++] = class;
+         }
+      }
+      if (num_candidates == 0) {
+         // Only an accepting state can run out of steps, the others always have one toward
+         // acceptance (unless its bytes are all nulls and newlines)
+         if (table->accepting[state]) {
+            break;
+         }
+         return -1;
+      }
+
+      int class = pick_class(sampler, candidates, num_candidates, seed);
+      if (path != NULL) {
+         path[len] = state;
+      }
+      out[len++] = class_byte(sampler, class, seed);
+      state = table_next(table, state, class);
+   }
+
+   if (path != NULL) {
+      path[len] = state;
+   }
+   out[len] = '\0';
+   return len;
+}
+
+// A random byte of the class, printable if the class has any
+static int class_byte(table_sampler_t* sampler, int class, unsigned int* seed) {
+   return sampler->bytes[sampler->class_offsets[class] +
+                         sample_random(seed, class_weight(sampler, class))];
+}
+
+// A random byte that takes the state to no state or one that can't accept, or -1 if none does
+static int dead_byte(table_sampler_t* sampler, int32_t state, unsigned int* seed) {
+   int candidates[TABLE_NUM_BYTES];
+   int num_candidates = 0;
+   for (int class = 0; class < sampler->table->num_classes; class++) {
+      if (!is_live(sampler, table_next(sampler->table, state, class)) &&
+          sampler->class_offsets[class] < sampler->class_offsets[class + 1]) {
+         candidates[num_candidates++] = class;
+      }
+   }
+   return num_candidates == 0
+              ? -1
+              : class_byte(sampler, pick_class(sampler, candidates, num_candidates, seed), seed);
+}
+
+// The number of bytes class_byte() picks from
+static int class_weight(table_sampler_t* sampler, int class) {
+   int count = sampler->num_printable[class];
+   return count > 0 ? count : sampler->class_offsets[class + 1] - sampler->class_offsets[class];
+}
+
+// A random class of the candidates, weighted by their number of bytes so that every byte is as
+// likely (otherwise letters a pattern spells out, which get classes of their own, would be much
+// likelier than the rest of their range)
+static int pick_class(table_sampler_t* sampler, int* candidates, int num_candidates,
+                      unsigned int* seed) {
+   int total = 0;
+   for (int i = 0; i < num_candidates; i++) {
+      total += class_weight(sampler, candidates[i]);
+   }
+   int pick = sample_random(seed, total);
+   for (int i = 0;; i++) {
+      pick -= class_weight(sampler, candidates[i]);
+      if (pick < 0) {
+         return candidates[i];
+      }
+   }
+}
+
+static bool is_live(table_sampler_t* sampler, int32_t state) {
+   return state != TABLE_NO_TRANSITION && sampler->distances[state] != UNREACHABLE;
+}
+
+static int sample_random(unsigned int* seed, int bound) { return rand_r(seed) % bound; }
@@ -0,0 +1,42 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include "table.h"
+
+typedef struct table_sampler table_sampler_t;
+
+/**
+ * Prepares to generate strings from a table: finds how far each state is from accepting and which
+ * bytes can stand for each byte class. Generated strings never contain a null byte or a newline,
+ * so they can be written one per line. The table must outlive the sampler. Sampling doesn't modify
+ * the sampler, so threads can share one as long as each has its own seed.
+ */
+table_sampler_t* new_table_sampler(dfa_table_t*);
+
+/**
+ * Writes a random string the table accepts, by walking it from the start and picking a random byte
+ * of a random transition that can still reach an accepting state. Once the string is length bytes
+ * long, the walk takes the shortest way to an accepting state. Languages with no string that long
+ * give the longest string the walk finds.
+ * @param out Where to write the null-terminated string
+ * @param size Size of out (the string is at most size - 1 bytes)
+ * @param length Length to aim for
+ * @returns the length of the string, or -1 if the table accepts no string shorter than size
+ */
+int table_sample_accepted(table_sampler_t*, char* out, int size, int length, unsigned int* seed);
+
+/**
+ * Writes a random string the table rejects that is one edit away from an accepted string: a byte
+ * replaced by or followed by one that leads nowhere, or the string cut short where it doesn't
+ * accept.
+ * @returns the length of the string, or -1 if no near miss was found (e.g. the table accepts every
+ * string that starts like the accepted ones do)
+ */
+int table_sample_near_miss(table_sampler_t*, char* out, int size, int length, unsigned int* seed);
+
+/**
+ * Frees the sampler (not the table).
+ */
+void free_table_sampler(table_sampler_t*);
+
+#endif  // SAMPLE_H
@@ -0,0 +1,161 @@
+#include "sim.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+typedef struct nfa_sim_edge {
+      uint64_t bytes[NFA_EDGE_NUM_WORDS];  // copied from the nfa_edge_t's bitmap
+      int to;
+      bool is_epsilon;
+} nfa_sim_edge_t;
+
+_Static_assert(sizeof(((nfa_sim_edge_t*)0)->bytes) == sizeof(((nfa_edge_t*)0)->bytes),
+               "nfa_sim_from_nfa() copies the edge bitmaps as they are");
+
+struct nfa_sim {
+      int num_states;
+      int start;
+      bool* accepting;
+      int* first_edge;  // edges of state s are edges[first_edge[s]] to edges[first_edge[s + 1] - 1]
+      nfa_sim_edge_t* edges;
+};
+
+// Set of states: O(1) insert and membership test, members listed in insertion order
+typedef struct state_set {
+      int* dense;
+      int* sparse;
+      int size;
+} state_set_t;
+
+static inline bool sim_edge_has_byte(nfa_sim_edge_t*, uint8_t);
+static void state_set_add_closure(nfa_sim_t*, state_set_t*, int*, int);
+static bool state_set_contains(state_set_t*, int);
+static void state_set_add(state_set_t*, int);
+
+/**
+ * Public API
+*/
+
+nfa_sim_t* nfa_sim_from_nfa(nfa_t* nfa) {
+   int num_states = nfa_num_states(nfa);
+   nfa_node_t** nodes = xmalloc(sizeof(nfa_node_t*) * num_states);
+   int num_edges = 0;
+
+   list_node_t* current;
+   list_traverse(nfa->__nodes, current) {
+      nfa_node_t* node = (nfa_node_t*)current->data;
+      nodes[node->id] = node;
+      num_edges += node->num_edges;
+   }
+
+   nfa_sim_t* sim = xmalloc(sizeof(nfa_sim_t));
+   sim->num_states = num_states;
+   sim->start = nfa->start->id;
+   sim->accepting = xmalloc(sizeof(bool) * num_states);
+   sim->first_edge = xmalloc(sizeof(int) * (num_states + 1));
+   sim->edges = xmalloc(sizeof(nfa_sim_edge_t) * (num_edges > 0 ? num_edges : 1));
+
+   int edge = 0;
+   for (int id = 0; id < num_states; id++) {
+      sim->accepting[id] = nodes[id]->is_accepting;
+      sim->first_edge[id] = edge;
+      for (int i = 0; i < nodes[id]->num_edges; i++, edge++) {
+         nfa_edge_t* nfa_edge = &nodes[id]->edges[i];
+         memcpy(sim->edges[edge].bytes, nfa_edge->bytes, sizeof nfa_edge->bytes);
+         sim->edges[edge].to = nfa_edge->to->id;
+         sim->edges[edge].is_epsilon = nfa_edge->is_epsilon;
+      }
+   }
+   sim->first_edge[num_states] = edge;
+
+   free(nodes);
+   return sim;
+}
+
+bool nfa_sim_accepts(nfa_sim_t* sim, char* str, int len) {
+   int num_states = sim->num_states;
+   // Both sets and the eclosure stack in one allocation; zeroing keeps the sparse arrays defined
+   int* memory = xmalloc(sizeof(int) * 5 * num_states);
+   memset(memory, 0, sizeof(int) * 5 * num_states);
+   state_set_t current = {.dense = memory, .sparse = memory + num_states, .size = 0};
+   state_set_t next = {.dense = memory + 2 * num_states, .sparse = memory + 3 * num_states};
+   int* stack = memory + 4 * num_states;
+
+   state_set_add_closure(sim, &current, stack, sim->start);
+   for (int i = 0; i < len && current.size > 0; i++) {
+      next.size = 0;
+      for (int j = 0; j < current.size; j++) {
+         int state = current.dense[j];
+         for (int e = sim->first_edge[state]; e < sim->first_edge[state + 1]; e++) {
+            if (!sim->edges[e].is_epsilon && sim_edge_has_byte(&sim->edges[e], str[i])) {
+               state_set_add_closure(sim, &next, stack, sim->edges[e].to);
+            }
+         }
+      }
+      state_set_t swap = current;
+      current = next;
+      next = swap;
+   }
+
+   bool accepts = false;
+   for (int j = 0; j < current.size && !accepts; j++) {
+      accepts = sim->accepting[current.dense[j]];
+   }
+
+   free(memory);
+   return accepts;
+}
+
+int nfa_sim_num_states(nfa_sim_t* sim) { return sim->num_states; }
+
+void free_nfa_sim(nfa_sim_t* sim) {
+   free(sim->accepting);
+   free(sim->first_edge);
+   free(sim->edges);
+   free(sim);
+}
+
+/**
+ * Helpers (private)
+*/
+
+// The simulation's own test of an edge's bitmap (see nfa_edge_has_byte() for the nfa's)
+static inline bool sim_edge_has_byte(nfa_sim_edge_t* edge, uint8_t byte) {
+   return (edge->bytes[byte >> 6] >> (byte & 63)) & 1;
+}
+
+// Adds a state and everything reachable from it on epsilon edges. States join the set when they're
+// pushed, so each is pushed at most once and the stack never outgrows the nfa.
+static void state_set_add_closure(nfa_sim_t* sim, state_set_t* set, int* stack, int state) {
+   if (state_set_contains(set, state)) {
+      return;
+   }
+   int stack_size = 0;
+   state_set_add(set, state);
+   stack[stack_size++] = state;
+
+   while (stack_size > 0) {
+      int id = stack[--stack_size];
+      for (int e = sim->first_edge[id]; e < sim->first_edge[id + 1]; e++) {
+         int to = sim->edges[e].to;
+         if (sim->edges[e].is_epsilon && !state_set_contains(set, to)) {
+            state_set_add(set, to);
+            stack[stack_size++] = to;
+         }
+      }
+   }
+}
+
+static bool state_set_contains(state_set_t* set, int id) {
+   int position = set->sparse[id];
+   return position < set->size && set->dense[position] == id;
+}
+
+static void state_set_add(state_set_t* set, int id) {
+   set->sparse[id] = set->size;
+   set->dense[set->size++] = id;
+}
@@ -0,0 +1,33 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdbool.h>
+
+#include "nfa.h"
+
+typedef struct nfa_sim nfa_sim_t;
+
+/**
+ * Copies an nfa into flat arrays that can be simulated without building a dfa, for patterns whose
+ * dfa would be too large. The simulator doesn't point into the nfa, so its arena can be released.
+ */
+nfa_sim_t* nfa_sim_from_nfa(nfa_t*);
+
+/**
+ * Returns true if the nfa accepts the first len characters of str (exact match). Tracks the set of
+ * states the nfa could be in, so it takes O(len * states) time and O(states) memory, allocated per
+ * call (the simulator is never modified, so it can be shared between threads).
+ */
+bool nfa_sim_accepts(nfa_sim_t*, char* str, int len);
+
+/**
+ * Returns the number of nfa states the simulator tracks.
+ */
+int nfa_sim_num_states(nfa_sim_t*);
+
+/**
+ * Frees the simulator.
+ */
+void free_nfa_sim(nfa_sim_t*);
+
+#endif  // SIM_H
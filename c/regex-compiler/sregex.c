@@ -2,33 +2,185 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "arena.h"
+#include "codegen.h"
 #include "dfa.h"
+#include "jit.h"
 #include "parse.h"
+#include "sample.h"
+#include "sim.h"
+#include "table.h"
 #include "utils.h"
 
+#define REGEX_MAX_BLOWUP_TRIALS 256  // most subexpressions regex_locate_blowup() compiles
+
 struct regex {
       char* pattern;
-      dfa_t* dfa;
+      dfa_table_t* table;  // null if a compile limit was exceeded and the regex fell back to sim
+      nfa_sim_t* sim;      // null unless the regex fell back to nfa simulation
+      jit_t* jit;  // null unless compiled with REGEX_FLAG_JIT on a supported architecture
+      int __refs;  // updated atomically
+      regex_stats_t __stats;  // filled in while compiling (see regex_stats())
+      // Set when the table points into a file mapped by regex_load_mmap()
+      void* __mapped;
+      size_t __mapped_size;
 };
 
-static dfa_t* regex_parse(char*);
+struct regex_generator {
+      regex_t* regex;
+      table_sampler_t* sampler;
+      unsigned int seed;
+};
 
-regex_t* new_regex(char* pattern) {
-   regex_t* regex = xmalloc(sizeof(regex_t));
-   regex->pattern = xmalloc(sizeof(char) * (strlen(pattern) + 1));
-   strcpy(regex->pattern, pattern);
-   regex->dfa = regex_parse(pattern);
+static regex_t* regex_alloc(char*);
+static nfa_t* regex_parse(arena_t*, char*, int, regex_error_t*, regex_stats_t*);
+static nfa_t* regex_nfa_from_ast(arena_t*, ast_node_t*, int);
+static void regex_maybe_jit(regex_t*, int);
+static bool regex_accepts_len(regex_t*, char*, int);
+static double regex_lap(double*);
+
+// Compile limits
+static dfa_limits_t regex_limits(const regex_options_t*, double);
+static void regex_limit_error(DFALimit, regex_error_t*);
+static void regex_locate_blowup(char*, const regex_options_t*, regex_error_t*);
+static bool regex_exceeds_limits(ast_node_t**, int, const regex_options_t*, double, int*);
+
+regex_t* new_regex(char* pattern) { return new_regex_with_flags(pattern, REGEX_FLAG_NONE); }
+
+regex_t* new_regex_with_flags(char* pattern, int flags) {
+   regex_error_t error;
+   return new_regex_with_error(pattern, flags, &error);
+}
+
+regex_t* new_regex_with_error(char* pattern, int flags, regex_error_t* error) {
+   regex_options_t options = {.flags = flags};
+   return new_regex_with_options(pattern, &options, error);
+}
+
+regex_t* new_regex_with_options(char* pattern, const regex_options_t* options,
+                                regex_error_t* error) {
+   double start = monotonic_seconds();
+   dfa_limits_t limits = regex_limits(options, start);
+   regex_stats_t stats = {.engine = REGEX_ENGINE_TABLE};
+
+   // Everything up to the dfa is scratch: only the table (or simulator) is kept, in its own
+   // allocation
+   arena_t* arena = new_arena();
+   nfa_t* nfa = regex_parse(arena, pattern, options->flags, error, &stats);
+   if (nfa == NULL) {
+      arena_release(arena);
+      return NULL;
+   }
+
+   double lap = monotonic_seconds();
+   dfa_t* dfa = dfa_from_nfa_with_limits(arena, nfa, &limits);
+   stats.determinize_seconds = regex_lap(&lap);
+   stats.alphabet_size = strlen(nfa_language(nfa));
+   regex_t* regex = NULL;
+
+   if (dfa == NULL) {
+      nfa_sim_t* sim = options->fallback ? nfa_sim_from_nfa(nfa) : NULL;
+      arena_release(arena);
+      regex_limit_error(limits.exceeded, error);
+      if (options->skip_locate) {
+         error->position = 0;
+         error->length = strlen(pattern);
+      } else {
+         regex_locate_blowup(pattern, options, error);
+      }
+      if (sim != NULL) {
+         regex = regex_alloc(pattern);
+         regex->sim = sim;
+      }
+   } else {
+      regex = regex_alloc(pattern);
+      regex->table = table_from_dfa(dfa, pattern, options->flags);
+      arena_release(arena);
+      regex_maybe_jit(regex, options->flags);
+      stats.table_seconds = regex_lap(&lap);
+   }
 
+   if (regex != NULL) {
+      stats.total_seconds = monotonic_seconds() - start;
+      regex->__stats = stats;
+   }
    return regex;
 }
 
 bool regex_accepts(regex_t* regex, char* input) {
-   return dfa_accepts(regex->dfa, input, strlen(input));
+   return regex_accepts_len(regex, input, strlen(input));
+}
+
+void regex_stats(regex_t* regex, regex_stats_t* stats) {
+   *stats = regex->__stats;
+   if (regex->table != NULL) {
+      stats->dfa_states = regex->table->num_states;
+      stats->byte_classes = regex->table->num_classes;
+      stats->table_bytes = regex->table->header->size;
+   }
+   if (regex->jit != NULL) {
+      stats->engine = REGEX_ENGINE_JIT;
+      stats->jit_bytes = jit_code_size(regex->jit);
+   } else if (regex->sim != NULL) {
+      stats->engine = REGEX_ENGINE_NFA_SIMULATION;
+   }
+}
+
+int regex_profile_write(regex_t* regex, FILE* out, RegexProfileFormat format) {
+   if (regex->table == NULL) {
+      return -1;
+   }
+   if (format == REGEX_PROFILE_DOT) {
+      return table_profile_write_dot(regex->table, out);
+   }
+   return table_profile_write_json(regex->table, out);
+}
+
+void regex_profile_reset(regex_t* regex) {
+   dfa_table_t* table = regex->table;
+   if (table != NULL && table->profile != NULL) {
+      table_profile_reset(table->profile, table->num_states, table->num_classes);
+   }
+}
+
+regex_t* regex_relayout(regex_t* regex, char** samples, int num_samples) {
+   dfa_table_t* table = regex->table;
+   if (table == NULL) {
+      return NULL;
+   }
+
+   uint64_t* weights = NULL;
+   table_profile_t* profile = table->profile;
+   if (num_samples > 0) {
+      weights = xmalloc(sizeof(uint64_t) * table->num_states);
+      memset(weights, 0, sizeof(uint64_t) * table->num_states);
+      for (int i = 0; i < num_samples; i++) {
+         table_count_visits(table, samples[i], strlen(samples[i]), weights);
+      }
+   } else if (profile != NULL && __atomic_load_n(&profile->matches, __ATOMIC_RELAXED) > 0) {
+      // A snapshot, as other threads may still be matching and counting
+      weights = xmalloc(sizeof(uint64_t) * table->num_states);
+      for (int state = 0; state < table->num_states; state++) {
+         weights[state] = __atomic_load_n(&profile->state_visits[state], __ATOMIC_RELAXED);
+      }
+   }
+
+   regex_t* relaid = regex_alloc(regex->pattern);
+   relaid->table = table_relayout(table, weights);
+   relaid->__stats = regex->__stats;
+   regex_maybe_jit(relaid, table->header->flags);
+   free(weights);
+   return relaid;
 }
 
 bool regex_test(regex_t* regex, char* input) {
@@ -36,11 +188,11 @@ bool regex_test(regex_t* regex, char* input) {
    char* end = input + strlen(input);
    char* forward;
 
-   // Calls to dfa_accepts() could be cached
+   // Calls to regex_accepts_len() could be cached
    while (start < end) {
       forward = start + 1;
       while (forward <= end) {
-         if (dfa_accepts(regex->dfa, start, forward - start)) {
+         if (regex_accepts_len(regex, start, forward - start)) {
             return true;
          }
          forward++;
@@ -50,23 +202,332 @@ bool regex_test(regex_t* regex, char* input) {
    return false;
 }
 
+regex_t* regex_retain(regex_t* regex) {
+   __atomic_fetch_add(&regex->__refs, 1, __ATOMIC_RELAXED);
+   return regex;
+}
+
 void regex_release(regex_t* regex) {
-   free(regex->pattern);
-   free_dfa(regex->dfa);
+   if (__atomic_sub_fetch(&regex->__refs, 1, __ATOMIC_ACQ_REL) > 0) {
+      return;
+   }
+
+   if (regex->__mapped != NULL) {
+      munmap(regex->__mapped, regex->__mapped_size);
+   } else {
+      free(regex->pattern);
+   }
+   if (regex->jit != NULL) {
+      free_jit(regex->jit);
+   }
+   if (regex->sim != NULL) {
+      free_nfa_sim(regex->sim);
+   }
+   if (regex->table != NULL) {
+      free_table(regex->table);
+   }
    free(regex);
 }
 
-static dfa_t* regex_parse(char* pattern) {
-   ast_node_t* ast = parse_regex(pattern);
-   nfa_t* nfa = nfa_from_ast(ast);
-   free_ast(ast);
-   // log_nfa(nfa);
+int regex_serialize(regex_t* regex, const char* path) {
+   if (regex->table == NULL) {
+      errno = ENOTSUP;
+      return -1;
+   }
+
+   size_t size;
+   const void* image = table_image(regex->table, &size);
+
+   FILE* file = fopen(path, "wb");
+   if (file == NULL) {
+      return -1;
+   }
+   size_t written = fwrite(image, 1, size, file);
+   if (fclose(file) != 0 || written != size) {
+      return -1;
+   }
+
+   return 0;
+}
+
+regex_t* regex_load_mmap(const char* path) {
+   int fd = open(path, O_RDONLY);
+   if (fd == -1) {
+      return NULL;
+   }
+
+   struct stat st;
+   if (fstat(fd, &st) == -1 || st.st_size == 0) {
+      close(fd);
+      return NULL;
+   }
+
+   // The mapping stays valid after the descriptor is closed
+   void* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (mapped == MAP_FAILED) {
+      return NULL;
+   }
 
-   dfa_t* dfa = dfa_from_nfa(nfa);
-   free_nfa(nfa);
+   dfa_table_t* table = table_from_image(mapped, st.st_size);
+   if (table == NULL) {
+      munmap(mapped, st.st_size);
+      return NULL;
+   }
 
-   // printf("\n");
-   // log_dfa(dfa);
+   regex_t* regex = xmalloc(sizeof(regex_t));
+   regex->pattern = (char*)table->pattern;
+   regex->table = table;
+   regex->sim = NULL;
+   memset(&regex->__stats, 0, sizeof regex->__stats);
+   regex->__mapped = mapped;
+   regex->__mapped_size = st.st_size;
+   regex->__refs = 1;
+   regex_maybe_jit(regex, table->header->flags);
 
-   return dfa;
+   return regex;
+}
+
+int regex_emit_c(regex_t* regex, FILE* out, const char* function_name) {
+   if (regex->table == NULL) {
+      return -1;
+   }
+   return codegen_emit_c(regex->table, out, function_name);
+}
+
+regex_generator_t* new_regex_generator(regex_t* regex, unsigned int seed) {
+   if (regex->table == NULL) {
+      return NULL;
+   }
+   regex_generator_t* generator = xmalloc(sizeof(regex_generator_t));
+   generator->regex = regex_retain(regex);
+   generator->sampler = new_table_sampler(regex->table);
+   generator->seed = seed;
+   return generator;
+}
+
+int regex_generate(regex_generator_t* generator, char* out, int size, int length) {
+   return table_sample_accepted(generator->sampler, out, size, length, &generator->seed);
+}
+
+int regex_generate_near_miss(regex_generator_t* generator, char* out, int size, int length) {
+   return table_sample_near_miss(generator->sampler, out, size, length, &generator->seed);
+}
+
+void free_regex_generator(regex_generator_t* generator) {
+   free_table_sampler(generator->sampler);
+   regex_release(generator->regex);
+   free(generator);
+}
+
+// Copies the pattern into a new regex with one reference and no matcher yet
+static regex_t* regex_alloc(char* pattern) {
+   regex_t* regex = xmalloc(sizeof(regex_t));
+   regex->pattern = xmalloc(sizeof(char) * (strlen(pattern) + 1));
+   strcpy(regex->pattern, pattern);
+   regex->table = NULL;
+   regex->sim = NULL;
+   regex->jit = NULL;
+   regex->__mapped = NULL;
+   regex->__mapped_size = 0;
+   regex->__refs = 1;
+   return regex;
+}
+
+// Falls back to the table when the architecture isn't supported or the table is too large, and
+// always in profiling builds (the generated code doesn't count)
+static void regex_maybe_jit(regex_t* regex, int flags) {
+#ifdef SREGEX_PROFILE
+   regex->jit = NULL;
+#else
+   regex->jit = (flags & REGEX_FLAG_JIT) ? jit_compile(regex->table) : NULL;
+#endif
+}
+
+static bool regex_accepts_len(regex_t* regex, char* input, int len) {
+   if (regex->jit != NULL) {
+      return jit_accepts(regex->jit, input, len);
+   }
+   if (regex->sim != NULL) {
+      return nfa_sim_accepts(regex->sim, input, len);
+   }
+   return table_accepts(regex->table, input, len);
+}
+
+// Parses, optimizes and builds the (simplified) nfa, timing each phase into stats
+static nfa_t* regex_parse(arena_t* arena, char* pattern, int flags, regex_error_t* error,
+                          regex_stats_t* stats) {
+   double lap = monotonic_seconds();
+   parse_error_t parse_error;
+   ast_node_t* ast = parse_regex_with_error(arena, pattern, &parse_error);
+   stats->parse_seconds = regex_lap(&lap);
+   if (ast == NULL) {
+      error->code = REGEX_ERROR_SYNTAX;
+      error->position = parse_error.position;
+      error->length = 0;
+      error->message = parse_error.message;
+      return NULL;
+   }
+   error->code = REGEX_ERROR_NONE;
+   error->position = 0;
+   error->length = 0;
+   error->message = NULL;
+
+   stats->ast_nodes = ast_num_nodes(ast);
+   lap = monotonic_seconds();
+   ast = optimize_ast(arena, ast);
+   stats->optimize_seconds = regex_lap(&lap);
+   stats->optimized_ast_nodes = ast_num_nodes(ast);
+
+   lap = monotonic_seconds();
+   nfa_t* nfa = regex_nfa_from_ast(arena, ast, flags);
+   stats->nfa_seconds = regex_lap(&lap);
+
+   nfa_stats_t counts;
+   nfa_stats(nfa, &counts);
+   stats->nfa_states = counts.num_states;
+   stats->nfa_edges = counts.num_edges;
+   return nfa;
+}
+
+static nfa_t* regex_nfa_from_ast(arena_t* arena, ast_node_t* ast, int flags) {
+   int nfa_flags = NFA_FLAG_NONE;
+   if (flags & REGEX_FLAG_CASE_INSENSITIVE) {
+      nfa_flags |= NFA_FLAG_CASE_INSENSITIVE;
+   }
+
+   nfa_t* nfa = nfa_from_ast_with_flags(arena, ast, nfa_flags);
+   nfa_simplify(nfa);
+   return nfa;
+}
+
+// Returns the seconds since *lap and starts the next lap
+static double regex_lap(double* lap) {
+   double now = monotonic_seconds();
+   double seconds = now - *lap;
+   *lap = now;
+   return seconds;
+}
+
+/**
+ * Compile limits
+*/
+
+static dfa_limits_t regex_limits(const regex_options_t* options, double start) {
+   dfa_limits_t limits = {
+       .max_states = options->max_states,
+       .max_bytes = options->max_bytes,
+       .bytes_per_state = TABLE_BUILD_BYTES_PER_STATE,
+       .deadline = options->max_seconds > 0 ? start + options->max_seconds : 0,
+   };
+   return limits;
+}
+
+static void regex_limit_error(DFALimit exceeded, regex_error_t* error) {
+   error->code = REGEX_ERROR_LIMIT;
+   switch (exceeded) {
+      case DFA_LIMIT_STATES:
+         error->message = "Too many dfa states";
+         break;
+      case DFA_LIMIT_BYTES:
+         error->message = "Too much memory";
+         break;
+      default:
+         error->message = "Took too long to compile";
+         break;
+   }
+}
+
+// Narrows a limit error down to the part of the pattern that causes it. Starting from the whole
+// pattern, descends into any child that exceeds the limits on its own; in a concatenation where no
+// single child does, keeps the shortest run of children that still does ('(a|b)*a(a|b)(a|b)...'
+// blows up only as a whole). Every trial compiles the unoptimized subexpression under the same
+// limits, and the search gives up after max_seconds or REGEX_MAX_BLOWUP_TRIALS trials: no trial
+// runs past the search's deadline, so the whole search takes about max_seconds at most.
+static void regex_locate_blowup(char* pattern, const regex_options_t* options,
+                                regex_error_t* error) {
+   arena_t* arena = new_arena();
+   ast_node_t* node = parse_regex(arena, pattern);
+   int trials = REGEX_MAX_BLOWUP_TRIALS;
+   double deadline = options->max_seconds > 0 ? monotonic_seconds() + options->max_seconds : 0;
+   error->position = 0;
+   error->length = strlen(pattern);
+
+   while (node != NULL) {
+      if (node->start >= 0) {
+         error->position = node->start;
+         error->length = node->end - node->start;
+      }
+      if (trials <= 0) {
+         break;
+      }
+
+      ast_node_t** children;
+      int num_children = ast_node_children(node, &children);
+      ast_node_t* culprit = NULL;
+      for (int i = 0; i < num_children && culprit == NULL; i++) {
+         if (regex_exceeds_limits(&children[i], 1, options, deadline, &trials)) {
+            culprit = children[i];
+         }
+      }
+      if (culprit == NULL && node->kind == NODE_KIND_CONCAT) {
+         // The shortest prefix that exceeds the limits, then as few of its children as still do
+         int last = num_children - 1;
+         for (int i = 1; i < num_children - 1; i++) {
+            if (regex_exceeds_limits(children, i + 1, options, deadline, &trials)) {
+               last = i;
+               break;
+            }
+         }
+         int first = 0;
+         while (first + 1 < last &&
+                regex_exceeds_limits(&children[first + 1], last - first, options, deadline,
+                                     &trials)) {
+            first++;
+         }
+         error->position = children[first]->start;
+         error->length = children[last]->end - children[first]->start;
+      }
+      node = culprit;
+   }
+
+   arena_release(arena);
+}
+
+// Returns true if a concatenation of the nodes exceeds the limits when compiled on its own. Returns
+// false once the trials run out or the search's deadline passes (and uses up the trials then), so
+// the search stops descending. A trial gets max_seconds, but no more than the search has left.
+static bool regex_exceeds_limits(ast_node_t** nodes, int num_nodes,
+                                 const regex_options_t* options, double deadline, int* trials) {
+   double now = monotonic_seconds();
+   if (*trials <= 0 || (deadline > 0 && now > deadline)) {
+      *trials = 0;
+      return false;
+   }
+   (*trials)--;
+
+   ast_node_concat_t concat = {
+       .num_children = num_nodes,
+       .children_capacity = num_nodes,
+       .children = nodes,
+   };
+   ast_node_t concat_node = {.kind = NODE_KIND_CONCAT, .concat = &concat};
+   ast_node_t* ast = num_nodes == 1 ? nodes[0] : &concat_node;
+
+   arena_t* arena = new_arena();
+   dfa_limits_t limits = regex_limits(options, now);
+   // Running out of the search's time says nothing about the nodes
+   bool cut_short = deadline > 0 && deadline < limits.deadline;
+   if (cut_short) {
+      limits.deadline = deadline;
+   }
+   nfa_t* nfa = regex_nfa_from_ast(arena, ast, options->flags);
+   bool exceeds = dfa_from_nfa_with_limits(arena, nfa, &limits) == NULL;
+   arena_release(arena);
+
+   if (exceeds && cut_short && limits.exceeded == DFA_LIMIT_TIME) {
+      *trials = 0;
+      return false;
+   }
+   return exceeds;
 }
@@ -4,8 +4,81 @@
 #define SREGEX_H
 
 #include <stdbool.h>
+#include <stdio.h>
 
 typedef struct regex regex_t;
+typedef struct regex_generator regex_generator_t;
+
+typedef enum {
+   REGEX_FLAG_NONE = 0,
+   REGEX_FLAG_CASE_INSENSITIVE = 1 << 0,  // 'a' and 'A' match each other
+   REGEX_FLAG_JIT = 1 << 1,  // Compile the matcher to native code (x86-64 only, ignored elsewhere)
+} RegexFlag;
+
+typedef enum {
+   REGEX_ERROR_NONE = 0,
+   REGEX_ERROR_SYNTAX = 1,  // The pattern isn't a valid regex
+   REGEX_ERROR_LIMIT = 2,   // Compiling the pattern exceeded a limit of its regex_options_t
+} RegexErrorCode;
+
+typedef struct regex_error {
+      RegexErrorCode code;
+      int position;         // offset in the pattern the error refers to
+      int length;           // length of the part of the pattern it refers to (0 for syntax errors)
+      const char* message;  // static description, null if code is REGEX_ERROR_NONE
+} regex_error_t;
+
+typedef enum {
+   REGEX_ENGINE_TABLE = 0,           // table interpreter over the dfa
+   REGEX_ENGINE_JIT = 1,             // native code generated from the table (REGEX_FLAG_JIT)
+   REGEX_ENGINE_NFA_SIMULATION = 2,  // a compile limit was exceeded (see regex_options_t.fallback)
+} RegexEngine;
+
+typedef enum {
+   REGEX_PROFILE_JSON = 0,  // totals, byte classes, and per state its visits and transitions taken
+   REGEX_PROFILE_DOT = 1,   // Graphviz graph of the dfa, labelled with the same counts
+} RegexProfileFormat;
+
+/**
+ * What compiling a regex produced and how long each phase took. Regexes loaded with
+ * regex_load_mmap() weren't compiled in this process, so only the fields that come from the table
+ * are filled in for them (the counts of earlier phases and the timings are 0).
+ */
+typedef struct regex_stats {
+      RegexEngine engine;
+      int ast_nodes;            // as parsed
+      int optimized_ast_nodes;  // after optimize_ast()
+      int nfa_states;           // after simplification
+      int nfa_edges;            // each edge carries a set of bytes
+      int dfa_states;           // 0 with REGEX_ENGINE_NFA_SIMULATION
+      int alphabet_size;        // distinct bytes the pattern can consume
+      int byte_classes;         // columns of the table (bytes no state tells apart share one)
+      size_t table_bytes;       // size of the table image (what regex_serialize() writes)
+      size_t jit_bytes;         // size of the generated code, 0 without REGEX_ENGINE_JIT
+      // Wall time of each compile phase, in seconds
+      double parse_seconds;
+      double optimize_seconds;
+      double nfa_seconds;          // building and simplifying the nfa
+      double determinize_seconds;  // subset construction (no separate minimization pass)
+      double table_seconds;        // flattening the dfa into a table, and jitting it
+      double total_seconds;        // everything above, plus locating a limit error
+} regex_stats_t;
+
+/**
+ * Bounds on compiling one pattern, so that a pathological pattern can't exhaust a shared process.
+ * Building the dfa is the only step that isn't linear in the pattern length (it can make
+ * exponentially many states), so that's where the limits are checked. Zero means no limit.
+ */
+typedef struct regex_options {
+      int flags;           // bitwise-or of RegexFlag values
+      int max_states;      // most dfa states to build
+      size_t max_bytes;    // most memory to use while compiling, the dfa's table included
+      double max_seconds;  // longest to spend compiling
+      bool fallback;       // when a limit is hit, match by simulating the nfa instead of failing
+      // when a limit is hit, report the whole pattern instead of looking for the subexpression that
+      // exceeds it (which compiles up to 256 of them), e.g. to time just the fallback
+      bool skip_locate;
+} regex_options_t;
 
 /**
  * Returns true if the regex accepts the provided string (exact match).
@@ -23,7 +96,168 @@ bool regex_accepts(regex_t*, char*);
 */
 bool regex_test(regex_t*, char*);
 
+/**
+ * Compiles a regex. The returned regex holds one reference (see regex_retain/regex_release).
+ * Compilation keeps no global state, so any number of threads may compile at once. Parsing and
+ * building the nfa and dfa don't recurse. The ast optimizer and its node comparisons do, to the
+ * depth of the ast, so patterns nested deeper than OPTIMIZE_MAX_DEPTH (1000 levels, see parse.c)
+ * are compiled without optimizing; that bounds the recursion, so no pattern can overflow the stack.
+ * Time and memory aren't bounded: a pattern can make exponentially many dfa states, and a large one
+ * a very large table. To bound those, compile with new_regex_with_options() and regex_options_t.
+ * @return the regex, or null if the pattern is invalid
+*/
 regex_t* new_regex(char*);
+
+/**
+ * Compiles a regex using a bitwise-or of RegexFlag values.
+ * Case-insensitivity is compiled into the automaton, so matching costs the same as without it.
+ * @param pattern The pattern to compile (null-terminated)
+ * @param flags Bitwise-or of RegexFlag values
+*/
+regex_t* new_regex_with_flags(char*, int);
+
+/**
+ * Compiles a regex like new_regex_with_flags(), and describes why an invalid pattern failed.
+ * @param pattern The pattern to compile (null-terminated)
+ * @param flags Bitwise-or of RegexFlag values
+ * @param error Set to REGEX_ERROR_NONE on success, or to the error and where in the pattern it is
+ * @return the regex, or null if the pattern is invalid
+*/
+regex_t* new_regex_with_error(char*, int, regex_error_t*);
+
+/**
+ * Compiles a regex within the limits of the options. When a limit is exceeded the error is
+ * REGEX_ERROR_LIMIT, and its position and length give the smallest subexpression found to exceed
+ * the limits on its own (looking for it takes up to about max_seconds more), or the whole pattern
+ * with skip_locate. With fallback, the regex is still returned along with the error: it matches by
+ * simulating the nfa, in time proportional to the input length times the pattern length, and can't
+ * be serialized, emitted as C or jitted.
+ * @param pattern The pattern to compile (null-terminated)
+ * @param options The flags and limits to compile with
+ * @param error Set to REGEX_ERROR_NONE on success, or to the error and the part of the pattern it
+ * refers to
+ * @return the regex, or null if the pattern is invalid or exceeds a limit without fallback
+*/
+regex_t* new_regex_with_options(char*, const regex_options_t*, regex_error_t*);
+
+/**
+ * Describes how the regex was compiled (sizes of each stage, the engine and time per phase), e.g.
+ * for exporting as metrics per loaded rule.
+ * @param regex The regex to describe
+ * @param stats Filled in with the regex's statistics
+*/
+void regex_stats(regex_t*, regex_stats_t*);
+
+/**
+ * Writes what matching with the regex has done so far: matches, bytes scanned, how often each dfa
+ * state was visited and each transition (per byte class) was taken. Counting is only compiled into
+ * builds with SREGEX_PROFILE defined (make PROFILE=1), which also leave out the jit so that every
+ * match goes through the counting table interpreter. Normal builds match with no overhead.
+ * @param regex The regex whose profile to write
+ * @param out The stream to write to
+ * @param format One of RegexProfileFormat
+ * @return 0 on success, -1 if the build doesn't profile, the regex fell back to nfa simulation or
+ * writing fails
+*/
+int regex_profile_write(regex_t*, FILE*, RegexProfileFormat);
+
+/**
+ * Zeroes the regex's profile counters (no-op unless built with SREGEX_PROFILE).
+*/
+void regex_profile_reset(regex_t*);
+
+/**
+ * Returns a new regex matching the same strings with its table reordered for a workload: states
+ * the samples visit most come first, and states they never reach are stored sparsely (see
+ * table_relayout()). Without samples, a profiling build uses the regex's profile if it has counted
+ * matches, and any other build only reorders states breadth-first. The regex itself is unchanged,
+ * since it may be shared; the new one can be serialized like any other.
+ * @param regex The regex to relayout
+ * @param samples Typical inputs, or null
+ * @param num_samples The number of samples
+ * @return A regex with one reference, or null if the regex fell back to nfa simulation
+*/
+regex_t* regex_relayout(regex_t*, char** samples, int num_samples);
+
+/**
+ * Adds a reference to the regex so it can be shared (e.g. between threads). Matching never
+ * modifies a regex, so a shared regex can be used concurrently.
+ * @return the regex
+*/
+regex_t* regex_retain(regex_t*);
+
+/**
+ * Drops a reference to the regex, freeing it when the last reference is dropped.
+*/
 void regex_release(regex_t*);
 
+/**
+ * Writes the compiled regex to a file in a versioned, position-independent format that
+ * regex_load_mmap() can map back without recompiling.
+ * @param regex The regex to write
+ * @param path The file to create or overwrite
+ * @return 0 on success, -1 on failure (errno describes the failure, ENOTSUP if the regex has no dfa
+ * because it fell back to nfa simulation)
+*/
+int regex_serialize(regex_t*, const char*);
+
+/**
+ * Loads a regex written by regex_serialize(). The file is mapped read-only and the regex points
+ * straight into it, so nothing is parsed or copied and forked processes share the pages.
+ * @param path The file to load
+ * @return the regex, or null if the file can't be mapped or isn't a valid compiled regex
+*/
+regex_t* regex_load_mmap(const char*);
+
+/**
+ * Writes standalone C source for `bool <function_name>(const char* str, size_t len)`, which
+ * returns the same result as regex_accepts() using static const tables and no runtime dependency
+ * on this library.
+ * @param regex The regex to generate a matcher for
+ * @param out The stream to write the source to
+ * @param function_name Name of the generated function (must be a valid C identifier)
+ * @return 0 on success, -1 on failure (or if the regex fell back to nfa simulation)
+*/
+int regex_emit_c(regex_t*, FILE*, const char*);
+
+/**
+ * Creates a generator of random strings for a regex, e.g. to build benchmark corpora or test cases
+ * from the pattern alone. It walks the compiled dfa, so generating takes time proportional to the
+ * string's length times the number of byte classes. Generated strings never contain a newline.
+ * The generator holds a reference to the regex. It isn't thread-safe: give each thread its own.
+ * @param regex The regex to generate strings for
+ * @param seed Seed of the generator's random numbers (the same seed gives the same strings)
+ * @return the generator, or null if the regex fell back to nfa simulation
+*/
+regex_generator_t* new_regex_generator(regex_t*, unsigned int);
+
+/**
+ * Writes a random string the regex accepts, of about the given length: the shortest way to an
+ * accepted string from where length bytes lead, or shorter if the regex accepts nothing longer.
+ * @param generator The generator
+ * @param out Where to write the string (null-terminated)
+ * @param size Size of out
+ * @param length Length to aim for
+ * @return the length of the string, or -1 if the regex accepts no string shorter than size
+*/
+int regex_generate(regex_generator_t*, char*, int, int);
+
+/**
+ * Writes a random string the regex rejects that is one edit away from an accepted string of about
+ * the given length: a byte replaced, a byte appended, or the string cut short. A replaced or
+ * appended byte is any byte the regex rejects there, so it needn't be printable: for ".*" it is
+ * '\r' or a byte from 0x80 up, which no pattern matches.
+ * @param generator The generator
+ * @param out Where to write the string (null-terminated)
+ * @param size Size of out
+ * @param length Length to aim for
+ * @return the length of the string, or -1 if the regex accepts no string shorter than size to edit
+*/
+int regex_generate_near_miss(regex_generator_t*, char*, int, int);
+
+/**
+ * Frees the generator and releases its reference to the regex.
+*/
+void free_regex_generator(regex_generator_t*);
+
 #endif  // SREGEX_H
@@ -0,0 +1,575 @@
+#include "table.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+#define ALIGN_UP(n, a) (((n) + (a)-1) & ~((size_t)(a)-1))
+
+// A table before it's laid out in an image: one full row per state, in the final numbering
+typedef struct table_rows {
+      int num_states;
+      int num_classes;
+      int num_dense;  // rows to keep in full, the others are stored sparsely
+      int start;
+      const uint8_t* classes;
+      const int32_t* rows;
+      const uint8_t* accepting;
+      const int32_t* rules;
+} table_rows_t;
+
+// Sort key of a state for table_relayout()
+typedef struct state_order {
+      uint64_t weight;
+      int rank;
+      int state;
+} state_order_t;
+
+static int* dense_transitions_from_dfa(dfa_t*);
+static int compute_byte_classes(int*, int, uint8_t*);
+static dfa_table_t* table_from_rows(const table_rows_t*, const char*, int);
+static int* breadth_first_ranks(dfa_table_t*);
+static int state_order_comparator(const void*, const void*);
+static int32_t sparse_next(dfa_table_t*, int32_t, int);
+static dfa_table_t* new_table(const table_header_t*, bool);
+static bool image_is_valid(const uint8_t*, size_t);
+#ifdef SREGEX_PROFILE
+static bool table_accepts_profiled(dfa_table_t*, char*, int);
+#else
+static bool table_accepts_sparse(dfa_table_t*, char*, int);
+#endif
+
+/**
+ * Public API
+*/
+
+dfa_table_t* table_from_dfa(dfa_t* dfa, char* pattern, int flags) {
+   int num_states = dfa->num_nodes;
+   int* dense = dense_transitions_from_dfa(dfa);
+
+   uint8_t classes[TABLE_NUM_BYTES];
+   int num_classes = compute_byte_classes(dense, num_states, classes);
+
+   // Any byte of a class can stand in for the whole class when filling in a row
+   int representatives[TABLE_NUM_BYTES];
+   for (int byte = TABLE_NUM_BYTES - 1; byte >= 0; byte--) {
+      representatives[classes[byte]] = byte;
+   }
+   int32_t* rows = xmalloc(sizeof(int32_t) * num_states * num_classes);
+   for (int state = 0; state < num_states; state++) {
+      for (int class = 0; class < num_classes; class++) {
+         rows[state * num_classes + class] =
+             dense[state * TABLE_NUM_BYTES + representatives[class]];
+      }
+   }
+   free(dense);
+
+   uint8_t* accepting = xmalloc(num_states);
+   int32_t* rules = xmalloc(sizeof(int32_t) * num_states);
+   list_node_t* current;
+   list_traverse(dfa->__nodes, current) {
+      dfa_node_t* node = (dfa_node_t*)current->data;
+      accepting[node->index] = node->is_accepting ? 1 : 0;
+      rules[node->index] = node->accepting_rule;
+   }
+
+   table_rows_t table_rows = {
+       .num_states = num_states,
+       .num_classes = num_classes,
+       .num_dense = num_states,
+       .start = dfa->start->index,
+       .classes = classes,
+       .rows = rows,
+       .accepting = accepting,
+       .rules = rules,
+   };
+   dfa_table_t* table = table_from_rows(&table_rows, pattern, flags);
+   free(rows);
+   free(accepting);
+   free(rules);
+
+   return table;
+}
+
+dfa_table_t* table_relayout(dfa_table_t* table, const uint64_t* weights) {
+   int num_states = table->num_states;
+   int num_classes = table->num_classes;
+
+   // Breadth-first ranks from the start order the states no weight tells apart
+   int* ranks = breadth_first_ranks(table);
+   state_order_t* order = xmalloc(sizeof(state_order_t) * num_states);
+   int num_dense = weights == NULL ? num_states : 0;
+   for (int state = 0; state < num_states; state++) {
+      order[state].weight = weights == NULL ? 0 : weights[state];
+      order[state].rank = ranks[state];
+      order[state].state = state;
+      num_dense += weights != NULL && weights[state] > 0 ? 1 : 0;
+   }
+   qsort(order, num_states, sizeof(state_order_t), state_order_comparator);
+
+   int* new_index = ranks;  // reused: every rank has been copied into order
+   for (int i = 0; i < num_states; i++) {
+      new_index[order[i].state] = i;
+   }
+
+   int32_t* rows = xmalloc(sizeof(int32_t) * num_states * num_classes);
+   uint8_t* accepting = xmalloc(num_states);
+   int32_t* rules = xmalloc(sizeof(int32_t) * num_states);
+   for (int i = 0; i < num_states; i++) {
+      int state = order[i].state;
+      for (int class = 0; class < num_classes; class++) {
+         int32_t next = table_next(table, state, class);
+         rows[i * num_classes + class] = next == TABLE_NO_TRANSITION ? next : new_index[next];
+      }
+      accepting[i] = table->accepting[state];
+      rules[i] = table->rules[state];
+   }
+
+   table_rows_t table_rows = {
+       .num_states = num_states,
+       .num_classes = num_classes,
+       .num_dense = num_dense > 0 ? num_dense : 1,
+       .start = new_index[table->start],
+       .classes = table->classes,
+       .rows = rows,
+       .accepting = accepting,
+       .rules = rules,
+   };
+   dfa_table_t* relaid = table_from_rows(&table_rows, table->pattern, table->header->flags);
+   free(rows);
+   free(accepting);
+   free(rules);
+   free(order);
+   free(new_index);
+
+   return relaid;
+}
+
+void table_count_visits(dfa_table_t* table, char* str, int len, uint64_t* visits) {
+   int32_t state = table->start;
+   visits[state]++;
+   for (int i = 0; i < len; i++) {
+      state = table_next(table, state, table->classes[(uint8_t)str[i]]);
+      if (state == TABLE_NO_TRANSITION) {
+         return;
+      }
+      visits[state]++;
+   }
+}
+
+int32_t table_next(dfa_table_t* table, int32_t state, int class) {
+   if (state < table->num_dense) {
+      return table->transitions[state * table->num_classes + class];
+   }
+   return sparse_next(table, state, class);
+}
+
+dfa_table_t* table_from_image(const void* image, size_t size) {
+   if (!image_is_valid(image, size)) {
+      return NULL;
+   }
+   return new_table((const table_header_t*)image, false);
+}
+
+const void* table_image(dfa_table_t* table, size_t* size) {
+   *size = table->header->size;
+   return table->header;
+}
+
+bool table_accepts(dfa_table_t* table, char* str, int len) {
+#ifdef SREGEX_PROFILE
+   return table_accepts_profiled(table, str, len);
+#else
+   if (table->num_dense < table->num_states) {
+      return table_accepts_sparse(table, str, len);
+   }
+   const uint8_t* classes = table->classes;
+   const int32_t* transitions = table->transitions;
+   int num_classes = table->num_classes;
+   int32_t state = table->start;
+
+   for (int i = 0; i < len; i++) {
+      state = transitions[state * num_classes + classes[(uint8_t)str[i]]];
+      if (state == TABLE_NO_TRANSITION) {
+         return false;
+      }
+   }
+
+   return table->accepting[state];
+#endif
+}
+
+void free_table(dfa_table_t* table) {
+   if (table->__owns_image) {
+      free((void*)table->header);
+   }
+   if (table->profile != NULL) {
+      free_table_profile(table->profile);
+   }
+   free(table);
+}
+
+void log_table(dfa_table_t* table) {
+   printf("Table (start - %d, states - %d, classes - %d, bytes - %u):\n", table->start,
+          table->num_states, table->num_classes, table->header->size);
+
+   for (int class = 0; class < table->num_classes; class++) {
+      printf("Class %d:", class);
+      for (int byte = 0; byte < TABLE_NUM_BYTES; byte++) {
+         if (table->classes[byte] == class && byte >= LITERAL_START && byte <= LITERAL_END) {
+            printf(" %c", byte);
+         } else if (table->classes[byte] == class) {
+            printf(" \\x%02x", byte);
+         }
+      }
+      printf("\n");
+   }
+
+   for (int state = 0; state < table->num_states; state++) {
+      printf("State %d - %s\n", state, table->accepting[state] ? "accepting" : "not accepting");
+      for (int class = 0; class < table->num_classes; class++) {
+         int32_t next = table_next(table, state, class);
+         if (next != TABLE_NO_TRANSITION) {
+            printf("    Class %d -> %d\n", class, next);
+         }
+      }
+   }
+}
+
+/**
+ * Helpers (private)
+*/
+
+// Returns a num_states * 256 table of next states (-1 where there is no transition)
+static int* dense_transitions_from_dfa(dfa_t* dfa) {
+   int* dense = xmalloc(sizeof(int) * dfa->num_nodes * TABLE_NUM_BYTES);
+   for (int i = 0; i < dfa->num_nodes * TABLE_NUM_BYTES; i++) {
+      dense[i] = TABLE_NO_TRANSITION;
+   }
+
+   list_node_t* current;
+   list_traverse(dfa->__nodes, current) {
+      dfa_node_t* node = (dfa_node_t*)current->data;
+
+      list_node_t* current_edge;
+      list_traverse(node->edges, current_edge) {
+         dfa_edge_t* edge = (dfa_edge_t*)current_edge->data;
+         dense[node->index * TABLE_NUM_BYTES + (uint8_t)edge->value] = edge->to->index;
+      }
+   }
+
+   return dense;
+}
+
+// Partitions the bytes into classes by refining the partition against each state's row: two bytes
+// stay in the same class only if every state sends them to the same next state.
+static int compute_byte_classes(int* dense, int num_states, uint8_t* classes) {
+   int num_classes = 1;
+   memset(classes, 0, TABLE_NUM_BYTES);
+
+   for (int state = 0; state < num_states; state++) {
+      int* row = &dense[state * TABLE_NUM_BYTES];
+      // (old class, next state) pairs seen so far in this row; the pair's index is its new class
+      int pair_class[TABLE_NUM_BYTES];
+      int pair_next[TABLE_NUM_BYTES];
+      int num_pairs = 0;
+
+      for (int byte = 0; byte < TABLE_NUM_BYTES; byte++) {
+         int new_class = -1;
+         for (int i = 0; i < num_pairs; i++) {
+            if (pair_class[i] == classes[byte] && pair_next[i] == row[byte]) {
+               new_class = i;
+               break;
+            }
+         }
+         if (new_class == -1) {
+            new_class = num_pairs++;
+            pair_class[new_class] = classes[byte];
+            pair_next[new_class] = row[byte];
+         }
+         classes[byte] = new_class;
+      }
+      num_classes = num_pairs;
+   }
+
+   return num_classes;
+}
+
+// Lays out the image: header, byte classes, the dense rows, the sparse rows' (class, next state)
+// entries, acceptance, rules and the pattern, keeping the 4-byte sections aligned
+static dfa_table_t* table_from_rows(const table_rows_t* t, const char* pattern, int flags) {
+   int num_sparse = t->num_states - t->num_dense;
+   int num_entries = 0;
+   for (size_t i = (size_t)t->num_dense * t->num_classes;
+        i < (size_t)t->num_states * t->num_classes; i++) {
+      num_entries += t->rows[i] != TABLE_NO_TRANSITION ? 1 : 0;
+   }
+
+   size_t classes_offset = ALIGN_UP(sizeof(table_header_t), sizeof(int32_t));
+   size_t transitions_offset = ALIGN_UP(classes_offset + TABLE_NUM_BYTES, sizeof(int32_t));
+   size_t sparse_rows_offset =
+       transitions_offset + sizeof(int32_t) * (size_t)t->num_dense * (size_t)t->num_classes;
+   size_t sparse_entries_offset = sparse_rows_offset + sizeof(uint32_t) * (num_sparse + 1);
+   size_t rules_offset = sparse_entries_offset + sizeof(int32_t) * 2 * (size_t)num_entries;
+   size_t accepting_offset = rules_offset + sizeof(int32_t) * t->num_states;
+   size_t pattern_offset = accepting_offset + t->num_states;
+   size_t size = ALIGN_UP(pattern_offset + strlen(pattern) + 1, sizeof(int32_t));
+
+   uint8_t* image = xmalloc(size);
+   memset(image, 0, size);
+
+   table_header_t* header = (table_header_t*)image;
+   memcpy(header->magic, TABLE_MAGIC, sizeof header->magic);
+   header->version = TABLE_VERSION;
+   header->size = size;
+   header->flags = flags;
+   header->num_states = t->num_states;
+   header->num_classes = t->num_classes;
+   header->num_dense = t->num_dense;
+   header->num_sparse_entries = num_entries;
+   header->start = t->start;
+   header->classes_offset = classes_offset;
+   header->transitions_offset = transitions_offset;
+   header->sparse_rows_offset = sparse_rows_offset;
+   header->sparse_entries_offset = sparse_entries_offset;
+   header->accepting_offset = accepting_offset;
+   header->rules_offset = rules_offset;
+   header->pattern_offset = pattern_offset;
+
+   memcpy(image + classes_offset, t->classes, TABLE_NUM_BYTES);
+   memcpy(image + transitions_offset, t->rows,
+          sizeof(int32_t) * (size_t)t->num_dense * (size_t)t->num_classes);
+
+   uint32_t* sparse_rows = (uint32_t*)(image + sparse_rows_offset);
+   int32_t* sparse_entries = (int32_t*)(image + sparse_entries_offset);
+   int entry = 0;
+   for (int state = t->num_dense; state < t->num_states; state++) {
+      sparse_rows[state - t->num_dense] = entry;
+      for (int class = 0; class < t->num_classes; class++) {
+         int32_t next = t->rows[(size_t)state * t->num_classes + class];
+         if (next != TABLE_NO_TRANSITION) {
+            sparse_entries[2 * entry] = class;
+            sparse_entries[2 * entry + 1] = next;
+            entry++;
+         }
+      }
+   }
+   sparse_rows[num_sparse] = entry;
+
+   memcpy(image + accepting_offset, t->accepting, t->num_states);
+   memcpy(image + rules_offset, t->rules, sizeof(int32_t) * t->num_states);
+   strcpy((char*)image + pattern_offset, pattern);
+
+   return new_table(header, true);
+}
+
+// Numbers the states in the order a breadth-first search from the start reaches them (states it
+// can't reach come last)
+static int* breadth_first_ranks(dfa_table_t* table) {
+   int num_states = table->num_states;
+   int* ranks = xmalloc(sizeof(int) * num_states);
+   int* queue = xmalloc(sizeof(int) * num_states);
+   for (int state = 0; state < num_states; state++) {
+      ranks[state] = -1;
+   }
+
+   int head = 0;
+   int tail = 0;
+   ranks[table->start] = tail;
+   queue[tail++] = table->start;
+   while (head < tail) {
+      int state = queue[head++];
+      for (int class = 0; class < table->num_classes; class++) {
+         int32_t next = table_next(table, state, class);
+         if (next != TABLE_NO_TRANSITION && ranks[next] == -1) {
+            ranks[next] = tail;
+            queue[tail++] = next;
+         }
+      }
+   }
+   for (int state = 0; state < num_states; state++) {
+      if (ranks[state] == -1) {
+         ranks[state] = tail++;
+      }
+   }
+
+   free(queue);
+   return ranks;
+}
+
+// Heaviest first, then by breadth-first rank
+static int state_order_comparator(const void* data1, const void* data2) {
+   const state_order_t* a = data1;
+   const state_order_t* b = data2;
+   if (a->weight != b->weight) {
+      return a->weight > b->weight ? -1 : 1;
+   }
+   return a->rank - b->rank;
+}
+
+// Sparse rows are short (the states had few or no visits), so a linear scan is enough
+static int32_t sparse_next(dfa_table_t* table, int32_t state, int class) {
+   const uint32_t* row = &table->sparse_rows[state - table->num_dense];
+   for (uint32_t entry = row[0]; entry < row[1]; entry++) {
+      if (table->sparse_entries[2 * entry] == class) {
+         return table->sparse_entries[2 * entry + 1];
+      }
+   }
+   return TABLE_NO_TRANSITION;
+}
+
+#ifndef SREGEX_PROFILE
+// table_accepts() for tables with sparse states: the hot (dense) states still take one load
+static bool table_accepts_sparse(dfa_table_t* table, char* str, int len) {
+   const uint8_t* classes = table->classes;
+   const int32_t* transitions = table->transitions;
+   int num_classes = table->num_classes;
+   int num_dense = table->num_dense;
+   int32_t state = table->start;
+
+   for (int i = 0; i < len; i++) {
+      int class = classes[(uint8_t)str[i]];
+      state = state < num_dense ? transitions[state * num_classes + class]
+                                : sparse_next(table, state, class);
+      if (state == TABLE_NO_TRANSITION) {
+         return false;
+      }
+   }
+
+   return table->accepting[state];
+}
+#endif
+
+static dfa_table_t* new_table(const table_header_t* header, bool owns_image) {
+   const uint8_t* image = (const uint8_t*)header;
+
+   dfa_table_t* table = xmalloc(sizeof(dfa_table_t));
+   table->num_states = header->num_states;
+   table->num_classes = header->num_classes;
+   table->num_dense = header->num_dense;
+   table->start = header->start;
+   table->header = header;
+   table->classes = image + header->classes_offset;
+   table->transitions = (const int32_t*)(image + header->transitions_offset);
+   table->sparse_rows = (const uint32_t*)(image + header->sparse_rows_offset);
+   table->sparse_entries = (const int32_t*)(image + header->sparse_entries_offset);
+   table->accepting = image + header->accepting_offset;
+   table->rules = (const int32_t*)(image + header->rules_offset);
+   table->pattern = (const char*)(image + header->pattern_offset);
+   table->__owns_image = owns_image;
+#ifdef SREGEX_PROFILE
+   table->profile = new_table_profile(table->num_states, table->num_classes);
+#else
+   table->profile = NULL;
+#endif
+
+   return table;
+}
+
+#ifdef SREGEX_PROFILE
+// table_accepts() counting every state entered and transition looked up. The counters are shared
+// by every thread matching with the table, hence the atomics.
+static bool table_accepts_profiled(dfa_table_t* table, char* str, int len) {
+   table_profile_t* profile = table->profile;
+   const uint8_t* classes = table->classes;
+   int num_classes = table->num_classes;
+   int32_t state = table->start;
+   int scanned = 0;
+
+   __atomic_fetch_add(&profile->state_visits[state], 1, __ATOMIC_RELAXED);
+   while (scanned < len && state != TABLE_NO_TRANSITION) {
+      int class = classes[(uint8_t)str[scanned++]];
+      __atomic_fetch_add(&profile->transitions[state * num_classes + class], 1, __ATOMIC_RELAXED);
+      state = table_next(table, state, class);
+      if (state != TABLE_NO_TRANSITION) {
+         __atomic_fetch_add(&profile->state_visits[state], 1, __ATOMIC_RELAXED);
+      }
+   }
+
+   bool accepted = state != TABLE_NO_TRANSITION && table->accepting[state];
+   __atomic_fetch_add(&profile->matches, 1, __ATOMIC_RELAXED);
+   __atomic_fetch_add(&profile->accepted, accepted ? 1 : 0, __ATOMIC_RELAXED);
+   __atomic_fetch_add(&profile->bytes_scanned, scanned, __ATOMIC_RELAXED);
+   return accepted;
+}
+#endif
+
+// Checks that every section lies inside the image, so a truncated or foreign file can't make
+// table_accepts() read out of bounds
+static bool image_is_valid(const uint8_t* image, size_t size) {
+   if (size < sizeof(table_header_t)) {
+      return false;
+   }
+
+   const table_header_t* header = (const table_header_t*)image;
+   if (memcmp(header->magic, TABLE_MAGIC, sizeof header->magic) != 0 ||
+       header->version != TABLE_VERSION || header->size > size) {
+      return false;
+   }
+
+   size_t num_states = header->num_states;
+   size_t num_classes = header->num_classes;
+   size_t num_dense = header->num_dense;
+   size_t num_entries = header->num_sparse_entries;
+   if (num_states == 0 || header->start >= num_states || num_classes == 0 ||
+       num_classes > TABLE_NUM_BYTES || num_dense > num_states) {
+      return false;
+   }
+
+   size_t transitions_size = sizeof(int32_t) * num_dense * num_classes;
+   size_t sparse_rows_size = sizeof(uint32_t) * (num_states - num_dense + 1);
+   size_t sparse_entries_size = sizeof(int32_t) * 2 * num_entries;
+   if (header->classes_offset + (size_t)TABLE_NUM_BYTES > header->size ||
+       header->transitions_offset % sizeof(int32_t) != 0 ||
+       header->transitions_offset + transitions_size > header->size ||
+       header->sparse_rows_offset % sizeof(uint32_t) != 0 ||
+       header->sparse_rows_offset + sparse_rows_size > header->size ||
+       header->sparse_entries_offset % sizeof(int32_t) != 0 ||
+       header->sparse_entries_offset + sparse_entries_size > header->size ||
+       header->accepting_offset + num_states > header->size ||
+       header->rules_offset % sizeof(int32_t) != 0 ||
+       header->rules_offset + sizeof(int32_t) * num_states > header->size ||
+       header->pattern_offset >= header->size) {
+      return false;
+   }
+
+   const uint8_t* classes = image + header->classes_offset;
+   for (int byte = 0; byte < TABLE_NUM_BYTES; byte++) {
+      if (classes[byte] >= num_classes) {
+         return false;
+      }
+   }
+
+   const int32_t* transitions = (const int32_t*)(image + header->transitions_offset);
+   for (size_t i = 0; i < num_dense * num_classes; i++) {
+      if (transitions[i] != TABLE_NO_TRANSITION &&
+          (transitions[i] < 0 || transitions[i] >= (int32_t)num_states)) {
+         return false;
+      }
+   }
+
+   // Sparse rows must cover the entries in order, each entry naming a class and a state
+   const uint32_t* sparse_rows = (const uint32_t*)(image + header->sparse_rows_offset);
+   for (size_t i = 0; i < num_states - num_dense; i++) {
+      if (sparse_rows[i] > sparse_rows[i + 1]) {
+         return false;
+      }
+   }
+   if (sparse_rows[0] != 0 || sparse_rows[num_states - num_dense] != num_entries) {
+      return false;
+   }
+   const int32_t* sparse_entries = (const int32_t*)(image + header->sparse_entries_offset);
+   for (size_t i = 0; i < num_entries; i++) {
+      if (sparse_entries[2 * i] < 0 || sparse_entries[2 * i] >= (int32_t)num_classes ||
+          sparse_entries[2 * i + 1] < 0 || sparse_entries[2 * i + 1] >= (int32_t)num_states) {
+         return false;
+      }
+   }
+
+   return memchr(image + header->pattern_offset, '\0', header->size - header->pattern_offset) !=
+          NULL;
+}
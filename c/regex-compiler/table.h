@@ -0,0 +1,122 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dfa.h"
+#include "profile.h"
+
+#define TABLE_MAGIC "SREGEX\0"  // 8 bytes including the implicit null terminator
+#define TABLE_VERSION 3
+#define TABLE_NUM_BYTES 256
+#define TABLE_NO_TRANSITION -1
+// Most memory table_from_dfa() takes per dfa state: a transition for every byte, and the rows by
+// byte class (then the image) made from them
+#define TABLE_BUILD_BYTES_PER_STATE (2 * TABLE_NUM_BYTES * sizeof(int32_t))
+
+typedef struct dfa_table dfa_table_t;
+typedef struct table_header table_header_t;
+
+/**
+ * A compiled dfa is a single contiguous image: this header followed by the sections it points to.
+ * All offsets are relative to the start of the image so it can be written to disk and mapped back
+ * at any address. Values are stored in native byte order.
+ * The first num_dense states have a full row of the transition table. The others (only after
+ * table_relayout()) keep just their transitions as (class, next state) pairs, sorted by class.
+ */
+struct table_header {
+      char magic[8];
+      uint32_t version;
+      uint32_t size;  // size of the whole image in bytes
+      uint32_t flags;  // flags the pattern was compiled with
+      uint32_t num_states;
+      uint32_t num_classes;
+      uint32_t num_dense;  // states with a full row (0 to num_dense - 1)
+      uint32_t num_sparse_entries;
+      uint32_t start;
+      uint32_t classes_offset;      // uint8_t[256]: byte -> byte class
+      uint32_t transitions_offset;  // int32_t[num_dense * num_classes]: next state or -1
+      // uint32_t[num_states - num_dense + 1]: first entry of each sparse state, then the end
+      uint32_t sparse_rows_offset;
+      uint32_t sparse_entries_offset;  // int32_t[2 * num_sparse_entries]: (class, next state)
+      uint32_t accepting_offset;       // uint8_t[num_states]
+      uint32_t rules_offset;           // int32_t[num_states]: accepted rule (see nfa_union) or -1
+      uint32_t pattern_offset;         // null-terminated pattern the image was compiled from
+};
+
+struct dfa_table {
+      int num_states;
+      int num_classes;
+      int num_dense;
+      int start;
+      const table_header_t* header;
+      const uint8_t* classes;
+      const int32_t* transitions;
+      const uint32_t* sparse_rows;
+      const int32_t* sparse_entries;
+      const uint8_t* accepting;
+      const int32_t* rules;
+      const char* pattern;
+      table_profile_t* profile;  // null unless built with SREGEX_PROFILE (see profile.h)
+      bool __owns_image;
+};
+
+/**
+ * Flattens a dfa into a table. Bytes that transition identically from every state share a byte
+ * class, so a row of the table has one column per class instead of one per byte.
+ */
+dfa_table_t* table_from_dfa(dfa_t*, char* pattern, int flags);
+
+/**
+ * Returns a new table with the states renumbered so that the heaviest come first, and so share the
+ * first cache lines of the transition table. Ties, and every state when weights is null, are
+ * ordered by breadth-first distance from the start. With weights, states of weight 0 lose their
+ * full row and keep only their transitions (see table_header_t), which shrinks tables whose
+ * workload only reaches a small part of the dfa.
+ * @param weights num_states weights, e.g. visits counted by table_count_visits() or a profile
+ */
+dfa_table_t* table_relayout(dfa_table_t*, const uint64_t* weights);
+
+/**
+ * Adds one to visits[state] for every state matching str against the table enters (the start
+ * included), without needing a profiling build.
+ */
+void table_count_visits(dfa_table_t*, char* str, int len, uint64_t* visits);
+
+/**
+ * Returns the state the table moves to from a state on a byte class, or TABLE_NO_TRANSITION. Works
+ * for dense and sparse states alike, for code that isn't on the matching fast path.
+ */
+int32_t table_next(dfa_table_t*, int32_t state, int class);
+
+/**
+ * Creates a table that points straight into an existing image (e.g. a mapped file) without copying.
+ * The image must outlive the table.
+ * @returns null if the image isn't a valid table image of the current version
+ */
+dfa_table_t* table_from_image(const void* image, size_t size);
+
+/**
+ * Returns the start of the table's contiguous image, and writes its size.
+ */
+const void* table_image(dfa_table_t*, size_t* size);
+
+/**
+ * Returns true if the table accepts the first len characters of str (exact match). Builds with
+ * SREGEX_PROFILE also count the match into the table's profile.
+ */
+bool table_accepts(dfa_table_t*, char* str, int len);
+
+/**
+ * Frees the table (and its image if the table created it).
+ */
+void free_table(dfa_table_t*);
+
+/**
+ * Logs the table to stdout.
+ */
+void log_table(dfa_table_t*);
+
+#endif  // TABLE_H
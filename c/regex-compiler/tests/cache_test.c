@@ -0,0 +1,114 @@
+#include <pthread.h>
+#include <stdio.h>
+
+#include "cache.h"
+#include "test_file.h"
+
+#define NUM_THREADS 8
+#define GETS_PER_THREAD 2000
+#define NUM_PATTERNS 24
+
+TEST_CASE(regex_cache_returns_shared_regex_on_hit) {
+   regex_cache_t* cache = new_regex_cache(8);
+   regex_cache_stats_t stats;
+
+   regex_t* first = regex_cache_get(cache, "foo+", REGEX_FLAG_NONE);
+   regex_t* second = regex_cache_get(cache, "foo+", REGEX_FLAG_NONE);
+   regex_t* case_insensitive = regex_cache_get(cache, "foo+", REGEX_FLAG_CASE_INSENSITIVE);
+
+   assert_true(first == second);
+   assert_true(first != case_insensitive);
+   assert_true(regex_accepts(first, "fooo"));
+   assert_false(regex_accepts(first, "FOOO"));
+   assert_true(regex_accepts(case_insensitive, "FOOO"));
+
+   regex_cache_stats(cache, &stats);
+   assert_int_equal(stats.hits, 1);
+   assert_int_equal(stats.misses, 2);
+   assert_int_equal(stats.evictions, 0);
+   assert_int_equal(stats.size, 2);
+
+   regex_release(first);
+   regex_release(second);
+   regex_release(case_insensitive);
+   regex_cache_release(cache);
+}
+
+TEST_CASE(regex_cache_evicts_but_keeps_regexes_in_use_alive) {
+   regex_cache_t* cache = new_regex_cache(1);
+   regex_cache_stats_t stats;
+
+   regex_t* a = regex_cache_get(cache, "a+", REGEX_FLAG_NONE);
+   regex_t* b = regex_cache_get(cache, "b+", REGEX_FLAG_NONE);
+
+   regex_cache_stats(cache, &stats);
+   assert_int_equal(stats.evictions, 1);
+   assert_int_equal(stats.size, 1);
+
+   // The evicted regex is still usable by the caller holding a reference
+   assert_true(regex_accepts(a, "aaa"));
+   assert_true(regex_accepts(b, "bbb"));
+
+   regex_release(a);
+   regex_release(b);
+   regex_cache_release(cache);
+}
+
+static char patterns[NUM_PATTERNS][16];
+
+typedef struct worker {
+      regex_cache_t* cache;
+      int offset;
+      int failures;
+} worker_t;
+
+static void* get_patterns(void* arg) {
+   worker_t* worker = (worker_t*)arg;
+
+   for (int i = 0; i < GETS_PER_THREAD; i++) {
+      int p = (i * 7 + worker->offset) % NUM_PATTERNS;
+      regex_t* regex = regex_cache_get(worker->cache, patterns[p], REGEX_FLAG_NONE);
+      char input[16];
+      sprintf(input, "x%dyyy", p);
+      if (!regex_accepts(regex, input)) {
+         worker->failures++;
+      }
+      regex_release(regex);
+   }
+   return NULL;
+}
+
+TEST_CASE(regex_cache_is_safe_to_share_between_threads) {
+   // A capacity below the number of patterns forces concurrent evictions
+   regex_cache_t* cache = new_regex_cache(NUM_PATTERNS / 2);
+   for (int p = 0; p < NUM_PATTERNS; p++) {
+      sprintf(patterns[p], "x%dy+", p);
+   }
+
+   pthread_t threads[NUM_THREADS];
+   worker_t workers[NUM_THREADS];
+   for (int t = 0; t < NUM_THREADS; t++) {
+      workers[t] = (worker_t){.cache = cache, .offset = t, .failures = 0};
+      pthread_create(&threads[t], NULL, get_patterns, &workers[t]);
+   }
+
+   int failures = 0;
+   for (int t = 0; t < NUM_THREADS; t++) {
+      pthread_join(threads[t], NULL);
+      failures += workers[t].failures;
+   }
+   assert_int_equal(failures, 0);
+
+   regex_cache_stats_t stats;
+   regex_cache_stats(cache, &stats);
+   assert_int_equal(stats.hits + stats.misses, NUM_THREADS * GETS_PER_THREAD);
+   assert_true(stats.size <= NUM_PATTERNS / 2);
+
+   regex_cache_release(cache);
+}
+
+void on_register_tests(void) {
+   REGISTER_TEST(regex_cache_returns_shared_regex_on_hit);
+   REGISTER_TEST(regex_cache_evicts_but_keeps_regexes_in_use_alive);
+   REGISTER_TEST(regex_cache_is_safe_to_share_between_threads);
+}
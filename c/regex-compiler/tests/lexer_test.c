@@ -0,0 +1,93 @@
+#include <string.h>
+
+#include "lexer.h"
+#include "sregex.h"
+#include "test_file.h"
+
+enum {
+   TOKEN_IF,
+   TOKEN_IDENTIFIER,
+   TOKEN_NUMBER,
+   TOKEN_OPERATOR,
+   TOKEN_WHITESPACE,
+};
+
+static lexer_rule_t RULES[] = {
+    {"if", TOKEN_IF},
+    {"[a-zA-Z_][a-zA-Z0-9_]*", TOKEN_IDENTIFIER},
+    {"\\d+(\\.\\d+)?", TOKEN_NUMBER},
+    {"==|=|<=|<|\\+", TOKEN_OPERATOR},
+    {"\\s+", TOKEN_WHITESPACE},
+};
+
+#define NUM_RULES (sizeof RULES / sizeof RULES[0])
+
+TEST_CASE(lexer_uses_longest_match_then_rule_order) {
+   lexer_t* lexer = new_lexer(RULES, NUM_RULES, REGEX_FLAG_NONE);
+   char* input = "if iffy <= 3.14==x";
+   token_t tokens[16];
+   int consumed;
+
+   int num_tokens = lexer_tokenize(lexer, input, strlen(input), tokens, 16, &consumed);
+
+   int expected_ids[] = {TOKEN_IF,         TOKEN_WHITESPACE, TOKEN_IDENTIFIER, TOKEN_WHITESPACE,
+                         TOKEN_OPERATOR,   TOKEN_WHITESPACE, TOKEN_NUMBER,     TOKEN_OPERATOR,
+                         TOKEN_IDENTIFIER};
+   int expected_lengths[] = {2, 1, 4, 1, 2, 1, 4, 2, 1};
+
+   assert_int_equal(num_tokens, 9);
+   assert_int_equal(consumed, strlen(input));
+   for (int i = 0; i < 9 && i < num_tokens; i++) {
+      assert_int_equal(tokens[i].token_id, expected_ids[i]);
+      assert_int_equal(tokens[i].length, expected_lengths[i]);
+   }
+   assert_int_equal(tokens[2].start, 3);
+
+   lexer_release(lexer);
+}
+
+TEST_CASE(lexer_stops_on_unmatched_input_and_full_token_array) {
+   lexer_t* lexer = new_lexer(RULES, NUM_RULES, REGEX_FLAG_NONE);
+   token_t tokens[2];
+   int consumed;
+
+   // '?' matches no rule
+   char* input = "abc ?def";
+   int num_tokens = lexer_tokenize(lexer, input, strlen(input), tokens, 2, &consumed);
+   assert_int_equal(num_tokens, 2);
+   assert_int_equal(consumed, 4);
+   num_tokens = lexer_tokenize(lexer, input + consumed, strlen(input) - consumed, tokens, 2,
+                               &consumed);
+   assert_int_equal(num_tokens, 0);
+   assert_int_equal(consumed, 0);
+
+   // A full token array stops tokenizing and can be resumed from `consumed`
+   input = "a b c";
+   num_tokens = lexer_tokenize(lexer, input, strlen(input), tokens, 2, &consumed);
+   assert_int_equal(num_tokens, 2);
+   assert_int_equal(consumed, 2);
+   num_tokens = lexer_tokenize(lexer, input + consumed, strlen(input) - consumed, tokens, 2,
+                               &consumed);
+   assert_int_equal(num_tokens, 2);
+   assert_int_equal(consumed, 2);
+
+   lexer_release(lexer);
+}
+
+TEST_CASE(lexer_applies_flags_to_every_rule) {
+   lexer_t* lexer = new_lexer(RULES, NUM_RULES, REGEX_FLAG_CASE_INSENSITIVE);
+   char* input = "IF";
+   token_t tokens[4];
+
+   int num_tokens = lexer_tokenize(lexer, input, strlen(input), tokens, 4, NULL);
+   assert_int_equal(num_tokens, 1);
+   assert_int_equal(tokens[0].token_id, TOKEN_IF);
+
+   lexer_release(lexer);
+}
+
+void on_register_tests(void) {
+   REGISTER_TEST(lexer_uses_longest_match_then_rule_order);
+   REGISTER_TEST(lexer_stops_on_unmatched_input_and_full_token_array);
+   REGISTER_TEST(lexer_applies_flags_to_every_rule);
+}
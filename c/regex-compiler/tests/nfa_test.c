@@ -1,34 +1,153 @@
 #include "nfa.h"
 
+#include <stdint.h>
+#include <string.h>
+
 #include "test_file.h"
 
 TEST_CASE(nfa_has_correct_number_states) {
-   ast_node_t* ast;
+   arena_t* arena;
    nfa_t* nfa;
 
-   ast = parse_regex("a");
-   nfa = nfa_from_ast(ast);
+   arena = new_arena();
+   nfa = nfa_from_ast(arena, parse_regex(arena, "a"));
    assert_int_equal(nfa_num_states(nfa), 2);
-   free_nfa(nfa);
-   free_ast(ast);
+   arena_release(arena);
 
-   ast = parse_regex("ab");
-   nfa = nfa_from_ast(ast);
+   arena = new_arena();
+   nfa = nfa_from_ast(arena, parse_regex(arena, "ab"));
    assert_int_equal(nfa_num_states(nfa), 4);
-   free_nfa(nfa);
-   free_ast(ast);
+   arena_release(arena);
 
-   ast = parse_regex("a*");
-   nfa = nfa_from_ast(ast);
+   arena = new_arena();
+   nfa = nfa_from_ast(arena, parse_regex(arena, "a*"));
    assert_int_equal(nfa_num_states(nfa), 4);
-   free_nfa(nfa);
-   free_ast(ast);
+   arena_release(arena);
 
-   ast = parse_regex("a|b");
-   nfa = nfa_from_ast(ast);
+   arena = new_arena();
+   nfa = nfa_from_ast(arena, parse_regex(arena, "a|b"));
    assert_int_equal(nfa_num_states(nfa), 6);
-   free_nfa(nfa);
-   free_ast(ast);
+   arena_release(arena);
+}
+
+TEST_CASE(nfa_character_class_is_a_single_edge) {
+   arena_t* arena = new_arena();
+   nfa_t* nfa = nfa_from_ast(arena, parse_regex(arena, "[^a]"));
+
+   assert_int_equal(nfa_num_states(nfa), 2);
+   assert_int_equal(nfa->start->num_edges, 1);
+   assert_true(nfa_edge_has_byte(&nfa->start->edges[0], 'b'));
+   assert_true(nfa_edge_has_byte(&nfa->start->edges[0], '~'));
+   assert_false(nfa_edge_has_byte(&nfa->start->edges[0], 'a'));
+   assert_true(nfa_node_find_transition(nfa->start, 'z') == nfa->end);
+   assert_true(nfa_node_find_transition(nfa->start, 'a') == NULL);
+
+   arena_release(arena);
+}
+
+TEST_CASE(nfa_simplify_removes_epsilons_and_merges_states) {
+   arena_t* arena = new_arena();
+   nfa_stats_t stats;
+
+   // Both branches end in equivalent accepting nodes, so their edges merge into one
+   nfa_t* nfa = nfa_from_ast(arena, parse_regex(arena, "a|b"));
+   nfa_stats(nfa, &stats);
+   assert_int_equal(stats.num_states, 6);
+   assert_int_equal(stats.num_epsilon_edges, 4);
+   nfa_simplify(nfa);
+   nfa_stats(nfa, &stats);
+   assert_int_equal(stats.num_states, 2);
+   assert_int_equal(stats.num_edges, 1);
+   assert_int_equal(stats.num_epsilon_edges, 0);
+   assert_true(nfa_node_find_transition(nfa->start, 'a') ==
+               nfa_node_find_transition(nfa->start, 'b'));
+
+   // The start of a star accepts and loops on itself
+   nfa = nfa_from_ast(arena, parse_regex(arena, "a*"));
+   nfa_simplify(nfa);
+   nfa_stats(nfa, &stats);
+   assert_int_equal(stats.num_states, 1);
+   assert_true(nfa->start->is_accepting);
+   assert_true(nfa_node_find_transition(nfa->start, 'a') == nfa->start);
+   assert_true(nfa_node_find_transition(nfa->start, 'b') == NULL);
+
+   arena_release(arena);
+}
+
+TEST_CASE(optimize_ast_factors_and_merges_alternatives) {
+   arena_t* arena = new_arena();
+
+   // 'hello (world|there|you)', with the shared prefix as one string
+   ast_node_t* ast = parse_regex(arena, "hello world|hello there|hello you");
+   int num_states = nfa_num_states(nfa_from_ast(arena, ast));
+   ast = optimize_ast(arena, ast);
+   assert_int_equal(ast->kind, NODE_KIND_CONCAT);
+   assert_int_equal(ast->concat->num_children, 2);
+   assert_int_equal(ast->concat->children[0]->kind, NODE_KIND_STRING);
+   assert_true(strcmp(ast->concat->children[0]->string->value, "hello ") == 0);
+   assert_int_equal(ast->concat->children[1]->kind, NODE_KIND_OPTION);
+   assert_int_equal(ast->concat->children[1]->option->num_children, 3);
+   assert_true(nfa_num_states(nfa_from_ast(arena, ast)) < num_states);
+
+   // Single characters become one class, whatever the nesting
+   ast = optimize_ast(arena, parse_regex(arena, "a|(b|\\d)|[xy]"));
+   assert_int_equal(ast->kind, NODE_KIND_CLASS_BRACKETED);
+   assert_int_equal(ast->class_bracketed->num_items, 5);
+
+   // What's left of 'ab' after factoring makes the rest optional: 'ab(c(d)?)?'
+   ast = optimize_ast(arena, parse_regex(arena, "ab|abc|abcd"));
+   assert_int_equal(ast->kind, NODE_KIND_CONCAT);
+   assert_int_equal(ast->concat->children[0]->kind, NODE_KIND_STRING);
+   assert_int_equal(ast->concat->children[1]->kind, NODE_KIND_REPITITION);
+   assert_int_equal(ast->concat->children[1]->repitition->kind, REPITITION_KIND_ZERO_OR_ONE);
+
+   // Shared suffixes too: '[bcr]at'
+   ast = optimize_ast(arena, parse_regex(arena, "bat|cat|rat"));
+   assert_int_equal(ast->kind, NODE_KIND_CONCAT);
+   assert_int_equal(ast->concat->children[0]->kind, NODE_KIND_CLASS_BRACKETED);
+   assert_true(strcmp(ast->concat->children[1]->string->value, "at") == 0);
+
+   ast = optimize_ast(arena, parse_regex(arena, "(a+)*"));
+   assert_int_equal(ast->kind, NODE_KIND_REPITITION);
+   assert_int_equal(ast->repitition->kind, REPITITION_KIND_ZERO_OR_MORE);
+   assert_int_equal(ast->repitition->child->kind, NODE_KIND_LITERAL);
+
+   arena_release(arena);
 }
 
-void on_register_tests(void) { REGISTER_TEST(nfa_has_correct_number_states); }
+TEST_CASE(arena_grows_and_keeps_allocations_apart) {
+   arena_t* arena = new_arena();
+
+   // Enough small allocations to need several chunks, plus one larger than any chunk
+   int* small[1000];
+   for (int i = 0; i < 1000; i++) {
+      small[i] = arena_alloc(arena, sizeof(int) * 3);
+      small[i][0] = small[i][2] = i;
+   }
+   char* large = arena_alloc(arena, 4 << 20);
+   large[0] = large[(4 << 20) - 1] = 'x';
+
+   int* grown = arena_alloc(arena, sizeof(int));
+   *grown = 42;
+   grown = arena_grow(arena, grown, sizeof(int), sizeof(int) * 64);
+   grown[63] = 7;
+
+   for (int i = 0; i < 1000; i++) {
+      assert_int_equal(small[i][0], i);
+      assert_int_equal(small[i][2], i);
+      assert_int_equal((uintptr_t)small[i] % 16, 0);
+   }
+   assert_int_equal(*grown, 42);
+   assert_int_equal(grown[63], 7);
+   assert_true(arena_size(arena) >= (4 << 20) + 1000 * sizeof(int) * 3);
+
+   arena_release(arena);
+}
+
+void on_register_tests(void) {
+   REGISTER_TEST(nfa_has_correct_number_states);
+   REGISTER_TEST(nfa_character_class_is_a_single_edge);
+   REGISTER_TEST(nfa_simplify_removes_epsilons_and_merges_states);
+   REGISTER_TEST(optimize_ast_factors_and_merges_alternatives);
+   REGISTER_TEST(arena_grows_and_keeps_allocations_apart);
+}
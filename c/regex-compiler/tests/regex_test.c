@@ -1,9 +1,12 @@
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "sregex.h"
 #include "test_file.h"
+#include "utils.h"
 
 TEST_CASE(regex_accepts_matches_exactly) {
    // First pattern
@@ -60,6 +63,245 @@ TEST_CASE(regex_accepts_matches_exactly) {
    regex_release(regex);
 }
 
+TEST_CASE(regex_matches_factored_alternations) {
+   // Shared prefixes and suffixes, alternatives that are prefixes of others, and single characters
+   regex_t* regex = new_regex("ab|abc|abcd|xbcd|b|c|\\d|(foo|for)+");
+
+   assert_true(regex_accepts(regex, "ab"));
+   assert_true(regex_accepts(regex, "abc"));
+   assert_true(regex_accepts(regex, "abcd"));
+   assert_true(regex_accepts(regex, "xbcd"));
+   assert_true(regex_accepts(regex, "b"));
+   assert_true(regex_accepts(regex, "7"));
+   assert_true(regex_accepts(regex, "foo"));
+   assert_true(regex_accepts(regex, "forfoofor"));
+
+   assert_false(regex_accepts(regex, ""));
+   assert_false(regex_accepts(regex, "a"));
+   assert_false(regex_accepts(regex, "abd"));
+   assert_false(regex_accepts(regex, "xbc"));
+   assert_false(regex_accepts(regex, "bc"));
+   assert_false(regex_accepts(regex, "fo"));
+   assert_false(regex_accepts(regex, "foofo"));
+
+   regex_release(regex);
+
+   regex = new_regex("(a|ab)(c|bcd)?");
+
+   assert_true(regex_accepts(regex, "a"));
+   assert_true(regex_accepts(regex, "ab"));
+   assert_true(regex_accepts(regex, "abcd"));
+   assert_true(regex_accepts(regex, "ac"));
+   assert_true(regex_accepts(regex, "abc"));
+   assert_true(regex_accepts(regex, "abbcd"));
+
+   assert_false(regex_accepts(regex, ""));
+   assert_false(regex_accepts(regex, "abb"));
+   assert_false(regex_accepts(regex, "acd"));
+
+   regex_release(regex);
+}
+
+TEST_CASE(regex_reports_syntax_errors) {
+   char* patterns[] = {"a|", "(ab", "ab)", "*a", "a**", "[ab", "a\\"};
+   int positions[] = {2, 0, 2, 0, 2, 0, 1};
+
+   for (int i = 0; i < sizeof patterns / sizeof patterns[0]; i++) {
+      regex_error_t error;
+      assert_true(new_regex_with_error(patterns[i], REGEX_FLAG_NONE, &error) == NULL);
+      assert_int_equal(error.code, REGEX_ERROR_SYNTAX);
+      assert_int_equal(error.position, positions[i]);
+      assert_true(new_regex(patterns[i]) == NULL);
+   }
+
+   regex_error_t error;
+   regex_t* regex = new_regex_with_error("(a|b)+c", REGEX_FLAG_NONE, &error);
+   assert_true(regex != NULL);
+   assert_int_equal(error.code, REGEX_ERROR_NONE);
+   regex_release(regex);
+}
+
+TEST_CASE(regex_compiles_very_large_patterns) {
+   // Nesting far deeper than a recursive parser's stack would allow
+   int depth = 200000;
+   char* pattern = malloc(2 * depth + 3);
+   memset(pattern, '(', depth);
+   memcpy(pattern + depth, "ab", 2);
+   memset(pattern + depth + 2, ')', depth);
+   pattern[2 * depth + 2] = '\0';
+
+   regex_t* regex = new_regex(pattern);
+   assert_true(regex != NULL);
+   assert_true(regex_accepts(regex, "ab"));
+   assert_false(regex_accepts(regex, "a"));
+   regex_release(regex);
+
+   // A long alternation of words
+   int num_words = 20000;
+   pattern = realloc(pattern, num_words * 8);
+   int length = 0;
+   for (int i = 0; i < num_words; i++) {
+      length += sprintf(pattern + length, "%sw%d", i > 0 ? "|" : "", i);
+   }
+
+   regex = new_regex(pattern);
+   assert_true(regex != NULL);
+   assert_true(regex_accepts(regex, "w0"));
+   assert_true(regex_accepts(regex, "w12345"));
+   assert_true(regex_accepts(regex, "w19999"));
+   assert_false(regex_accepts(regex, "w20000"));
+   assert_false(regex_accepts(regex, "w"));
+   regex_release(regex);
+   free(pattern);
+}
+
+TEST_CASE(regex_falls_back_when_compile_limits_are_exceeded) {
+   // 'x(a|b)*a' followed by 16 '(a|b)' needs a dfa state for every combination of the last 17 bytes
+   char pattern[128] = "foo|x(a|b)*a";
+   for (int i = 0; i < 16; i++) {
+      strcat(pattern, "(a|b)");
+   }
+   char accepted[] = "xbba" "bbbbbbbbbbbbbbbb";
+   char rejected[] = "xbbb" "bbbbbbbbbbbbbbbb";
+
+   regex_options_t options = {.flags = REGEX_FLAG_NONE, .max_states = 1000, .fallback = false};
+   regex_error_t error;
+   assert_true(new_regex_with_options(pattern, &options, &error) == NULL);
+   assert_int_equal(error.code, REGEX_ERROR_LIMIT);
+   // The blowup is reported from the repetition on ('(a|b)*a(a|b)(a|b)...'), leaving out 'foo',
+   // the leading 'x' and any '(a|b)' not needed to exceed the limit
+   assert_int_equal(error.position, 5);
+   assert_true(error.length > strlen("(a|b)*a"));
+   assert_true(error.position + error.length <= strlen(pattern));
+
+   options.fallback = true;
+   regex_t* regex = new_regex_with_options(pattern, &options, &error);
+   assert_true(regex != NULL);
+   assert_int_equal(error.code, REGEX_ERROR_LIMIT);
+   assert_true(regex_accepts(regex, "foo"));
+   assert_true(regex_accepts(regex, accepted));
+   assert_false(regex_accepts(regex, rejected));
+   assert_true(regex_test(regex, "zzfoozz"));
+   assert_int_equal(regex_serialize(regex, "/tmp/regex_test_unused"), -1);
+   regex_release(regex);
+
+   // Without the search for the blowup, the error covers the whole pattern
+   options.skip_locate = true;
+   regex = new_regex_with_options(pattern, &options, &error);
+   assert_int_equal(error.code, REGEX_ERROR_LIMIT);
+   assert_int_equal(error.position, 0);
+   assert_int_equal(error.length, strlen(pattern));
+   assert_true(regex_accepts(regex, accepted));
+   regex_release(regex);
+   options.skip_locate = false;
+
+   // The memory limit stops construction as well, and without limits the dfa is built
+   options.max_states = 0;
+   options.max_bytes = 1 << 20;
+   regex = new_regex_with_options(pattern, &options, &error);
+   assert_int_equal(error.code, REGEX_ERROR_LIMIT);
+   regex_release(regex);
+
+   options.max_bytes = 0;
+   regex = new_regex_with_options(pattern, &options, &error);
+   assert_int_equal(error.code, REGEX_ERROR_NONE);
+   assert_true(regex_accepts(regex, accepted));
+   assert_false(regex_accepts(regex, rejected));
+   regex_release(regex);
+}
+
+TEST_CASE(regex_bounds_compile_time_including_locating_the_blowup) {
+   // Every 'x' and '(a|b)' is one more child of the concatenation for the blowup search to try
+   char pattern[256] = "xxxxxxxxxx(a|b)*a";
+   for (int i = 0; i < 22; i++) {
+      strcat(pattern, "(a|b)");
+   }
+
+   regex_options_t options = {.flags = REGEX_FLAG_NONE, .max_seconds = 0.2, .fallback = false};
+   regex_error_t error;
+   double start = monotonic_seconds();
+   assert_true(new_regex_with_options(pattern, &options, &error) == NULL);
+   double seconds = monotonic_seconds() - start;
+   assert_int_equal(error.code, REGEX_ERROR_LIMIT);
+   // max_seconds to compile, and about as long again to locate the blowup
+   assert_true(seconds < 3 * options.max_seconds);
+}
+
+TEST_CASE(regex_reports_compile_stats) {
+   regex_t* regex = new_regex("(a|b)*abb");
+   regex_stats_t stats;
+   regex_stats(regex, &stats);
+
+   assert_int_equal(stats.engine, REGEX_ENGINE_TABLE);
+   assert_true(stats.ast_nodes >= stats.optimized_ast_nodes && stats.optimized_ast_nodes > 0);
+   assert_true(stats.nfa_states > 0 && stats.nfa_edges > 0);
+   // The textbook dfa for '(a|b)*abb' has 4 states after minimization
+   assert_true(stats.dfa_states >= 4);
+   assert_int_equal(stats.alphabet_size, 2);
+   // 'a', 'b' and every other byte
+   assert_int_equal(stats.byte_classes, 3);
+   assert_true(stats.table_bytes > 0);
+   assert_int_equal(stats.jit_bytes, 0);
+   assert_true(stats.total_seconds >= stats.parse_seconds + stats.determinize_seconds);
+   regex_release(regex);
+
+   regex_options_t options = {.flags = REGEX_FLAG_NONE, .max_states = 1, .fallback = true};
+   regex_error_t error;
+   regex = new_regex_with_options("(a|b)*abb", &options, &error);
+   regex_stats(regex, &stats);
+   assert_int_equal(stats.engine, REGEX_ENGINE_NFA_SIMULATION);
+   assert_int_equal(stats.dfa_states, 0);
+   assert_int_equal(stats.table_bytes, 0);
+   assert_true(stats.nfa_states > 0);
+   regex_release(regex);
+}
+
+TEST_CASE(regex_profiles_matches_in_profiling_builds) {
+   regex_t* regex = new_regex("ab+c");
+   assert_true(regex_accepts(regex, "abbc"));
+   assert_false(regex_accepts(regex, "ax"));
+
+   char* buffer;
+   size_t size;
+   FILE* out = open_memstream(&buffer, &size);
+#ifdef SREGEX_PROFILE
+   assert_int_equal(regex_profile_write(regex, out, REGEX_PROFILE_JSON), 0);
+   fflush(out);
+   assert_true(strstr(buffer, "\"matches\": 2,") != NULL);
+   assert_true(strstr(buffer, "\"accepted\": 1,") != NULL);
+   // All of 'abbc', and 'a' plus the 'x' that had no transition
+   assert_true(strstr(buffer, "\"bytes_scanned\": 6,") != NULL);
+
+   assert_int_equal(regex_profile_write(regex, out, REGEX_PROFILE_DOT), 0);
+   fflush(out);
+   assert_true(strstr(buffer, "digraph") != NULL);
+
+   // DOT has no '\u' escapes, so unprintable bytes of the pattern are written as entities there
+   regex_t* tabbed = new_regex("a\tb");
+   rewind(out);
+   assert_int_equal(regex_profile_write(tabbed, out, REGEX_PROFILE_DOT), 0);
+   fflush(out);
+   assert_true(strstr(buffer, "label=\"a&#9;b\";") != NULL);
+   rewind(out);
+   assert_int_equal(regex_profile_write(tabbed, out, REGEX_PROFILE_JSON), 0);
+   fflush(out);
+   assert_true(strstr(buffer, "\"pattern\": \"a\\u0009b\",") != NULL);
+   regex_release(tabbed);
+
+   regex_profile_reset(regex);
+   rewind(out);
+   assert_int_equal(regex_profile_write(regex, out, REGEX_PROFILE_JSON), 0);
+   fflush(out);
+   assert_true(strstr(buffer, "\"matches\": 0,") != NULL);
+#else
+   // Normal builds don't count anything
+   assert_int_equal(regex_profile_write(regex, out, REGEX_PROFILE_JSON), -1);
+#endif
+   fclose(out);
+   free(buffer);
+   regex_release(regex);
+}
+
 TEST_CASE(regex_matches_quantifiers) {
    // First
    regex_t* regex = new_regex("a*b+c?d");
@@ -258,8 +500,284 @@ TEST_CASE(regex_matches_character_classes) {
    regex_release(regex);
 }
 
+TEST_CASE(regex_matches_case_insensitive) {
+   // First
+   regex_t* regex = new_regex_with_flags("hello w[a-o]rld", REGEX_FLAG_CASE_INSENSITIVE);
+
+   assert_true(regex_accepts(regex, "hello world"));
+   assert_true(regex_accepts(regex, "HELLO WORLD"));
+   assert_true(regex_accepts(regex, "HeLlO wOrLd"));
+
+   assert_false(regex_accepts(regex, "hello wurld"));
+   assert_false(regex_accepts(regex, "HELLO WURLD"));
+
+   regex_release(regex);
+
+   // Second
+   regex = new_regex_with_flags("[^a-c]+", REGEX_FLAG_CASE_INSENSITIVE);
+
+   assert_true(regex_accepts(regex, "def"));
+   assert_true(regex_accepts(regex, "DEF123"));
+
+   assert_false(regex_accepts(regex, "a"));
+   assert_false(regex_accepts(regex, "B"));
+
+   regex_release(regex);
+
+   // Third
+   regex = new_regex("hello");
+   assert_true(regex_accepts(regex, "hello"));
+   assert_false(regex_accepts(regex, "HELLO"));
+   regex_release(regex);
+}
+
+TEST_CASE(regex_serializes_and_loads_from_mmap) {
+   char path[] = "/tmp/regex_test_XXXXXX";
+   int fd = mkstemp(path);
+   assert_true(fd != -1);
+   close(fd);
+
+   regex_t* regex = new_regex_with_flags("[a-z]+( [a-z]+)*\\.?", REGEX_FLAG_CASE_INSENSITIVE);
+   assert_int_equal(regex_serialize(regex, path), 0);
+   regex_release(regex);
+
+   regex = regex_load_mmap(path);
+   assert_true(regex != NULL);
+
+   assert_true(regex_accepts(regex, "hello world."));
+   assert_true(regex_accepts(regex, "I am writing a sentence"));
+   assert_true(regex_test(regex, "123 abc"));
+
+   assert_false(regex_accepts(regex, "hello  world"));
+   assert_false(regex_accepts(regex, "123"));
+
+   regex_release(regex);
+
+   // A file that isn't a compiled regex is rejected
+   FILE* file = fopen(path, "w");
+   fputs("not a compiled regex", file);
+   fclose(file);
+   assert_true(regex_load_mmap(path) == NULL);
+
+   unlink(path);
+}
+
+TEST_CASE(regex_relayout_keeps_matches_and_shrinks_cold_states) {
+   char* inputs[] = {"alpha.com", "alpha.net", "beta.org", "gamma.com", "delta.net", "epsilon.io",
+                     "alpha.", "alpha.co", "beta.comm", "gamma", "", ".com", "deltanet"};
+   int num_inputs = sizeof inputs / sizeof inputs[0];
+   char* samples[] = {"alpha.com", "alpha.net", "alpha.nope"};
+   char path[] = "/tmp/regex_test_XXXXXX";
+   int fd = mkstemp(path);
+   assert_true(fd != -1);
+   close(fd);
+
+   int flags[] = {REGEX_FLAG_NONE, REGEX_FLAG_JIT};
+   for (int f = 0; f < 2; f++) {
+      regex_t* regex =
+          new_regex_with_flags("(alpha|beta|gamma|delta|epsilon)\\.(com|net|org|io)", flags[f]);
+      regex_t* unweighted = regex_relayout(regex, NULL, 0);
+      regex_t* relaid = regex_relayout(regex, samples, 3);
+      assert_true(unweighted != NULL && relaid != NULL);
+
+      regex_stats_t stats;
+      regex_stats_t relaid_stats;
+      regex_stats(regex, &stats);
+      regex_stats(relaid, &relaid_stats);
+      assert_int_equal(relaid_stats.dfa_states, stats.dfa_states);
+      // Only the states of "alpha." keep a full row
+      assert_true(relaid_stats.table_bytes < stats.table_bytes);
+
+      assert_int_equal(regex_serialize(relaid, path), 0);
+      regex_t* loaded = regex_load_mmap(path);
+      assert_true(loaded != NULL);
+
+      for (int i = 0; i < num_inputs; i++) {
+         bool expected = regex_accepts(regex, inputs[i]);
+         assert_true(regex_accepts(unweighted, inputs[i]) == expected);
+         assert_true(regex_accepts(relaid, inputs[i]) == expected);
+         assert_true(regex_accepts(loaded, inputs[i]) == expected);
+      }
+      assert_true(regex_accepts(loaded, "delta.io"));
+      assert_false(regex_accepts(loaded, "delta.i"));
+
+      regex_release(loaded);
+      regex_release(relaid);
+      regex_release(unweighted);
+      regex_release(regex);
+   }
+   unlink(path);
+}
+
+TEST_CASE(regex_generates_accepted_strings_and_near_misses) {
+   char* patterns[] = {"[a-z]+@[a-z]+\\.(com|org)", "\\d+-\\d+-\\d+ (INFO|WARN|ERROR) .*",
+                       "(a|b)*abb", "x?y?z?", "[^abc]+", "(ab|cd)*"};
+   char out[64];
+
+   for (int p = 0; p < sizeof patterns / sizeof patterns[0]; p++) {
+      regex_t* regex = new_regex_with_flags(patterns[p], REGEX_FLAG_CASE_INSENSITIVE);
+      regex_generator_t* generator = new_regex_generator(regex, 7);
+      assert_true(generator != NULL);
+      for (int i = 0; i < 50; i++) {
+         int length = regex_generate(generator, out, sizeof out, i % 24);
+         assert_int_equal(length, strlen(out));
+         assert_true(regex_accepts(regex, out));
+         assert_true(strchr(out, '\n') == NULL);
+
+         length = regex_generate_near_miss(generator, out, sizeof out, i % 24);
+         if (length != -1) {
+            assert_int_equal(length, strlen(out));
+            assert_false(regex_accepts(regex, out));
+         }
+      }
+      free_regex_generator(generator);
+      regex_release(regex);
+   }
+
+   // Languages that allow it get the length asked for, and strings that don't fit aren't written
+   regex_t* regex = new_regex("[a-z]+");
+   regex_generator_t* generator = new_regex_generator(regex, 7);
+   assert_int_equal(regex_generate(generator, out, sizeof out, 20), 20);
+   assert_int_equal(regex_generate(generator, out, sizeof out, 100), sizeof out - 1);
+   assert_int_equal(regex_generate(generator, out, 1, 20), -1);
+   free_regex_generator(generator);
+   // The generator holds a reference, so the regex outlives it either way
+   regex_release(regex);
+
+   regex = new_regex("abc");
+   generator = new_regex_generator(regex, 7);
+   assert_int_equal(regex_generate(generator, out, sizeof out, 20), 3);
+   assert_true(strcmp(out, "abc") == 0);
+   assert_int_equal(regex_generate(generator, out, 3, 20), -1);
+   free_regex_generator(generator);
+   regex_release(regex);
+
+   // Nfa simulation has no dfa to walk
+   regex_options_t options = {.flags = REGEX_FLAG_NONE, .max_states = 1, .fallback = true};
+   regex_error_t error;
+   regex = new_regex_with_options("abc|abd", &options, &error);
+   assert_true(new_regex_generator(regex, 7) == NULL);
+   regex_release(regex);
+}
+
+TEST_CASE(regex_emits_standalone_c_matcher) {
+   char source_path[] = "/tmp/regex_test_XXXXXX.c";
+   int fd = mkstemps(source_path, 2);
+   assert_true(fd != -1);
+   FILE* out = fdopen(fd, "w");
+
+   regex_t* regex = new_regex("(a|b)*ab(b|cc)kkws*");
+   assert_int_equal(regex_emit_c(regex, out, "generated_match"), 0);
+   assert_int_equal(regex_emit_c(regex, out, "not an identifier"), -1);
+   regex_release(regex);
+   fclose(out);
+
+   // Compile the generated source on its own and load it
+   char library_path[sizeof source_path + 1];
+   strcpy(library_path, source_path);
+   strcpy(library_path + strlen(library_path) - 1, "so");
+   char command[3 * sizeof library_path + 64];
+   sprintf(command, "cc -std=c99 -Wall -Werror -shared -fPIC %s -o %s", source_path, library_path);
+   assert_int_equal(system(command), 0);
+
+   void* handle = dlopen(library_path, RTLD_NOW);
+   assert_true(handle != NULL);
+   if (handle != NULL) {
+      bool (*generated_match)(const char*, size_t) = dlsym(handle, "generated_match");
+      assert_true(generated_match != NULL);
+
+      assert_true(generated_match("abcckkws", 8));
+      assert_true(generated_match("aaaaabbbbbbbabbkkwsssssss", 25));
+      assert_true(generated_match("abcckkwxyz", 7));
+
+      assert_false(generated_match("abkkw", 5));
+      assert_false(generated_match("abckkwss", 8));
+
+      dlclose(handle);
+   }
+
+   unlink(source_path);
+   unlink(library_path);
+}
+
+TEST_CASE(regex_jit_matches_like_the_interpreter) {
+   char* patterns[] = {"(a|b)*ab(b|cc)kkws*", "[a-zA-Z][a-zA-Z0-9_]*", "\\d+\\s+\\d+", "a*b*c*",
+                       "[^abc][^a-z]*", "do you like foo.*\\?"};
+   char* inputs[] = {"",           "abcckkws",  "abababbkkws",   "abkkw",      "hello_world_123",
+                     "1hello",     "123 456",   "99   \n\t\r 2", "123 456 789", "aaabbccc",
+                     "abd",        "dA0!@#$%^", "zbba",          "\x80\xff",   "do you like food?",
+                     "do you like"};
+
+   for (int p = 0; p < sizeof patterns / sizeof patterns[0]; p++) {
+      regex_t* interpreted = new_regex(patterns[p]);
+      regex_t* jitted = new_regex_with_flags(patterns[p], REGEX_FLAG_JIT);
+
+      for (int i = 0; i < sizeof inputs / sizeof inputs[0]; i++) {
+         assert_true(regex_accepts(jitted, inputs[i]) == regex_accepts(interpreted, inputs[i]));
+         assert_true(regex_test(jitted, inputs[i]) == regex_test(interpreted, inputs[i]));
+      }
+
+      regex_release(interpreted);
+      regex_release(jitted);
+   }
+}
+
+#define NUM_COMPILE_THREADS 8
+#define COMPILES_PER_THREAD 500
+
+// Patterns that go through every kind of character set scratch the nfa builder uses
+static char* concurrent_patterns[][3] = {
+    {"(a|b)*ab(b|cc)", "abcc", "abc"}, {"[a-zA-Z_]\\w*", "hello_42", "hello world"},
+    {"\\d+\\s\\D+", "12 ab", "12 34"}, {"[^a-z]+\\S", "12!", "abc"},
+    {".x?\\W", "ax!", "axx"},
+};
+
+static void* compile_patterns(void* arg) {
+   int* failures = (int*)arg;
+   int num_patterns = sizeof concurrent_patterns / sizeof concurrent_patterns[0];
+   char pattern[64];
+   char accepted[64];
+   char rejected[64];
+
+   for (int i = 0; i < COMPILES_PER_THREAD; i++) {
+      char** spec = concurrent_patterns[i % num_patterns];
+      // A different literal prefix per compile gives every nfa a different shape and size
+      sprintf(pattern, "%d%s", i, spec[0]);
+      sprintf(accepted, "%d%s", i, spec[1]);
+      sprintf(rejected, "%d%s", i, spec[2]);
+
+      regex_t* regex =
+          new_regex_with_flags(pattern, i % 2 == 0 ? REGEX_FLAG_NONE : REGEX_FLAG_CASE_INSENSITIVE);
+      if (!regex_accepts(regex, accepted) || regex_accepts(regex, rejected)) {
+         (*failures)++;
+      }
+      regex_release(regex);
+   }
+   return NULL;
+}
+
+TEST_CASE(regex_compiles_concurrently) {
+   pthread_t threads[NUM_COMPILE_THREADS];
+   int failures[NUM_COMPILE_THREADS] = {0};
+
+   for (int t = 0; t < NUM_COMPILE_THREADS; t++) {
+      pthread_create(&threads[t], NULL, compile_patterns, &failures[t]);
+   }
+   for (int t = 0; t < NUM_COMPILE_THREADS; t++) {
+      pthread_join(threads[t], NULL);
+      assert_int_equal(failures[t], 0);
+   }
+}
+
 void on_register_tests(void) {
    REGISTER_TEST(regex_accepts_matches_exactly);
+   REGISTER_TEST(regex_matches_factored_alternations);
+   REGISTER_TEST(regex_reports_syntax_errors);
+   REGISTER_TEST(regex_compiles_very_large_patterns);
+   REGISTER_TEST(regex_falls_back_when_compile_limits_are_exceeded);
+   REGISTER_TEST(regex_bounds_compile_time_including_locating_the_blowup);
+   REGISTER_TEST(regex_reports_compile_stats);
+   REGISTER_TEST(regex_profiles_matches_in_profiling_builds);
    REGISTER_TEST(regex_matches_quantifiers);
    REGISTER_TEST(regex_test_matches_any_substring);
    REGISTER_TEST(regex_matches_escape_characters);
@@ -267,4 +785,11 @@ void on_register_tests(void) {
    REGISTER_TEST(regex_works_with_character_ranges);
    REGISTER_TEST(regex_matches_tabs_and_newlines);
    REGISTER_TEST(regex_matches_character_classes);
+   REGISTER_TEST(regex_matches_case_insensitive);
+   REGISTER_TEST(regex_generates_accepted_strings_and_near_misses);
+   REGISTER_TEST(regex_serializes_and_loads_from_mmap);
+   REGISTER_TEST(regex_relayout_keeps_matches_and_shrinks_cold_states);
+   REGISTER_TEST(regex_emits_standalone_c_matcher);
+   REGISTER_TEST(regex_jit_matches_like_the_interpreter);
+   REGISTER_TEST(regex_compiles_concurrently);
 }
@@ -7,5 +7,7 @@ void* xmalloc(size_t);
 void* xrealloc(void*, size_t);
 void error(char*);
 int num_places(int n);
+// Seconds on a clock that never jumps (for measuring durations and deadlines)
+double monotonic_seconds(void);
 
 #endif  // UTILS_H
@@ -0,0 +1,93 @@
+//! Rust driver of the C vs Rust comparison (see bench/compare.sh at the root of the repository).
+//! Compiles one pattern with one engine, matches every line of a corpus with it a number of times,
+//! and prints the measurements as one json object, in the same format as the C driver.
+//!
+//! Usage: cargo run --release --example compare -- <dfa|nfa_sim> <case> <pattern> <corpus> <rounds>
+
+use std::{env, fs, process, time::Instant};
+
+use regex_compiler::Regex;
+
+// Compiles are timed this many times and the fastest kept, as they're too quick to time once
+const COMPILE_ROUNDS: usize = 5;
+
+fn main() {
+    let args: Vec<String> = env::args().collect();
+    let rounds: usize = args.get(5).and_then(|r| r.parse().ok()).unwrap_or(0);
+    let compile: fn(&str) -> Regex = match args.get(1).map(String::as_str) {
+        Some("dfa") => Regex::new,
+        Some("nfa_sim") => Regex::new_nfa_sim,
+        _ => usage(&args[0]),
+    };
+    if args.len() != 6 || rounds == 0 {
+        usage(&args[0]);
+    }
+    let (engine, case, pattern) = (&args[1], &args[2], &args[3]);
+
+    let corpus = fs::read(&args[4]).unwrap_or_else(|err| {
+        eprintln!("Error: could not read {}: {}", args[4], err);
+        process::exit(1);
+    });
+    // Split on newlines only, as the C driver does (str::lines() would also drop a '\r')
+    let text = String::from_utf8_lossy(&corpus);
+    let mut lines: Vec<&str> = text.split('\n').collect();
+    if text.ends_with('\n') {
+        lines.pop();
+    }
+    let bytes: usize = lines.iter().map(|line| line.len()).sum();
+    let rss_before_kb = peak_rss_kb();
+
+    let mut compile_seconds = f64::MAX;
+    let mut regex = None;
+    for _ in 0..COMPILE_ROUNDS {
+        let start = Instant::now();
+        regex = Some(compile(pattern));
+        compile_seconds = compile_seconds.min(start.elapsed().as_secs_f64());
+    }
+    let regex = regex.unwrap();
+
+    let mut matched = 0;
+    let start = Instant::now();
+    for _ in 0..rounds {
+        matched = lines.iter().filter(|line| regex.accepts(line)).count();
+    }
+    let seconds = start.elapsed().as_secs_f64();
+
+    println!(
+        "{{\"impl\":\"rust_{}\",\"case\":\"{}\",\"lines\":{},\"bytes\":{},\"rounds\":{},\
+         \"compile_ms\":{:.3},\"mb_per_second\":{:.3},\"ns_per_line\":{:.1},\"matched\":{},\
+         \"rss_before_kb\":{},\"peak_rss_kb\":{}}}",
+        engine,
+        case,
+        lines.len(),
+        bytes,
+        rounds,
+        compile_seconds * 1e3,
+        (bytes * rounds) as f64 / seconds / 1e6,
+        seconds * 1e9 / (lines.len() * rounds).max(1) as f64,
+        matched,
+        rss_before_kb,
+        peak_rss_kb()
+    );
+}
+
+// The process's peak resident set size so far (VmHWM), or 0 where /proc isn't available
+fn peak_rss_kb() -> u64 {
+    fs::read_to_string("/proc/self/status")
+        .ok()
+        .and_then(|status| {
+            status
+                .lines()
+                .find(|line| line.starts_with("VmHWM:"))
+                .and_then(|line| line.split_whitespace().nth(1)?.parse().ok())
+        })
+        .unwrap_or(0)
+}
+
+fn usage(program: &str) -> ! {
+    eprintln!(
+        "Usage: {} <dfa|nfa_sim> <case> <pattern> <corpus> <rounds>",
+        program
+    );
+    process::exit(1);
+}
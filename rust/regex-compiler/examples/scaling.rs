@@ -0,0 +1,129 @@
+//! Multi-threaded throughput of one Regex shared by every thread through an Arc. For each thread
+//! count, compiles the pattern, starts the threads together and has each match the lines of a
+//! corpus in a loop (from a different starting line) for a fixed time, then prints the total
+//! throughput and how it scales from one thread. Engines that need scratch to match (the lazy DFA
+//! of nfa_sim) borrow it from a pool, one per thread, so both should scale with the cores.
+//!
+//! Usage: cargo run --release --example scaling -- <dfa|nfa_sim> <pattern> <corpus> [seconds]
+//!        [threads,...]
+//! The thread counts default to the powers of two up to twice the available cores. A corpus can
+//! be generated with c/regex-compiler's `main --generate`, or taken from bench/compare.sh's.
+
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::{Arc, Barrier};
+use std::time::{Duration, Instant};
+use std::{env, fs, process, thread};
+
+use regex_compiler::Regex;
+
+fn main() {
+    let args: Vec<String> = env::args().collect();
+    if args.len() < 4 || args.len() > 6 {
+        usage(&args[0]);
+    }
+    let compile: fn(&str) -> Regex = match args[1].as_str() {
+        "dfa" => Regex::new,
+        "nfa_sim" => Regex::new_nfa_sim,
+        _ => usage(&args[0]),
+    };
+    let pattern = &args[2];
+    let seconds: f64 = match args.get(4) {
+        Some(seconds) => seconds.parse().unwrap_or_else(|_| usage(&args[0])),
+        None => 1.0,
+    };
+    let thread_counts: Vec<usize> = match args.get(5) {
+        Some(list) => list
+            .split(',')
+            .map(|count| count.parse().unwrap_or_else(|_| usage(&args[0])))
+            .collect(),
+        None => {
+            let cores = thread::available_parallelism().map_or(1, |n| n.get());
+            (0..)
+                .map(|shift| 1 << shift)
+                .take_while(|count| *count <= 2 * cores)
+                .collect()
+        }
+    };
+
+    let corpus = fs::read(&args[3]).unwrap_or_else(|err| {
+        eprintln!("Error: could not read {}: {}", args[3], err);
+        process::exit(1);
+    });
+    let text = String::from_utf8_lossy(&corpus);
+    let lines: Arc<Vec<String>> = Arc::new(text.lines().map(String::from).collect());
+    if lines.is_empty() {
+        eprintln!("Error: {} has no lines", args[3]);
+        process::exit(1);
+    }
+
+    println!(
+        "{:>8} {:>10} {:>12} {:>8}",
+        "threads", "MB/s", "lines/s", "scaling"
+    );
+    let mut base = 0.0;
+    for count in thread_counts {
+        let (bytes, num_lines, elapsed) = run(compile(pattern), &lines, count, seconds);
+        let mb_per_second = bytes as f64 / elapsed / 1e6;
+        if base == 0.0 {
+            base = mb_per_second;
+        }
+        println!(
+            "{:>8} {:>10.1} {:>12.0} {:>7.2}x",
+            count,
+            mb_per_second,
+            num_lines as f64 / elapsed,
+            mb_per_second / base
+        );
+    }
+}
+
+// Matches for the given time on count threads, and returns the bytes and lines matched in total
+// and the seconds it took
+fn run(regex: Regex, lines: &Arc<Vec<String>>, count: usize, seconds: f64) -> (u64, u64, f64) {
+    let regex = Arc::new(regex);
+    let stop = Arc::new(AtomicBool::new(false));
+    // The threads and the timer start together
+    let start = Arc::new(Barrier::new(count + 1));
+
+    let handles: Vec<_> = (0..count)
+        .map(|i| {
+            let (regex, lines) = (Arc::clone(&regex), Arc::clone(lines));
+            let (stop, start) = (Arc::clone(&stop), Arc::clone(&start));
+            thread::spawn(move || {
+                let (mut bytes, mut num_lines, mut matches) = (0, 0, 0);
+                let mut line = i * lines.len() / count;
+                start.wait();
+                while !stop.load(Ordering::Relaxed) {
+                    matches += regex.accepts(&lines[line]) as u64;
+                    bytes += lines[line].len() as u64;
+                    num_lines += 1;
+                    line = (line + 1) % lines.len();
+                }
+                // Keep the matches from being optimized out
+                assert!(matches <= num_lines);
+                (bytes, num_lines)
+            })
+        })
+        .collect();
+
+    start.wait();
+    let timer = Instant::now();
+    thread::sleep(Duration::from_secs_f64(seconds));
+    stop.store(true, Ordering::Relaxed);
+
+    let (mut bytes, mut num_lines) = (0, 0);
+    for handle in handles {
+        let (thread_bytes, thread_num_lines) = handle.join().unwrap();
+        bytes += thread_bytes;
+        num_lines += thread_num_lines;
+    }
+    (bytes, num_lines, timer.elapsed().as_secs_f64())
+}
+
+fn usage(program: &str) -> ! {
+    eprintln!(
+        "Usage: {} <dfa|nfa_sim> <pattern> <corpus> [seconds] [threads,...]",
+        program
+    );
+    process::exit(1);
+}
@@ -1,104 +1,201 @@
 use std::collections::HashMap;
 
-use crate::nfa::{EpsilonClosure, NFA};
+use crate::nfa::{NFANodeIdx, NFA};
+use crate::state_sets::StateSets;
+
+// The state every transition of a byte the pattern doesn't use leads to, and that never leaves.
+// State ids are row offsets into the transition table (the state's index times the number of
+// classes), so the dead state, the first row, is 0.
+const DEAD: u32 = 0;
 
 pub struct DFA {
-    nodes: HashMap<DFANodeId, DFANode>,
-    start: DFANodeId,
+    classes: ByteClasses,
+    // The row of state s is transitions[s..s + classes.len()], indexed by byte class, and holds the
+    // ids of the next states
+    transitions: Vec<u32>,
+    // Indexed by state index (the id divided by the number of classes)
+    accepting: Vec<bool>,
+    start: u32,
 }
 
-struct DFANode {
-    id: DFANodeId,
-    is_accepting: bool,
-    edges: Vec<DFAEdge>,
+struct Builder<'a> {
+    nfa: &'a NFA,
+    classes: ByteClasses,
+    // The set of each state, by state index (the id divided by the number of classes)
+    sets: StateSets,
+    transitions: Vec<u32>,
+    accepting: Vec<bool>,
 }
 
-#[derive(Clone, PartialEq, Eq, Hash)]
-struct DFANodeId(String);
-
-struct DFAEdge {
-    literal: char,
-    to: DFANodeId,
+// Partition of the bytes into classes no NFA edge tells apart: bytes are in the same class when
+// they label exactly the same edges. Class 0 holds the bytes that label no edge at all (among them
+// every non-ASCII byte, as patterns are ASCII), which lead to the dead state from everywhere.
+pub struct ByteClasses {
+    classes: [u8; 256],
+    // A byte of each class, standing for the whole class when computing moves
+    representatives: Vec<char>,
 }
 
 impl DFA {
+    // Subset construction over byte classes. Each set of NFA nodes is interned once, as a sorted
+    // list, and gets the next row of the table.
     pub fn from_nfa(nfa: &NFA) -> Self {
-        // Map of dfa nodes that we build up
-        let mut dfa_nodes_map: HashMap<DFANodeId, DFANode> = HashMap::new();
-        // Stack of eclosures to process
-        let mut eclosures_stack = Vec::new();
-
-        // Create initial eclosure from starting node of nfa, then create dfa_node from the eclosure
-        let initial_closure = nfa.epsilon_closure(nfa.start());
-        // Create the initial dfa node from the initial closure
-        let initial_dfa_node = DFANode::from_eclosure(&initial_closure);
-        let initial_dfa_node_id = initial_dfa_node.id.clone();
-
-        eclosures_stack.push(initial_closure);
-        dfa_nodes_map.insert(initial_dfa_node_id.clone(), initial_dfa_node);
-
-        // Process the eclosures stack
-        while let Some(eclosure) = eclosures_stack.pop() {
-            for literal in nfa.character_set_iter() {
-                // Get the move set of the eclosure for the current literal
-                let move_set = nfa.compute_move_set(&eclosure, *literal);
-                if (move_set).is_empty() {
+        let mut builder = Builder::new(nfa);
+
+        // The empty set is the dead state, so it gets the first row
+        builder.intern(Vec::new());
+        let start = builder.intern(nfa.epsilon_closure_sorted(vec![nfa.start()]));
+
+        let num_classes = builder.classes.len();
+        let mut index = 1;
+        while index < builder.sets.len() {
+            let row = index * num_classes;
+
+            for class in 1..num_classes {
+                let literal = builder.classes.representative(class);
+                let move_list = nfa.compute_move_list(builder.sets.get(index), literal);
+                if move_list.is_empty() {
                     continue;
                 }
-                let next_dfa_node_id = DFANodeId(EpsilonClosure::id_for_set(&move_set));
-
-                match dfa_nodes_map.get(&next_dfa_node_id) {
-                    Some(_) => (),
-                    None => {
-                        let next_closure = nfa.epsilon_closure_set(move_set);
-                        let next_dfa_node = DFANode::from_eclosure(&next_closure);
-                        dfa_nodes_map.insert(next_dfa_node_id.clone(), next_dfa_node);
-                        eclosures_stack.push(next_closure);
-                    }
-                };
-
-                // Add an edge from current_dfa_node to the next_dfa_node
-                let current_dfa_node = dfa_nodes_map
-                    .get_mut(&DFANodeId(eclosure.id.clone()))
-                    .unwrap();
-                current_dfa_node.add_edge(*literal, next_dfa_node_id);
+                let next = builder.intern(nfa.epsilon_closure_sorted(move_list));
+                builder.transitions[row + class] = next;
             }
+
+            index += 1;
         }
 
         DFA {
-            nodes: dfa_nodes_map,
-            start: initial_dfa_node_id,
+            classes: builder.classes,
+            transitions: builder.transitions,
+            accepting: builder.accepting,
+            start,
         }
     }
 
     pub fn accepts(&self, input: &str) -> bool {
-        let mut current_node = &self.nodes[&self.start];
+        let mut state = self.start;
+
+        for byte in input.bytes() {
+            state = self.transitions[state as usize + self.classes.get(byte)];
+            if state == DEAD {
+                return false;
+            }
+        }
 
-        for c in input.chars() {
-            let next_node = match current_node.edges.iter().find(|edge| edge.literal == c) {
-                Some(edge) => &self.nodes[&edge.to],
-                None => return false,
-            };
+        self.accepting[state as usize / self.classes.len()]
+    }
 
-            current_node = next_node;
+    #[cfg(test)]
+    pub fn num_states(&self) -> usize {
+        self.accepting.len()
+    }
+}
+
+impl<'a> Builder<'a> {
+    fn new(nfa: &'a NFA) -> Self {
+        Builder {
+            nfa,
+            classes: ByteClasses::from_nfa(nfa),
+            sets: StateSets::new(),
+            transitions: Vec::new(),
+            accepting: Vec::new(),
         }
+    }
 
-        current_node.is_accepting
+    // Returns the id of the state of the set, adding a row for it if it's new
+    fn intern(&mut self, set: Vec<NFANodeIdx>) -> u32 {
+        let (index, is_new) = self.sets.insert(set);
+        if is_new {
+            self.transitions
+                .resize(self.transitions.len() + self.classes.len(), DEAD);
+            self.accepting
+                .push(self.nfa.is_accepting_list(self.sets.get(index)));
+        }
+        u32::try_from(index * self.classes.len()).expect("too many DFA states")
     }
 }
 
-impl DFANode {
-    pub fn from_eclosure(eclosure: &EpsilonClosure) -> Self {
-        let edges = Vec::new();
+impl ByteClasses {
+    pub fn from_nfa(nfa: &NFA) -> Self {
+        // The edges each byte labels, in the order literal_edges() gives them (so equal sets are
+        // equal lists)
+        let mut edges: Vec<Vec<(NFANodeIdx, NFANodeIdx)>> = vec![Vec::new(); 256];
+        for (from, literal, to) in nfa.literal_edges() {
+            debug_assert!(literal.is_ascii());
+            edges[literal as usize].push((from, to));
+        }
 
-        DFANode {
-            id: DFANodeId(eclosure.id.clone()),
-            is_accepting: eclosure.is_accepting,
-            edges,
+        let mut class_ids: HashMap<&[(NFANodeIdx, NFANodeIdx)], u8> = HashMap::new();
+        class_ids.insert(&[], 0);
+        let mut classes = [0; 256];
+        let mut representatives = vec!['\0'];
+        for (byte, byte_edges) in edges.iter().enumerate() {
+            let next_id = representatives.len() as u8;
+            let id = *class_ids.entry(byte_edges.as_slice()).or_insert(next_id);
+            if id == next_id {
+                representatives.push(byte as u8 as char);
+            }
+            classes[byte] = id;
+        }
+
+        ByteClasses {
+            classes,
+            representatives,
         }
     }
 
-    pub fn add_edge(&mut self, literal: char, to: DFANodeId) {
-        self.edges.push(DFAEdge { literal, to });
+    pub fn get(&self, byte: u8) -> usize {
+        self.classes[byte as usize] as usize
+    }
+
+    pub fn representative(&self, class: usize) -> char {
+        self.representatives[class]
+    }
+
+    // Number of classes, class 0 included
+    pub fn len(&self) -> usize {
+        self.representatives.len()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::parse::Parser;
+
+    fn dfa(pattern: &str) -> DFA {
+        DFA::from_nfa(&NFA::from_ast(&Parser::parse(pattern).unwrap()))
+    }
+
+    #[test]
+    fn it_groups_bytes_into_classes() {
+        let dfa = dfa("[a-z]+x|[0-9]");
+
+        // Unused bytes, [a-wyz], x and [0-9]
+        assert_eq!(dfa.classes.len(), 4);
+        assert_eq!(dfa.classes.get(b'a'), dfa.classes.get(b'q'));
+        assert_ne!(dfa.classes.get(b'a'), dfa.classes.get(b'x'));
+        assert_eq!(dfa.classes.get(b'0'), dfa.classes.get(b'9'));
+        assert_eq!(dfa.classes.get(b'A'), 0);
+        assert_eq!(dfa.classes.get(0xc3), 0);
+    }
+
+    #[test]
+    fn it_builds_one_state_per_set() {
+        // Dead, and the 5 sets of the textbook construction (not minimal: the start and the state
+        // after a b are equivalent)
+        assert_eq!(dfa("(a|b)*abb").num_states(), 6);
+        // Dead, the start, and one for each of the 8 ways the last 3 bytes can be a or b
+        assert_eq!(dfa("(a|b)*a(a|b)(a|b)").num_states(), 10);
+    }
+
+    #[test]
+    fn it_rejects_bytes_outside_the_pattern() {
+        let dfa = dfa("caf.*");
+
+        assert_eq!(dfa.accepts("cafe"), true);
+        assert_eq!(dfa.accepts("café"), false);
+        assert_eq!(dfa.accepts("cab"), false);
+        assert_eq!(dfa.accepts("ca"), false);
     }
 }
@@ -0,0 +1,218 @@
+use crate::dfa::ByteClasses;
+use crate::nfa::{NFANodeIdx, NFA};
+use crate::pool::Pool;
+use crate::state_sets::StateSets;
+
+// As in the DFA, state ids are row offsets into the transition table and the dead state is row 0
+const DEAD: u32 = 0;
+// A transition not computed yet
+const UNKNOWN: u32 = u32::MAX;
+// States a cache holds before it is reset, the dead and start states included
+pub const DEFAULT_CACHE_STATES: usize = 4096;
+
+// An NFA simulation that builds the DFA it walks as it goes: each transition is computed from the
+// NFA the first time an input takes it, then looked up in a table like the DFA's. The states and
+// transitions found stay in a cache for the next inputs, so matching gets faster as the cache
+// warms up, while states no input reaches are never built.
+//
+// Matching needs a cache to itself, so the caches are kept in a pool: an input borrows one (or
+// starts a new one if the pool has none for the thread) and returns it when done. Threads
+// matching concurrently each get one of their own, which is also the one they warmed up before
+// (see pool.rs).
+pub struct LazyDFA {
+    nfa: NFA,
+    classes: ByteClasses,
+    cache_states: usize,
+    caches: Pool<Cache>,
+}
+
+// The part of the DFA found so far. When it holds cache_states states and needs a new one, it is
+// cleared and starts over from the dead and start states, rather than evicting states one by one:
+// the transitions into an evicted state would have to be found and cleared too.
+struct Cache {
+    // The set of NFA nodes of each state, by state index (the id divided by the number of classes)
+    sets: StateSets,
+    transitions: Vec<u32>,
+    accepting: Vec<bool>,
+    start: u32,
+    resets: usize,
+}
+
+impl LazyDFA {
+    pub fn from_nfa(nfa: NFA) -> Self {
+        LazyDFA::with_cache_states(nfa, DEFAULT_CACHE_STATES)
+    }
+
+    // cache_states is raised to 3, as a cache needs room for the dead and start states and one more
+    pub fn with_cache_states(nfa: NFA, cache_states: usize) -> Self {
+        LazyDFA {
+            classes: ByteClasses::from_nfa(&nfa),
+            nfa,
+            cache_states: cache_states.max(3),
+            caches: Pool::new(),
+        }
+    }
+
+    pub fn accepts(&self, input: &str) -> bool {
+        let mut cache = self.caches.get(|| Cache::new(self));
+        self.accepts_with(&mut cache, input)
+    }
+
+    fn accepts_with(&self, cache: &mut Cache, input: &str) -> bool {
+        let mut state = cache.start;
+
+        for byte in input.bytes() {
+            let class = self.classes.get(byte);
+            let mut next = cache.transitions[state as usize + class];
+            if next == UNKNOWN {
+                next = self.compute_transition(cache, state, class);
+            }
+            if next == DEAD {
+                return false;
+            }
+            state = next;
+        }
+
+        cache.accepting[state as usize / self.classes.len()]
+    }
+
+    // Computes the state the class leads to from the state and adds it to the cache if it's new.
+    // A reset to make room leaves the transition out (the state it's from is gone), but the id
+    // returned is valid in the reset cache.
+    fn compute_transition(&self, cache: &mut Cache, state: u32, class: usize) -> u32 {
+        let index = state as usize / self.classes.len();
+        let move_list = self
+            .nfa
+            .compute_move_list(cache.sets.get(index), self.classes.representative(class));
+        let set = self.nfa.epsilon_closure_sorted(move_list);
+
+        if let Some(index) = cache.sets.find(&set) {
+            let next = (index * self.classes.len()) as u32;
+            cache.transitions[state as usize + class] = next;
+            return next;
+        }
+        if cache.sets.len() >= self.cache_states {
+            cache.reset(self);
+            return cache.intern(self, set);
+        }
+
+        let next = cache.intern(self, set);
+        cache.transitions[state as usize + class] = next;
+        next
+    }
+}
+
+impl Cache {
+    fn new(dfa: &LazyDFA) -> Self {
+        let mut cache = Cache {
+            sets: StateSets::new(),
+            transitions: Vec::new(),
+            accepting: Vec::new(),
+            start: DEAD,
+            resets: 0,
+        };
+        cache.add_initial_states(dfa);
+        cache
+    }
+
+    fn reset(&mut self, dfa: &LazyDFA) {
+        self.sets.clear();
+        self.transitions.clear();
+        self.accepting.clear();
+        self.resets += 1;
+        self.add_initial_states(dfa);
+    }
+
+    fn add_initial_states(&mut self, dfa: &LazyDFA) {
+        // The empty set is the dead state, so it gets the first row
+        self.intern(dfa, Vec::new());
+        let nfa = &dfa.nfa;
+        self.start = self.intern(dfa, nfa.epsilon_closure_sorted(vec![nfa.start()]));
+    }
+
+    // Returns the id of the state of the set, adding a row for it if it's new. Only the transitions
+    // of class 0 are known up front: they lead to the dead state.
+    fn intern(&mut self, dfa: &LazyDFA, set: Vec<NFANodeIdx>) -> u32 {
+        let (index, is_new) = self.sets.insert(set);
+        if is_new {
+            let fill = if index == 0 { DEAD } else { UNKNOWN };
+            self.transitions.push(DEAD);
+            self.transitions
+                .resize(self.transitions.len() + dfa.classes.len() - 1, fill);
+            self.accepting
+                .push(dfa.nfa.is_accepting_list(self.sets.get(index)));
+        }
+        u32::try_from(index * dfa.classes.len()).expect("too many DFA states")
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::dfa::DFA;
+    use crate::parse::Parser;
+
+    fn nfa(pattern: &str) -> NFA {
+        NFA::from_ast(&Parser::parse(pattern).unwrap())
+    }
+
+    // The states and resets of the caches, which the tests only ever have one of
+    fn cache_stats(dfa: &LazyDFA) -> (usize, usize) {
+        let mut stats = vec![];
+        dfa.caches
+            .for_each(|cache| stats.push((cache.sets.len(), cache.resets)));
+        assert_eq!(stats.len(), 1);
+        stats[0]
+    }
+
+    #[test]
+    fn it_keeps_states_across_inputs() {
+        let dfa = LazyDFA::from_nfa(nfa("(a|b)*abb"));
+
+        assert_eq!(dfa.accepts("abb"), true);
+        let (states, _) = cache_stats(&dfa);
+        // Dead, start, and after a, ab and abb
+        assert_eq!(states, 5);
+
+        assert_eq!(dfa.accepts("aabb"), true);
+        assert_eq!(dfa.accepts("babb"), true);
+        assert_eq!(dfa.accepts("abab"), false);
+        // Only the state after a leading b was new (the DFA has it too, see dfa.rs)
+        assert_eq!(cache_stats(&dfa), (6, 0));
+    }
+
+    #[test]
+    fn it_resets_a_full_cache_and_still_matches() {
+        let pattern = "(a|b)*a(a|b)(a|b)(a|b)";
+        let dfa = DFA::from_nfa(&nfa(pattern));
+        let lazy = LazyDFA::with_cache_states(nfa(pattern), 4);
+
+        let mut seed: u32 = 42;
+        for _ in 0..200 {
+            let input: String = (0..12)
+                .map(|_| {
+                    seed = seed.wrapping_mul(1103515245).wrapping_add(12345);
+                    if (seed >> 16) % 2 == 0 {
+                        'a'
+                    } else {
+                        'b'
+                    }
+                })
+                .collect();
+            assert_eq!(lazy.accepts(&input), dfa.accepts(&input), "{}", input);
+        }
+
+        let (states, resets) = cache_stats(&lazy);
+        assert!(states <= 4);
+        assert!(resets > 0);
+    }
+
+    #[test]
+    fn it_rejects_bytes_outside_the_pattern() {
+        let dfa = LazyDFA::from_nfa(nfa("caf.*"));
+
+        assert_eq!(dfa.accepts("cafe"), true);
+        assert_eq!(dfa.accepts("café"), false);
+        assert_eq!(dfa.accepts(""), false);
+    }
+}
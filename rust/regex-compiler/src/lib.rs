@@ -1,8 +1,11 @@
 mod alphabet;
 mod ast;
 mod dfa;
+mod lazy_dfa;
 mod nfa;
 mod parse;
+mod pool;
 mod regex;
+mod state_sets;
 
 pub use regex::Regex;
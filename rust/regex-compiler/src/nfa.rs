@@ -1,10 +1,9 @@
 use crate::alphabet::Alphabet;
 use crate::ast::{AstNode, AstNodeLayer, AstTopo, ComputeCharacters, RepetitionKind};
-use std::collections::{HashMap, HashSet};
+use std::collections::HashSet;
 
 struct Builder {
     nodes: Vec<NFANode>,
-    character_set: HashSet<char>,
     start: Option<NFANodeIdx>,
 }
 
@@ -12,7 +11,6 @@ struct Builder {
 pub struct NFA {
     nodes: Vec<NFANode>,
     start: NFANodeIdx,
-    character_set: HashSet<char>,
 }
 
 #[derive(Clone, Debug)]
@@ -27,95 +25,76 @@ pub enum NFAEdge {
     Literal { literal: char, to: NFANodeIdx },
 }
 
-#[derive(Clone, PartialEq, Eq, Hash, Copy, Debug)]
+#[derive(Clone, PartialEq, Eq, PartialOrd, Ord, Hash, Copy, Debug)]
 pub struct NFANodeIdx(usize);
 
-#[derive(PartialEq, Eq, Clone)]
-pub struct EpsilonClosure {
-    pub id: String,
-    pub is_accepting: bool,
-    nodes: HashSet<NFANodeIdx>,
-}
-
 impl NFA {
     pub fn from_ast(root: &AstNode) -> Self {
         let mut builder = Builder::new();
         builder.from_ast(root).build()
     }
 
-    pub fn accepts(&self, input: &str) -> bool {
-        let mut move_set_cache = HashMap::new();
-        let mut closure_cache = HashMap::new();
-
-        let mut current = self.epsilon_closure(self.start);
-        closure_cache.insert(current.id.clone(), current.clone());
-
-        for c in input.chars() {
-            let move_set = move_set_cache
-                .entry((current.id.clone(), c))
-                .or_insert_with(|| self.compute_move_set(&current, c))
-                .clone();
-
-            if (move_set).is_empty() {
-                return false;
-            }
-
-            current = closure_cache
-                .entry(EpsilonClosure::id_for_set(&move_set))
-                .or_insert_with(|| self.epsilon_closure_set(move_set))
-                .clone();
-        }
-
-        current.is_accepting
-    }
-
     pub fn start(&self) -> NFANodeIdx {
         self.start
     }
 
-    pub fn character_set_iter(&self) -> impl Iterator<Item = &char> {
-        self.character_set.iter()
-    }
-
-    // Returns the epsilon closure of a given NFA node
-    pub fn epsilon_closure(&self, node: NFANodeIdx) -> EpsilonClosure {
-        self.epsilon_closure_set(HashSet::from([node]))
+    // Returns every literal edge as (from, literal, to)
+    pub fn literal_edges(&self) -> impl Iterator<Item = (NFANodeIdx, char, NFANodeIdx)> + '_ {
+        self.nodes.iter().enumerate().flat_map(|(from, node)| {
+            node.edges.iter().filter_map(move |edge| match edge {
+                NFAEdge::Literal { literal, to } => Some((NFANodeIdx(from), *literal, *to)),
+                NFAEdge::Epsilon { .. } => None,
+            })
+        })
     }
 
-    // Returns the epsilon closure of a given set of NFA nodes
-    pub fn epsilon_closure_set(&self, node_set: HashSet<NFANodeIdx>) -> EpsilonClosure {
-        let id = EpsilonClosure::id_for_set(&node_set);
-        let mut closure_set = HashSet::new();
-        let mut stack: Vec<_> = node_set.into_iter().collect();
+    // Returns the epsilon closure of a list of NFA nodes, sorted and without duplicates so that equal
+    // sets are equal lists (and can be interned as they are)
+    pub fn epsilon_closure_sorted(&self, nodes: Vec<NFANodeIdx>) -> Vec<NFANodeIdx> {
+        let mut seen = vec![false; self.nodes.len()];
+        let mut closure = Vec::new();
+        let mut stack = nodes;
 
         while let Some(idx) = stack.pop() {
-            closure_set.insert(idx);
+            if seen[idx.0] {
+                continue;
+            }
+            seen[idx.0] = true;
+            closure.push(idx);
 
             for edge in &self.node(idx).edges {
                 if let NFAEdge::Epsilon { to } = edge {
-                    if !closure_set.contains(to) {
+                    if !seen[to.0] {
                         stack.push(*to);
                     }
                 }
             }
         }
 
-        let is_accepting = closure_set.iter().any(|idx| self.node(*idx).is_accepting);
-
-        EpsilonClosure::new(id, closure_set, is_accepting)
+        closure.sort_unstable();
+        closure
     }
 
-    //  Gicen a literal, returns the move set for a given set of NFA nodes.
-    pub fn compute_move_set(&self, closure: &EpsilonClosure, literal: char) -> HashSet<NFANodeIdx> {
-        let mut move_set = HashSet::new();
+    // Returns the nodes a literal leads to from a list of NFA nodes, not closed over epsilon edges and
+    // possibly with duplicates (epsilon_closure_sorted() drops them)
+    pub fn compute_move_list(&self, nodes: &[NFANodeIdx], literal: char) -> Vec<NFANodeIdx> {
+        let mut move_list = Vec::new();
 
-        for idx in closure.nodes.iter() {
-            if let Some(to) = self.node(*idx).find_transition(literal) {
-                move_set.insert(to);
+        for idx in nodes {
+            for edge in &self.node(*idx).edges {
+                if let NFAEdge::Literal { literal: l, to } = edge {
+                    if *l == literal {
+                        move_list.push(*to);
+                    }
+                }
             }
         }
 
-        move_set
+        move_list
+    }
+
+    pub fn is_accepting_list(&self, nodes: &[NFANodeIdx]) -> bool {
+        nodes.iter().any(|idx| self.node(*idx).is_accepting)
     }
 
     fn node(&self, idx: NFANodeIdx) -> &NFANode {
@@ -127,7 +106,6 @@ impl Builder {
     pub fn new() -> Self {
         Builder {
             nodes: vec![],
-            character_set: HashSet::new(),
             start: None,
         }
     }
@@ -135,7 +113,6 @@ impl Builder {
     pub fn build(&self) -> NFA {
         NFA {
             nodes: self.nodes.clone(),
-            character_set: self.character_set.clone(),
             start: self.start.unwrap(),
         }
     }
@@ -206,23 +183,19 @@ impl Builder {
                 }
                 AstNodeLayer::Dot => {
                     let characters = Alphabet::all_characters();
-                    self.character_set.extend(characters.iter().cloned());
                     self.add_alteration_system_for_characters(&characters)
                 }
                 AstNodeLayer::CharacterClass(character_class) => {
                     let characters = character_class.compute_characters();
-                    self.character_set.extend(characters.iter().cloned());
                     self.add_alteration_system_for_characters(&characters)
                 }
                 AstNodeLayer::ClassBracketed(class_bracketed) => {
                     let characters = class_bracketed.compute_characters();
-                    self.character_set.extend(characters.iter().cloned());
                     self.add_alteration_system_for_characters(&characters)
                 }
                 AstNodeLayer::Literal { value } => {
                     let mut characters = HashSet::new();
                     characters.insert(value);
-                    self.character_set.insert(value);
                     self.add_alteration_system_for_characters(&characters)
                 }
             };
@@ -283,40 +256,4 @@ impl NFANode {
         self.edges.push(edge);
         self
     }
-
-    pub fn find_transition(&self, literal: char) -> Option<NFANodeIdx> {
-        self.edges
-            .iter()
-            .find(|edge| match edge {
-                NFAEdge::Literal { literal: l, .. } => *l == literal,
-                _ => false,
-            })
-            .map(|edge| edge.to())
-    }
-}
-
-impl NFAEdge {
-    pub fn to(&self) -> NFANodeIdx {
-        match self {
-            NFAEdge::Epsilon { to } => *to,
-            NFAEdge::Literal { to, .. } => *to,
-        }
-    }
-}
-
-impl EpsilonClosure {
-    pub fn new(id: String, nodes: HashSet<NFANodeIdx>, is_accepting: bool) -> Self {
-        EpsilonClosure {
-            id,
-            is_accepting,
-            nodes,
-        }
-    }
-
-    pub fn id_for_set(set: &HashSet<NFANodeIdx>) -> String {
-        set.iter()
-            .map(|idx| idx.0.to_string())
-            .collect::<Vec<String>>()
-            .join(",")
-    }
 }
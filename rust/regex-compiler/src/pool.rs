@@ -0,0 +1,149 @@
+use std::ops::{Deref, DerefMut};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Mutex;
+use std::thread;
+
+// Slots per available core, so that threads mostly have a slot to themselves
+const SLOTS_PER_CORE: usize = 2;
+
+// A pool of values that matching borrows for the length of one input, such as the caches of a lazy
+// DFA. Values are kept in slots, each a stack behind a lock of its own, and a thread always
+// borrows from and returns to the same slot: as long as there are no more threads than slots,
+// each thread has its slot (and its lock) to itself, and gets back the value it warmed up last
+// time. Threads that share a slot only wait on each other for the pop or push, not for the match.
+pub struct Pool<T> {
+    slots: Box<[Slot<T>]>,
+}
+
+// Aligned to a cache line, so that threads on different slots don't write to the same line
+#[repr(align(64))]
+struct Slot<T>(Mutex<Vec<T>>);
+
+// A value borrowed from a pool, returned to it when dropped
+pub struct PoolGuard<'a, T> {
+    pool: &'a Pool<T>,
+    slot: usize,
+    value: Option<T>,
+}
+
+impl<T> Pool<T> {
+    pub fn new() -> Self {
+        let cores = thread::available_parallelism().map_or(1, |n| n.get());
+        Pool::with_slots(cores * SLOTS_PER_CORE)
+    }
+
+    pub fn with_slots(num_slots: usize) -> Self {
+        Pool {
+            slots: (0..num_slots.max(1))
+                .map(|_| Slot(Mutex::new(Vec::new())))
+                .collect(),
+        }
+    }
+
+    // Borrows a value of the thread's slot, or a new one from create if the slot has none
+    pub fn get(&self, create: impl FnOnce() -> T) -> PoolGuard<'_, T> {
+        let slot = thread_index() % self.slots.len();
+        let value = self.slots[slot].0.lock().unwrap().pop();
+
+        PoolGuard {
+            pool: self,
+            slot,
+            value: Some(value.unwrap_or_else(create)),
+        }
+    }
+
+    // Calls f with every value in the pool (not the borrowed ones)
+    #[cfg(test)]
+    pub fn for_each(&self, mut f: impl FnMut(&T)) {
+        for slot in self.slots.iter() {
+            slot.0.lock().unwrap().iter().for_each(&mut f);
+        }
+    }
+}
+
+impl<'a, T> Deref for PoolGuard<'a, T> {
+    type Target = T;
+
+    fn deref(&self) -> &T {
+        self.value.as_ref().unwrap()
+    }
+}
+
+impl<'a, T> DerefMut for PoolGuard<'a, T> {
+    fn deref_mut(&mut self) -> &mut T {
+        self.value.as_mut().unwrap()
+    }
+}
+
+impl<'a, T> Drop for PoolGuard<'a, T> {
+    fn drop(&mut self) {
+        if let Some(value) = self.value.take() {
+            // A poisoned slot (a match panicked while popping or pushing) just loses the value
+            if let Ok(mut values) = self.pool.slots[self.slot].0.lock() {
+                values.push(value);
+            }
+        }
+    }
+}
+
+// A small number for the current thread, given out in the order threads first ask for one
+fn thread_index() -> usize {
+    static NEXT_INDEX: AtomicUsize = AtomicUsize::new(0);
+    thread_local! {
+        static INDEX: usize = NEXT_INDEX.fetch_add(1, Ordering::Relaxed);
+    }
+    INDEX.with(|index| *index)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::sync::Arc;
+
+    #[test]
+    fn it_gives_a_thread_back_its_value() {
+        let pool = Pool::with_slots(4);
+
+        *pool.get(|| 0) += 1;
+        *pool.get(|| 0) += 1;
+        assert_eq!(*pool.get(|| 0), 2);
+    }
+
+    #[test]
+    fn it_creates_a_value_per_concurrent_borrow() {
+        let pool = Pool::with_slots(1);
+
+        let first = pool.get(|| 1);
+        let second = pool.get(|| 2);
+        assert_eq!((*first, *second), (1, 2));
+        drop(first);
+        drop(second);
+
+        let mut values = vec![];
+        pool.for_each(|value| values.push(*value));
+        assert_eq!(values, vec![1, 2]);
+    }
+
+    #[test]
+    fn it_is_shared_by_threads() {
+        let pool = Arc::new(Pool::with_slots(2));
+
+        let handles: Vec<_> = (0..8)
+            .map(|_| {
+                let pool = Arc::clone(&pool);
+                thread::spawn(move || {
+                    for _ in 0..1000 {
+                        *pool.get(|| 0) += 1;
+                    }
+                })
+            })
+            .collect();
+        for handle in handles {
+            handle.join().unwrap();
+        }
+
+        let mut total = 0;
+        pool.for_each(|value| total += value);
+        assert_eq!(total, 8000);
+    }
+}
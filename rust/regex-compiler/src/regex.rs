@@ -1,12 +1,16 @@
 use crate::dfa::DFA;
+use crate::lazy_dfa::LazyDFA;
 use crate::nfa::NFA;
 use crate::parse::Parser;
 
+// A compiled pattern. Matching takes &self and every engine is Send + Sync, so one Regex can be
+// shared by threads (e.g. in an Arc) and match on all of them at once.
 pub struct Regex {
     matcher: Box<dyn Matcher>,
 }
 
-trait Matcher {
+// Engines that need mutable state to match, like the lazy DFA, borrow it from a Pool
+trait Matcher: Send + Sync {
     fn accepts(&self, input: &str) -> bool;
 }
 
@@ -16,7 +20,7 @@ impl Matcher for DFA {
     }
 }
 
-impl Matcher for NFA {
+impl Matcher for LazyDFA {
     fn accepts(&self, input: &str) -> bool {
         self.accepts(input)
     }
@@ -36,9 +40,10 @@ impl Regex {
     pub fn new_nfa_sim(pattern: &str) -> Self {
         let ast = Parser::parse(pattern).unwrap();
         let nfa = NFA::from_ast(&ast);
+        let lazy_dfa = LazyDFA::from_nfa(nfa);
 
         Regex {
-            matcher: Box::new(nfa),
+            matcher: Box::new(lazy_dfa),
         }
     }
 
@@ -69,6 +74,8 @@ impl Regex {
 #[cfg(test)]
 mod tests {
     use super::*;
+    use std::sync::Arc;
+    use std::thread;
 
     #[test]
     fn it_accepts_matches_exactly() {
@@ -309,4 +316,26 @@ mod tests {
         assert_eq!(regex.accepts("hello world"), true);
         assert_eq!(regex.accepts("123"), false);
     }
+
+    #[test]
+    fn it_matches_from_many_threads_at_once() {
+        for compile in [Regex::new, Regex::new_nfa_sim] {
+            let regex = Arc::new(compile(r"[a-z]+@[a-z]+\.(com|org)"));
+
+            let handles: Vec<_> = (0..4)
+                .map(|i| {
+                    let regex = Arc::clone(&regex);
+                    thread::spawn(move || {
+                        for _ in 0..100 {
+                            assert_eq!(regex.accepts(&format!("user{}@example.com", i)), false);
+                            assert_eq!(regex.accepts("user@example.org"), true);
+                        }
+                    })
+                })
+                .collect();
+            for handle in handles {
+                handle.join().unwrap();
+            }
+        }
+    }
 }
@@ -0,0 +1,104 @@
+use std::collections::hash_map::RandomState;
+use std::collections::HashMap;
+use std::hash::BuildHasher;
+
+use crate::nfa::NFANodeIdx;
+
+// No next index in a chain
+const END: u32 = u32::MAX;
+
+// The sets of NFA nodes of DFA states, by state index. Each set is stored once: rather than keying
+// a map by the sets themselves, a map from the hash of a set gives the last state added with that
+// hash, and the states that share a hash are chained through next.
+pub struct StateSets {
+    sets: Vec<Vec<NFANodeIdx>>,
+    last_by_hash: HashMap<u64, u32>,
+    // The state added before this one with the same hash, or END
+    next: Vec<u32>,
+    hasher: RandomState,
+}
+
+impl StateSets {
+    pub fn new() -> Self {
+        StateSets {
+            sets: Vec::new(),
+            last_by_hash: HashMap::new(),
+            next: Vec::new(),
+            hasher: RandomState::new(),
+        }
+    }
+
+    // Returns the index of the set, and whether it was new (and added with the next index)
+    pub fn insert(&mut self, set: Vec<NFANodeIdx>) -> (usize, bool) {
+        let hash = self.hasher.hash_one(set.as_slice());
+        if let Some(index) = self.find_hashed(&set, hash) {
+            return (index, false);
+        }
+
+        let index = u32::try_from(self.sets.len())
+            .ok()
+            .filter(|index| *index != END)
+            .expect("too many DFA states");
+        self.next
+            .push(self.last_by_hash.insert(hash, index).unwrap_or(END));
+        self.sets.push(set);
+        (index as usize, true)
+    }
+
+    pub fn find(&self, set: &[NFANodeIdx]) -> Option<usize> {
+        self.find_hashed(set, self.hasher.hash_one(set))
+    }
+
+    pub fn get(&self, index: usize) -> &[NFANodeIdx] {
+        &self.sets[index]
+    }
+
+    pub fn len(&self) -> usize {
+        self.sets.len()
+    }
+
+    pub fn clear(&mut self) {
+        self.sets.clear();
+        self.last_by_hash.clear();
+        self.next.clear();
+    }
+
+    fn find_hashed(&self, set: &[NFANodeIdx], hash: u64) -> Option<usize> {
+        let mut index = self.last_by_hash.get(&hash).copied().unwrap_or(END);
+        while index != END {
+            if self.sets[index as usize] == set {
+                return Some(index as usize);
+            }
+            index = self.next[index as usize];
+        }
+        None
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::nfa::NFA;
+    use crate::parse::Parser;
+
+    #[test]
+    fn it_stores_each_set_once() {
+        let nfa = NFA::from_ast(&Parser::parse("ab").unwrap());
+        let start = nfa.epsilon_closure_sorted(vec![nfa.start()]);
+        let after_a = nfa.epsilon_closure_sorted(nfa.compute_move_list(&start, 'a'));
+        let mut sets = StateSets::new();
+
+        assert_eq!(sets.insert(vec![]), (0, true));
+        assert_eq!(sets.insert(start.clone()), (1, true));
+        assert_eq!(sets.insert(after_a.clone()), (2, true));
+        assert_eq!(sets.insert(start.clone()), (1, false));
+        assert_eq!(sets.insert(vec![]), (0, false));
+        assert_eq!(sets.len(), 3);
+        assert_eq!(sets.get(2), after_a.as_slice());
+        assert_eq!(sets.find(&after_a), Some(2));
+
+        sets.clear();
+        assert_eq!(sets.find(&after_a), None);
+        assert_eq!(sets.insert(after_a), (0, true));
+    }
+}